@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Measures the cgroup walk and checks the attribution. Builds
+ * a fake cgroup v2 hierarchy in a temporary directory with pods
+ * of 10 containers each, then adds CPU time to the containers
+ * and replaces some of them between the scans, outside of the
+ * timed part. At the end the attributed energy must add up to
+ * the energy handed out. The hierarchy is created in /tmp or the
+ * directory given by -d, a tmpfs like /dev/shm comes closest to
+ * the real cgroup filesystem. Build with 'make benchcgroup'.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/cgroups.h"
+#include "../src/main.h"
+
+
+// ----
+
+
+// Containers per pod.
+#define PODSIZE 10
+
+// Package and x86 cores energy per scan in joule.
+#define PKG 100.0
+#define PP0 60.0
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+// Root of the fake hierarchy.
+static char root[256];
+
+// CPU time of each container in microseconds,
+// 0 if it doesn't exist.
+static uint64_t *usage;
+
+// CPU time of each pod and the root. Like the kernel
+// they keep the time of removed children.
+static uint64_t *pods;
+static uint64_t total;
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t gettime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * Writes the cpu.stat of a cgroup.
+ *
+ *  - dir: Directory of the cgroup.
+ *  - usec: Usage in microseconds.
+ */
+static void writestat(const char *dir, uint64_t usec) {
+	char path[1024];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", dir);
+
+	if (!(f = fopen(path, "w"))) {
+		exit_error(1, "ERROR: Couldn't write %s\n", path);
+	}
+
+	fprintf(f, "usage_usec %" PRIu64 "\nuser_usec %" PRIu64 "\nsystem_usec 0\n", usec, usec);
+	fclose(f);
+}
+
+
+/*
+ * Adds CPU time to a container, it's pod and the root.
+ *
+ *  - c: Container.
+ *  - usec: CPU time in microseconds.
+ */
+static void use(uint32_t c, uint64_t usec) {
+	usage[c] += usec;
+	pods[c / PODSIZE] += usec;
+	total += usec;
+}
+
+
+/*
+ * Writes the usage of all cgroups.
+ *
+ *  - containers: Number of containers.
+ */
+static void writetree(uint32_t containers) {
+	char dir[512];
+
+	for (uint32_t c = 0; c < containers; c++) {
+		if (usage[c]) {
+			snprintf(dir, sizeof(dir), "%s/pod%u/ctr%u", root, c / PODSIZE, c);
+			writestat(dir, usage[c]);
+		}
+
+		if (c % PODSIZE == 0) {
+			snprintf(dir, sizeof(dir), "%s/pod%u", root, c / PODSIZE);
+			writestat(dir, pods[c / PODSIZE]);
+		}
+	}
+
+	writestat(root, total);
+}
+
+
+/*
+ * Removes the hierarchy.
+ *
+ *  - containers: Number of containers.
+ */
+static void removetree(uint32_t containers) {
+	char path[512];
+
+	for (uint32_t c = 0; c < containers; c++) {
+		snprintf(path, sizeof(path), "%s/pod%u/ctr%u/cpu.stat", root, c / PODSIZE, c);
+		unlink(path);
+		*strrchr(path, '/') = '\0';
+		rmdir(path);
+
+		if (c % PODSIZE == PODSIZE - 1) {
+			snprintf(path, sizeof(path), "%s/pod%u/cpu.stat", root, c / PODSIZE);
+			unlink(path);
+			*strrchr(path, '/') = '\0';
+			rmdir(path);
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", root);
+	unlink(path);
+	rmdir(root);
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	const char *parent = "/tmp";
+	uint32_t containers = 5000;
+	uint32_t scans = 100;
+	uint64_t elapsed = 0;
+	int32_t ch;
+	char dir[512];
+
+	while ((ch = getopt(argc, argv, "d:n:s:")) != -1) {
+		switch (ch) {
+			case 'd':
+				parent = optarg;
+				break;
+
+			case 'n':
+				containers = strtoul(optarg, NULL, 10) / PODSIZE * PODSIZE;
+				break;
+
+			case 's':
+				scans = strtoul(optarg, NULL, 10);
+				break;
+
+			default:
+				fprintf(stderr, "Usage: benchcgroup [-d directory] [-n containers] [-s scans]\n");
+				return 1;
+		}
+	}
+
+	if (!containers || !(usage = calloc(containers, sizeof(uint64_t)))
+			|| !(pods = calloc(containers / PODSIZE, sizeof(uint64_t)))) {
+		exit_error(1, "%s\n", "ERROR: No containers");
+	}
+
+	snprintf(root, sizeof(root), "%s/benchcgroup.XXXXXX", parent);
+
+	if (!mkdtemp(root)) {
+		exit_error(1, "%s\n", "ERROR: Couldn't create the hierarchy");
+	}
+
+	for (uint32_t c = 0; c < containers; c++) {
+		if (c % PODSIZE == 0) {
+			snprintf(dir, sizeof(dir), "%s/pod%u", root, c / PODSIZE);
+			mkdir(dir, 0755);
+		}
+
+		snprintf(dir, sizeof(dir), "%s/pod%u/ctr%u", root, c / PODSIZE, c);
+		mkdir(dir, 0755);
+		use(c, 1);
+	}
+
+	writetree(containers);
+
+	opencgroups(root);
+	scancgroups();
+
+	// Each scan each container uses up to 20ms and one in
+	// a hundred is replaced. The fake CPU time is far more
+	// than the real system uses, so all energy is handed out.
+	srandom(1);
+
+	for (uint32_t s = 0; s < scans; s++) {
+		for (uint32_t c = 0; c < containers; c++) {
+			snprintf(dir, sizeof(dir), "%s/pod%u/ctr%u", root, c / PODSIZE, c);
+
+			if (usage[c] && random() % 100 == 0) {
+				char path[sizeof(dir) + 16];
+
+				snprintf(path, sizeof(path), "%s/cpu.stat", dir);
+				unlink(path);
+				rmdir(dir);
+				usage[c] = 0;
+			} else if (!usage[c]) {
+				mkdir(dir, 0755);
+				use(c, 1 + random() % 20000);
+			} else {
+				use(c, random() % 20000);
+			}
+		}
+
+		writetree(containers);
+
+		uint64_t start = gettime();
+
+		uint32_t present = scancgroups();
+		attributecgroups(PKG, PP0);
+
+		elapsed += gettime() - start;
+
+		if (s == 0) {
+			printf("%u cgroups\n", present);
+		}
+	}
+
+	// Everything went to the containers, which are the
+	// only ones using CPU time themselves.
+	double pkg = 0;
+	double pp0 = 0;
+	uint32_t removed = 0;
+	uint32_t ok = 1;
+
+	const cgroup_t *cgroup;
+	uint32_t iter = 0;
+
+	while ((cgroup = nextcgroup(&iter))) {
+		removed += cgroup->removed != 0;
+	}
+
+	for (uint32_t c = 0; c < containers; c++) {
+		snprintf(dir, sizeof(dir), "/pod%u/ctr%u", c / PODSIZE, c);
+
+		if ((cgroup = getcgroup(dir))) {
+			pkg += cgroup->pkg_energy;
+			pp0 += cgroup->pp0_energy;
+		}
+
+		if (c % PODSIZE == 0) {
+			snprintf(dir, sizeof(dir), "/pod%u", c / PODSIZE);
+
+			if ((cgroup = getcgroup(dir)) && cgroup->pkg_energy > 0) {
+				printf("ERROR: %s has %.3f J\n", dir, cgroup->pkg_energy);
+				ok = 0;
+			}
+		}
+	}
+
+	if (fabs(pkg - PKG * scans) > 1e-6 * PKG * scans
+			|| fabs(pp0 - PP0 * scans) > 1e-6 * PP0 * scans) {
+		printf("ERROR: %.3f J package and %.3f J x86 cores attributed\n", pkg, pp0);
+		ok = 0;
+	}
+
+	printf("%u scans in %.3f s\n", scans, elapsed / 1000000000.0);
+	printf("  per scan: %.2f ms\n", elapsed / 1000000.0 / scans);
+	printf("  removed in the last scan: %u\n", removed);
+
+	removetree(containers);
+	closecgroups();
+
+	return !ok;
+}
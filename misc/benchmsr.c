@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Compares the cost of reading the energy counters one by one
+ * through getmsr() with reading them in one batch through
+ * getmsrs(). Build with 'make benchmsr'. Each sample consists
+ * of the *_STATUS MSRs present. Besides the time per sample
+ * the syscalls per sample are counted: The loop is run again
+ * in a child we're tracing, each syscall stops it once.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../src/main.h"
+#include "../src/msr.h"
+
+
+// ----
+
+
+// Samples of the shorter traced run. The longer one takes
+// twice as many, the difference is the loop alone.
+#define TRACED_SAMPLES 100
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Returns the current monotonic time in nanoseconds.
+ */
+static uint64_t now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * Reads the given number of samples.
+ *
+ *  - batched: Read through getmsrs() instead of getmsr().
+ *  - msrs: MSRs of a sample.
+ *  - count: Number of MSRs.
+ *  - samples: Number of samples.
+ */
+static void readsamples(bool batched, const int32_t *msrs, size_t count,
+		uint32_t samples) {
+	uint64_t data[4];
+
+	for (uint32_t i = 0; i < samples; i++) {
+		if (batched) {
+			getmsrs(0, msrs, data, count);
+		} else {
+			for (size_t j = 0; j < count; j++) {
+				data[j] = getmsr(msrs[j]);
+			}
+		}
+	}
+}
+
+
+/*
+ * Reads the given number of samples in a child and returns
+ * the number of syscalls it made after it's first stop, -1
+ * if it can't be traced. The child opens the backend again,
+ * a forked io_uring belongs to us.
+ *
+ *  - batched: Read through getmsrs() instead of getmsr().
+ *  - msrs: MSRs of a sample.
+ *  - count: Number of MSRs.
+ *  - samples: Number of samples.
+ */
+static int64_t tracesamples(bool batched, const int32_t *msrs, size_t count,
+		uint32_t samples) {
+	int64_t syscalls = 0;
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+
+	if ((pid = fork()) == -1) {
+		return -1;
+	}
+
+	if (pid == 0) {
+		closebackend();
+		openbackend();
+
+		if (ptrace(PT_TRACE_ME, 0, NULL, 0) == -1) {
+			_exit(1);
+		}
+
+		raise(SIGSTOP);
+		readsamples(batched, msrs, count, samples);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+		waitpid(pid, &status, 0);
+		return -1;
+	}
+
+	// Linux stops at the entry and the exit of each
+	// syscall, FreeBSD can stop at the entry only.
+	for (;;) {
+#ifdef __linux__
+		ptrace(PTRACE_SYSCALL, pid, NULL, 0);
+#else
+		ptrace(PT_TO_SCE, pid, (caddr_t)1, 0);
+#endif
+
+		if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+			break;
+		}
+
+		syscalls++;
+	}
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		return -1;
+	}
+
+#ifdef __linux__
+	syscalls /= 2;
+#endif
+
+	return syscalls;
+}
+
+
+/*
+ * Returns the number of syscalls per sample, -1 if they
+ * can't be counted. The syscalls of the child itself
+ * cancel out between a short and a long run.
+ *
+ *  - batched: Read through getmsrs() instead of getmsr().
+ *  - msrs: MSRs of a sample.
+ *  - count: Number of MSRs.
+ */
+static double countsyscalls(bool batched, const int32_t *msrs, size_t count) {
+	int64_t shortrun = tracesamples(batched, msrs, count, TRACED_SAMPLES);
+	int64_t longrun = tracesamples(batched, msrs, count, 2 * TRACED_SAMPLES);
+
+	if (shortrun == -1 || longrun == -1) {
+		return -1;
+	}
+
+	return (double)(longrun - shortrun) / TRACED_SAMPLES;
+}
+
+
+/*
+ * Prints the results of one way of reading.
+ *
+ *  - name: How the samples were read.
+ *  - nanoseconds: Time taken by all samples.
+ *  - samples: Number of samples.
+ *  - syscalls: Syscalls per sample, -1 if unknown.
+ */
+static void printresult(const char *name, uint64_t nanoseconds, uint32_t samples,
+		double syscalls) {
+	printf("%-10s %8.0f ns/sample, ", name, (double)nanoseconds / samples);
+
+	if (syscalls < 0) {
+		printf("syscalls can't be counted\n");
+	} else {
+		printf("%.2f syscalls/sample\n", syscalls);
+	}
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	int32_t all[4] = { PKG_STATUS, PP0_STATUS, PP1_STATUS, DRAM_STATUS };
+	int32_t msrs[4];
+	size_t count = 0;
+	uint32_t samples = 100000;
+	int32_t ch;
+
+	while ((ch = getopt(argc, argv, "b:d:n:")) != -1) {
+		switch (ch) {
+			case 'b':
+				if (!(options.backend = getbackend(optarg))) {
+					exit_error(1, "ERROR: Unknown backend %s\n", optarg);
+				}
+				break;
+
+			case 'd':
+				options.device = optarg;
+				break;
+
+			case 'n':
+				samples = strtoul(optarg, NULL, 10);
+				break;
+
+			default:
+				exit_error(1, "Usage: benchmsr [-b backend] [-d device] [-n samples]\n");
+		}
+	}
+
+	openbackend();
+
+	// Only the MSRs present on this CPU.
+	for (size_t i = 0; i < 4; i++) {
+		if (checkmsr(all[i])) {
+			msrs[count++] = all[i];
+		}
+	}
+
+	if (!count || !samples) {
+		exit_error(1, "ERROR: Nothing to read\n");
+	}
+
+	printf("Backend %s, %zu MSRs per sample, %u samples%s\n\n",
+			options.backend->name, count, samples, options.backend->readbatch
+			? "" : ", no batch support");
+
+	// One by one.
+	uint64_t start = now();
+	readsamples(false, msrs, count, samples);
+	uint64_t single = now() - start;
+
+	// Batched.
+	start = now();
+	readsamples(true, msrs, count, samples);
+	uint64_t batch = now() - start;
+
+	printresult("getmsr():", single, samples, countsyscalls(false, msrs, count));
+	printresult("getmsrs():", batch, samples, countsyscalls(true, msrs, count));
+
+	closebackend();
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Measures the cost of the libpowermon region markers. Marks
+ * batches of nested regions that fit into the thread's buffer,
+ * writing the buffer between the batches outside of the timed
+ * part, and compares against an empty loop. The markers are
+ * written to the file given by PMREGIONS, /dev/null if it's not
+ * set. Build with 'make benchregion'.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/libpowermon.h"
+
+
+// ----
+
+
+// Region pairs per batch, half the buffer.
+#define BATCH 8192
+
+
+// ----
+
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static uint64_t gettime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	uint64_t batches = 1000;
+	uint64_t marked = 0;
+	uint64_t empty = 0;
+	int32_t ch;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+			case 'n':
+				batches = strtoull(optarg, NULL, 10);
+				break;
+
+			default:
+				fprintf(stderr, "Usage: benchregion [-n batches]\n");
+				return 1;
+		}
+	}
+
+	setenv("PMREGIONS", "/dev/null", 0);
+
+	// The first marker sets everything up.
+	pm_region_begin("warmup");
+	pm_region_end();
+	pm_region_flush();
+
+	for (uint64_t b = 0; b < batches; b++) {
+		uint64_t start = gettime();
+
+		for (uint32_t i = 0; i < BATCH; i++) {
+			pm_region_begin("outer");
+			pm_region_end();
+		}
+
+		marked += gettime() - start;
+		pm_region_flush();
+
+		// The compiler must not remove the loop.
+		start = gettime();
+
+		for (volatile uint32_t i = 0; i < BATCH; i++);
+
+		empty += gettime() - start;
+	}
+
+	uint64_t markers = 2 * BATCH * batches;
+
+	printf("%" PRIu64 " markers in %.3f s\n", markers, marked / 1000000000.0);
+	printf("  per marker: %.2f ns\n", (double)marked / markers);
+	printf("  empty loop: %.2f ns per iteration\n", (double)empty / (BATCH * batches));
+
+	return 0;
+}
+
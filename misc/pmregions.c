@@ -0,0 +1,514 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Attributes energy to the regions marked with libpowermon. Reads
+ * the headless CSV output of powermon and the markers written by
+ * libpowermon, prints the number of calls, the time and the energy
+ * of each region. The energy consumed while regions are open on
+ * several threads is split evenly between them, a region gets
+ * only the energy consumed while it's the innermost one on it's
+ * thread. The energy between two records is interpolated. Build
+ * with 'make pmregions'.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// ----
+
+
+// Maximum number of domains in the CSV.
+#define MAX_DOMAINS 8
+
+// Maximum open regions per thread.
+#define MAX_DEPTH 64
+
+
+// ----
+
+
+/*
+ * A region, summed over all calls.
+ */
+typedef struct region_t {
+	char *name;
+	uint64_t calls;
+	double time;
+	double energy[MAX_DOMAINS];
+} region_t;
+
+
+/*
+ * Time a region was the innermost one on it's thread.
+ */
+typedef struct segment_t {
+	uint32_t region;
+	double start;
+	double end;
+
+	// Share of the energy at start and end.
+	double sstart[MAX_DOMAINS];
+	double send[MAX_DOMAINS];
+} segment_t;
+
+
+/*
+ * Start or end of a segment.
+ */
+typedef struct point_t {
+	double time;
+	uint32_t segment;
+	int32_t change;
+} point_t;
+
+
+/*
+ * An open region.
+ */
+typedef struct open_t {
+	uint32_t region;
+	double start;
+} open_t;
+
+
+/*
+ * Regions open on one thread.
+ */
+typedef struct thread_t {
+	open_t stack[MAX_DEPTH];
+	uint32_t depth;
+
+	// Start of the innermost regions segment.
+	double since;
+} thread_t;
+
+
+// ----
+
+
+// Energy records.
+static double *times;
+static double *energy;
+static uint32_t records;
+static uint32_t domains;
+static char keys[MAX_DOMAINS][32];
+
+static region_t *regions;
+static uint32_t nregions;
+
+static segment_t *segments;
+static uint32_t nsegments;
+
+static thread_t *threads;
+static uint32_t nthreads;
+
+
+// ----
+
+
+/*
+ * realloc() or die.
+ *
+ *  - ptr: Memory to resize.
+ *  - count: New number of elements.
+ *  - size: Size of each element.
+ */
+static void *grow(void *ptr, size_t count, size_t size) {
+	void *new = realloc(ptr, count * size);
+
+	if (!new) {
+		fprintf(stderr, "ERROR: Couldn't allocate memory\n");
+		exit(1);
+	}
+
+	return new;
+}
+
+
+/*
+ * Reads the headless CSV output of powermon.
+ *
+ *  - path: File to read.
+ */
+static void readenergy(const char *path) {
+	char line[4096];
+	int32_t columns[MAX_DOMAINS];
+	FILE *f = fopen(path, "r");
+
+	if (!f || !fgets(line, sizeof(line), f)) {
+		fprintf(stderr, "ERROR: Couldn't read %s\n", path);
+		exit(1);
+	}
+
+	// The energy columns are named key_j.
+	int32_t column = 0;
+
+	for (char *tok = strtok(line, ",\n"); tok; tok = strtok(NULL, ",\n"), column++) {
+		size_t len = strlen(tok);
+
+		if (len > 2 && len < sizeof(keys[0]) + 2 && !strcmp(tok + len - 2, "_j")
+				&& domains < MAX_DOMAINS) {
+			memcpy(keys[domains], tok, len - 2);
+			columns[domains++] = column;
+		}
+	}
+
+	if (!domains) {
+		fprintf(stderr, "ERROR: No energy columns in %s\n", path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		times = grow(times, records + 1, sizeof(double));
+		energy = grow(energy, (records + 1) * domains, sizeof(double));
+
+		column = 0;
+
+		for (char *tok = strtok(line, ",\n"); tok; tok = strtok(NULL, ",\n"), column++) {
+			if (column == 0) {
+				times[records] = strtod(tok, NULL);
+			}
+
+			for (uint32_t d = 0; d < domains; d++) {
+				if (columns[d] == column) {
+					energy[records * domains + d] = strtod(tok, NULL);
+				}
+			}
+		}
+
+		records++;
+	}
+
+	fclose(f);
+
+	if (records < 2) {
+		fprintf(stderr, "ERROR: Not enough records in %s\n", path);
+		exit(1);
+	}
+}
+
+
+/*
+ * Returns the energy consumed until the given time,
+ * interpolated between the records.
+ *
+ *  - time: Time in seconds.
+ *  - d: Domain.
+ */
+static double energyat(double time, uint32_t d) {
+	if (time <= times[0]) {
+		return energy[d];
+	} else if (time >= times[records - 1]) {
+		return energy[(records - 1) * domains + d];
+	}
+
+	uint32_t low = 0;
+	uint32_t high = records - 1;
+
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+
+		if (times[mid] <= time) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+
+	double a = energy[low * domains + d];
+	double b = energy[high * domains + d];
+
+	return a + (b - a) * (time - times[low]) / (times[high] - times[low]);
+}
+
+
+/*
+ * Returns the region with the given name, creating it.
+ *
+ *  - name: Name of the region.
+ */
+static uint32_t getregion(const char *name) {
+	for (uint32_t i = 0; i < nregions; i++) {
+		if (!strcmp(regions[i].name, name)) {
+			return i;
+		}
+	}
+
+	regions = grow(regions, nregions + 1, sizeof(region_t));
+	memset(&regions[nregions], 0, sizeof(region_t));
+	regions[nregions].name = strdup(name);
+
+	return nregions++;
+}
+
+
+/*
+ * Returns the thread with the given number, creating it.
+ *
+ *  - id: Number of the thread.
+ */
+static thread_t *getthread(uint32_t id) {
+	if (id >= nthreads) {
+		threads = grow(threads, id + 1, sizeof(thread_t));
+		memset(&threads[nthreads], 0, (id + 1 - nthreads) * sizeof(thread_t));
+		nthreads = id + 1;
+	}
+
+	return &threads[id];
+}
+
+
+/*
+ * Adds a segment of the innermost region of the thread.
+ *
+ *  - thread: Thread the region is open on.
+ *  - end: End of the segment.
+ */
+static void addsegment(thread_t *thread, double end) {
+	if (!thread->depth || end <= thread->since) {
+		return;
+	}
+
+	segments = grow(segments, nsegments + 1, sizeof(segment_t));
+	segments[nsegments].region = thread->stack[thread->depth - 1].region;
+	segments[nsegments].start = thread->since;
+	segments[nsegments].end = end;
+	nsegments++;
+}
+
+
+/*
+ * Reads the markers.
+ *
+ *  - path: File to read.
+ */
+static void readmarkers(const char *path) {
+	char line[4096];
+	char name[4096];
+	uint64_t clock;
+	uint64_t realtime;
+	uint64_t count;
+	uint32_t id;
+	uint32_t depth;
+
+	// Clock at the first and last calibration.
+	uint64_t clocks[2] = { 0, 0 };
+	uint64_t realtimes[2] = { 0, 0 };
+	uint64_t dropped = 0;
+
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		fprintf(stderr, "ERROR: Couldn't read %s\n", path);
+		exit(1);
+	}
+
+	// The calibration is needed before the markers
+	// can be converted, so the file is read twice.
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "C %" SCNu64 " %" SCNu64, &clock, &realtime) == 2) {
+			if (!clocks[0]) {
+				clocks[0] = clock;
+				realtimes[0] = realtime;
+			}
+
+			clocks[1] = clock;
+			realtimes[1] = realtime;
+		}
+	}
+
+	if (clocks[1] <= clocks[0]) {
+		fprintf(stderr, "ERROR: Not enough clock calibrations in %s\n", path);
+		exit(1);
+	}
+
+	double scale = (double)(realtimes[1] - realtimes[0]) / (clocks[1] - clocks[0]);
+
+	rewind(f);
+
+	while (fgets(line, sizeof(line), f)) {
+		double time;
+		thread_t *thread;
+
+		if (sscanf(line, "B %u %u %" SCNu64 " %4095[^\n]", &id, &depth, &clock, name) == 4) {
+			time = (realtimes[0] + ((double)clock - clocks[0]) * scale) / 1000000000.0;
+			thread = getthread(id);
+
+			// Deeper regions whose end was dropped.
+			if (depth < thread->depth) {
+				thread->depth = depth;
+			}
+
+			if (depth != thread->depth || depth == MAX_DEPTH) {
+				continue;
+			}
+
+			addsegment(thread, time);
+
+			thread->stack[thread->depth].region = getregion(name);
+			thread->stack[thread->depth].start = time;
+			thread->depth++;
+			thread->since = time;
+		} else if (sscanf(line, "E %u %u %" SCNu64, &id, &depth, &clock) == 3) {
+			time = (realtimes[0] + ((double)clock - clocks[0]) * scale) / 1000000000.0;
+			thread = getthread(id);
+
+			// The begin was dropped.
+			if (depth >= thread->depth) {
+				continue;
+			}
+
+			thread->depth = depth + 1;
+			addsegment(thread, time);
+
+			region_t *region = &regions[thread->stack[depth].region];
+			region->calls++;
+			region->time += time - thread->stack[depth].start;
+
+			thread->depth = depth;
+			thread->since = time;
+		} else if (sscanf(line, "D %u %" SCNu64, &id, &count) == 2) {
+			dropped += count;
+		}
+	}
+
+	fclose(f);
+
+	if (dropped) {
+		fprintf(stderr, "WARNING: %" PRIu64 " markers were dropped\n", dropped);
+	}
+}
+
+
+/*
+ * Sorts points by time.
+ */
+static int comparepoints(const void *a, const void *b) {
+	const point_t *pa = a;
+	const point_t *pb = b;
+
+	return (pa->time > pb->time) - (pa->time < pb->time);
+}
+
+
+/*
+ * Sorts regions by the energy of the first domain.
+ */
+static int compareregions(const void *a, const void *b) {
+	const region_t *ra = a;
+	const region_t *rb = b;
+
+	return (ra->energy[0] < rb->energy[0]) - (ra->energy[0] > rb->energy[0]);
+}
+
+
+/*
+ * Splits the energy between the segments. Between two points
+ * the energy is divided by the number of open segments, the
+ * running sum of these shares at the start and end of a
+ * segment gives it's energy.
+ */
+static void attribute(void) {
+	point_t *points = grow(NULL, 2 * nsegments + 1, sizeof(point_t));
+	double share[MAX_DOMAINS] = { 0 };
+	int32_t open = 0;
+
+	for (uint32_t i = 0; i < nsegments; i++) {
+		points[2 * i] = (point_t){ segments[i].start, i, 1 };
+		points[2 * i + 1] = (point_t){ segments[i].end, i, -1 };
+	}
+
+	qsort(points, 2 * nsegments, sizeof(point_t), comparepoints);
+
+	for (uint32_t i = 0; i < 2 * nsegments; i++) {
+		if (i > 0 && open > 0) {
+			for (uint32_t d = 0; d < domains; d++) {
+				share[d] += (energyat(points[i].time, d)
+						- energyat(points[i - 1].time, d)) / open;
+			}
+		}
+
+		segment_t *segment = &segments[points[i].segment];
+		memcpy((points[i].change > 0) ? segment->sstart : segment->send,
+				share, sizeof(share));
+
+		open += points[i].change;
+	}
+
+	for (uint32_t i = 0; i < nsegments; i++) {
+		for (uint32_t d = 0; d < domains; d++) {
+			regions[segments[i].region].energy[d] += segments[i].send[d] - segments[i].sstart[d];
+		}
+	}
+
+	free(points);
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "Usage: pmregions energy.csv regions.txt\n");
+		return 1;
+	}
+
+	readenergy(argv[1]);
+	readmarkers(argv[2]);
+	attribute();
+
+	qsort(regions, nregions, sizeof(region_t), compareregions);
+
+	printf("%-32s %10s %12s", "Region", "Calls", "Time (s)");
+
+	for (uint32_t d = 0; d < domains; d++) {
+		char label[40];
+
+		snprintf(label, sizeof(label), "%s (J)", keys[d]);
+		printf(" %14s", label);
+	}
+
+	printf("\n");
+
+	for (uint32_t i = 0; i < nregions; i++) {
+		printf("%-32s %10" PRIu64 " %12.6f", regions[i].name, regions[i].calls, regions[i].time);
+
+		for (uint32_t d = 0; d < domains; d++) {
+			printf(" %14.6f", regions[i].energy[d]);
+		}
+
+		printf("\n");
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Prints the records of time series store files in a time
+ * range as CSV. The files are mapped through pmts.h and only
+ * the blocks overlapping the range are decoded. Build with
+ * 'make pmtsdump'.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/pmts.h"
+
+
+// ----
+
+
+// Keys of the domains, as in domain.c.
+static const char *keys[PMTS_PLATFORM + 1] = { "pkg", "pp0", "pp1", "dram", "platform" };
+
+
+// ----
+
+
+/*
+ * Prints the records of one file between from and to.
+ *
+ *  - path: File to print.
+ *  - from: First millisecond of the range.
+ *  - to: Last millisecond of the range.
+ */
+static void dumpfile(const char *path, uint64_t from, uint64_t to) {
+	pmts_file_t file;
+	pmts_cursor_t cursor;
+	uint64_t time;
+	double values[PMTS_COLUMNS];
+
+	if (!pmts_open(path, &file)) {
+		fprintf(stderr, "WARNING: Couldn't open %s, skipping\n", path);
+		return;
+	}
+
+	const pmts_header_t *header = file.header;
+
+	printf("# %s\ntime", path);
+
+	for (uint32_t i = 0; i < header->columns; i++) {
+		printf(",%s%u", keys[header->domain[i] <= PMTS_PLATFORM ? header->domain[i] : 0],
+				header->package[i]);
+	}
+
+	printf("\n");
+
+	for (uint64_t n = pmts_seek(&file, from); n < file.blocks; n++) {
+		pmts_begin(&cursor, &file, n);
+
+		if (cursor.block && cursor.block->first > to) {
+			break;
+		}
+
+		while (pmts_next(&cursor, &time, values)) {
+			if (time < from || time > to) {
+				continue;
+			}
+
+			printf("%" PRIu64 ".%03" PRIu64, time / 1000, time % 1000);
+
+			for (uint32_t i = 0; i < header->columns; i++) {
+				printf(",%.3f", values[i]);
+			}
+
+			printf("\n");
+		}
+	}
+
+	pmts_close(&file);
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	uint64_t from = 0;
+	uint64_t to = UINT64_MAX;
+	int32_t ch;
+
+	while ((ch = getopt(argc, argv, "f:t:")) != -1) {
+		switch (ch) {
+			case 'f':
+				from = strtod(optarg, NULL) * 1000;
+				break;
+
+			case 't':
+				to = strtod(optarg, NULL) * 1000;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: pmtsdump [-f from] [-t to] file...\n");
+				return 1;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "Usage: pmtsdump [-f from] [-t to] file...\n");
+		return 1;
+	}
+
+	// Times are given as UNIX timestamps in seconds.
+	for (int32_t i = optind; i < argc; i++) {
+		dumpfile(argv[i], from, to);
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Stress test for the shared memory export. One writer publishes
+ * records as fast as possible through the same code powermon
+ * uses, several readers map the segment through pmshm.h and read
+ * the latest and random older records concurrently. Each record
+ * is derived from it's number, so a torn read is detected. Build
+ * with 'make stressshm'.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/main.h"
+#include "../src/pmshm.h"
+#include "../src/shm.h"
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+// Name of the segment.
+static const char *name = "/powermon-stress";
+
+// Set when the writer is done.
+static uint32_t done;
+
+
+// ----
+
+
+/*
+ * Statistics of one reader.
+ */
+typedef struct reader_t {
+	pthread_t thread;
+
+	// Records read.
+	uint64_t reads;
+
+	// Records overwritten before they were read.
+	uint64_t lost;
+
+	// Inconsistent records.
+	uint64_t torn;
+} reader_t;
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Returns true if the record is the n-th one.
+ *
+ *  - record: Record to check.
+ *  - n: Number of the record.
+ */
+static bool checkrecord(const pmshm_record_t *record, uint64_t n) {
+	if (record->seq != 2 * (n + 1) || record->timestamp != n
+			|| record->realtime != 3 * n || record->missed != (n ^ 0x5555)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < PMSHM_DOMAINS; i++) {
+		if (record->power[i] != (double)(n + i)
+				|| record->energy[i] != (double)(2 * n + i)) {
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < PMSHM_THROTTLES; i++) {
+		if (record->throttled[i] != (double)(3 * n + i)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * Reads the latest and a random older record in a loop
+ * until the writer is done.
+ *
+ *  - arg: The readers reader_t.
+ */
+static void *readerthread(void *arg) {
+	reader_t *reader = arg;
+	uint32_t seed = (uint32_t)(uintptr_t)arg;
+	pmshm_record_t record;
+
+	const pmshm_header_t *shm = pmshm_attach(name);
+
+	if (!shm) {
+		exit_error(1, "ERROR: Couldn't attach to %s\n", name);
+	}
+
+	while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+		// Latest.
+		if (pmshm_latest(shm, &record)) {
+			reader->reads++;
+
+			if (!checkrecord(&record, record.timestamp)) {
+				reader->torn++;
+			}
+		}
+
+		// Some older one, maybe already overwritten.
+		uint64_t head = pmshm_head(shm);
+
+		if (head) {
+			uint64_t n = head - 1 - rand_r(&seed) % (2 * shm->records);
+
+			if (n >= head) {
+				continue;
+			}
+
+			if (pmshm_read(shm, n, &record)) {
+				reader->reads++;
+
+				if (!checkrecord(&record, n)) {
+					reader->torn++;
+				}
+			} else {
+				reader->lost++;
+			}
+		}
+	}
+
+	pmshm_detach(shm);
+
+	return NULL;
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	uint32_t readers = 4;
+	uint64_t records = 10000000;
+	int32_t ch;
+
+	while ((ch = getopt(argc, argv, "n:r:")) != -1) {
+		switch (ch) {
+			case 'n':
+				records = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'r':
+				readers = strtoul(optarg, NULL, 10);
+				break;
+
+			default:
+				exit_error(1, "Usage: stressshm [-n records] [-r readers]\n");
+		}
+	}
+
+	if (!readers) {
+		exit_error(1, "ERROR: Need at least one reader\n");
+	}
+
+	reader_t *reader = calloc(readers, sizeof(reader_t));
+
+	if (!reader) {
+		exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+	}
+
+	openshm(name, (1 << PMSHM_DOMAINS) - 1, 0);
+
+	for (uint32_t i = 0; i < readers; i++) {
+		if (pthread_create(&reader[i].thread, NULL, readerthread, &reader[i])) {
+			exit_error(1, "%s\n", "ERROR: Couldn't create reader thread");
+		}
+	}
+
+	printf("Publishing %" PRIu64 " records to %u readers\n\n", records, readers);
+
+	double power[PMSHM_DOMAINS];
+	double energy[PMSHM_DOMAINS];
+	double throttled[PMSHM_THROTTLES];
+
+	for (uint64_t n = 0; n < records; n++) {
+		for (uint32_t i = 0; i < PMSHM_DOMAINS; i++) {
+			power[i] = (double)(n + i);
+			energy[i] = (double)(2 * n + i);
+		}
+
+		for (uint32_t i = 0; i < PMSHM_THROTTLES; i++) {
+			throttled[i] = (double)(3 * n + i);
+		}
+
+		publishshm(n, 3 * n, n ^ 0x5555, power, energy, throttled);
+	}
+
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+	uint64_t torn = 0;
+
+	for (uint32_t i = 0; i < readers; i++) {
+		pthread_join(reader[i].thread, NULL);
+
+		printf("Reader %u: %" PRIu64 " reads, %" PRIu64 " overwritten, %" PRIu64 " torn\n",
+				i, reader[i].reads, reader[i].lost, reader[i].torn);
+
+		torn += reader[i].torn;
+	}
+
+	closeshm();
+	free(reader);
+
+	printf("\n%s\n", torn ? "FAILED" : "OK");
+
+	return torn ? 1 : 0;
+}
+
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Checks the power capping controller against a simulated
+ * plant. The MSR functions of msr.c are replaced by a fake
+ * device with UNIT_MULTIPLIER, PKG_INFO and PKG_LIMIT. The
+ * package power follows PL1 with a lag, but like a real PMU
+ * not exactly: It's off by a gain and an offset, and of
+ * course a package never draws more than it's workload
+ * demands. The controller must settle at the target anyway,
+ * keep PL1 within PKG_INFO and a band around the target,
+ * recover from long phases below the limit, restore the
+ * original limits and refuse locked ones. Build with
+ * 'make testcap'.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../src/cap.h"
+#include "../src/main.h"
+#include "../src/msr.h"
+
+
+// ----
+
+
+// Packages of the simulated machine.
+#define PACKAGES 2
+
+// Power unit of 1/8 W.
+#define UNITS 0x3
+
+// Thermal spec, minimum and maximum power of PKG_INFO in watts.
+#define TDP 95
+#define MINIMUM 20
+#define MAXIMUM 120
+
+// Firmware default of PKG_LIMIT: PL1 95 W and PL2 118 W.
+#define DEFAULT 0x00dd83b0000782f8
+
+// The package draws GAIN * PL1 + OFFSET watts at the
+// limit and approaches it with time constant LAG.
+#define GAIN 0.9
+#define OFFSET 3.0
+#define LAG 1.0
+
+// Length of one step in seconds.
+#define STEP 1.0
+
+
+// ----
+
+
+/*
+ * A simulated package.
+ */
+typedef struct plant_t {
+	// Raw PKG_LIMIT.
+	uint64_t limit;
+
+	// Power the workload would draw unlimited.
+	double demand;
+
+	// Power currently drawn.
+	double power;
+
+	// Number of writes to PKG_LIMIT.
+	uint32_t writes;
+} plant_t;
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+// The simulated packages.
+static plant_t plants[PACKAGES];
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Reads a register of the simulated device. Returns
+ * false if the device doesn't have the register.
+ *
+ *  - package: Package to read from.
+ *  - msr: Register to read.
+ *  - data: Filled with the register.
+ */
+static bool readplant(uint32_t package, int32_t msr, uint64_t *data) {
+	switch (msr) {
+		case UNIT_MULTIPLIER:
+			*data = UNITS;
+			return true;
+
+		case PKG_INFO:
+			*data = ((uint64_t)MAXIMUM << UNITS << 32) | ((uint64_t)MINIMUM << UNITS << 16)
+				| ((uint64_t)TDP << UNITS);
+			return true;
+
+		case PKG_LIMIT:
+			*data = plants[package].limit;
+			return true;
+
+		default:
+			errno = EIO;
+			return false;
+	}
+}
+
+
+/*
+ * Replacements for msr.c on top of the simulated device.
+ */
+bool checkmsr(int32_t msr) {
+	uint64_t data;
+
+	return readplant(0, msr, &data);
+}
+
+
+void getmsrs(uint32_t package, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		if (!readplant(package, msrs[i], &data[i])) {
+			exit_error(1, "ERROR: Couldn't read MSR 0x%x\n", msrs[i]);
+		}
+	}
+}
+
+
+bool setmsr(uint32_t package, int32_t msr, uint64_t data) {
+	if (msr != PKG_LIMIT) {
+		errno = EIO;
+		return false;
+	}
+
+	plants[package].limit = data;
+	plants[package].writes++;
+
+	return true;
+}
+
+
+/*
+ * Returns PL1 of the given package in watts.
+ *
+ *  - package: Package to query.
+ */
+static double getpl1(uint32_t package) {
+	return (plants[package].limit & 0x7fff) / (double)B2POW(UNITS);
+}
+
+
+/*
+ * Advances the plant by one step and runs the controllers.
+ */
+static void step(void) {
+	for (uint32_t p = 0; p < PACKAGES; p++) {
+		plant_t *plant = &plants[p];
+		double steady = fmin(plant->demand, GAIN * getpl1(p) + OFFSET);
+
+		plant->power += (steady - plant->power) * (1 - exp(-STEP / LAG));
+		updatecap(p, plant->power, STEP);
+	}
+}
+
+
+/*
+ * Resets the plant to the firmware defaults.
+ *
+ *  - demand: Demand of all packages in watts.
+ */
+static void reset(double demand) {
+	for (uint32_t p = 0; p < PACKAGES; p++) {
+		plants[p].limit = DEFAULT;
+		plants[p].demand = demand;
+		plants[p].power = demand;
+		plants[p].writes = 0;
+	}
+}
+
+
+/*
+ * Checks a condition, prints an error if it failed.
+ * Returns the condition.
+ *
+ *  - ok: Condition.
+ *  - what: What was checked.
+ */
+static bool check(bool ok, const char *what) {
+	if (!ok) {
+		printf("ERROR: %s\n", what);
+	}
+
+	return ok;
+}
+
+
+// ----
+
+
+int main(void) {
+	bool ok = true;
+
+	options.packages = PACKAGES;
+
+	// Package 1 idles below it's share for a while, then
+	// gets busy. Package 0 is busy all the time.
+	reset(100);
+	plants[1].demand = 25;
+	opencap(80);
+
+	for (uint32_t s = 0; s < 60; s++) {
+		step();
+	}
+
+	printf("busy: %.2f W at PL1 %.2f W, idle: %.2f W at PL1 %.2f W\n",
+			plants[0].power, getpl1(0), plants[1].power, getpl1(1));
+
+	ok &= check(fabs(plants[0].power - 40) < 0.5, "busy package doesn't settle at the target");
+	ok &= check(getpl1(1) <= 40 * 1.25, "idle package opened PL1 beyond the band");
+	ok &= check(getcap(1) == getpl1(1), "getcap() doesn't match PKG_LIMIT");
+
+	plants[1].demand = 100;
+
+	double peak = 0;
+
+	for (uint32_t s = 0; s < 20; s++) {
+		step();
+		peak = fmax(peak, plants[1].power);
+	}
+
+	printf("after load: %.2f W at PL1 %.2f W, peak %.2f W\n", plants[1].power, getpl1(1), peak);
+
+	ok &= check(fabs(plants[1].power - 40) < 0.5, "idle package wound up");
+	ok &= check(peak <= GAIN * 40 * 1.25 + OFFSET, "load overshot the band");
+
+	// Only the PL1 fields may be touched.
+	ok &= check((plants[0].limit & ~0xffffull) == (DEFAULT & ~0xffffull), "PL2 or the window changed");
+	ok &= check((plants[0].limit & 0x18000) == 0x18000, "PL1 not enabled and clamped");
+
+	closecap();
+
+	ok &= check(plants[0].limit == DEFAULT && plants[1].limit == DEFAULT, "limits not restored");
+
+	// Below the minimum of PKG_INFO.
+	reset(100);
+	opencap(30);
+
+	for (uint32_t s = 0; s < 30; s++) {
+		step();
+	}
+
+	printf("below minimum: %.2f W at PL1 %.2f W\n", plants[0].power, getpl1(0));
+
+	ok &= check(getpl1(0) == MINIMUM, "PL1 below the minimum of PKG_INFO");
+
+	// A settled controller doesn't write again.
+	uint32_t writes = plants[0].writes;
+	step();
+	ok &= check(plants[0].writes == writes, "unchanged PL1 written");
+
+	closecap();
+	closecap();
+
+	ok &= check(plants[0].limit == DEFAULT, "limits not restored");
+
+	// A locked limit is refused.
+	reset(100);
+	plants[0].limit |= 1ull << 63;
+
+	fflush(stdout);
+
+	pid_t pid = fork();
+	int status;
+
+	if (pid == 0) {
+		fclose(stderr);
+		opencap(80);
+		_exit(0);
+	}
+
+	waitpid(pid, &status, 0);
+
+	ok &= check(WIFEXITED(status) && WEXITSTATUS(status) == 1, "locked limit not refused");
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Checks the sampling loop against the file backend. A fake
+ * device with UNIT_MULTIPLIER and the PKG, PP0 and DRAM
+ * *_STATUS counters is written to a temporary file. While
+ * the sampler runs the counters are advanced step by step
+ * across their 32 bit wraparound, the energy accumulated
+ * by the sampler must match what was written exactly. The
+ * DRAM counter is in the fixed unit of a Skylake server.
+ * Build with 'make testfile'.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/domain.h"
+#include "../src/main.h"
+#include "../src/msr.h"
+#include "../src/record.h"
+#include "../src/sampler.h"
+
+
+// ----
+
+
+// Energy unit of 1/16384 J, power unit of 1/8 W and
+// time unit of 1/1024 s.
+#define UNITS 0xa0e03
+
+// Fixed DRAM unit of the server in joule.
+#define DRAMUNIT 0.0000153
+
+// Number of steps and length of one step in microseconds.
+#define STEPS 100
+#define STEP 10000
+
+// Interval of the sampler in nanoseconds, it
+// doesn't sample more often than every 50 ms.
+#define PERIOD 50000000
+
+// Joules each domain consumes per step.
+#define PKG_STEP 2.0
+#define PP0_STEP 1.5
+#define DRAM_STEP 0.25
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Nothing is recorded.
+ */
+void recordsample(uint32_t package, uint64_t timestamp, const uint32_t *raw,
+		const uint32_t *throttle) {
+	(void)package;
+	(void)timestamp;
+	(void)raw;
+	(void)throttle;
+}
+
+
+/*
+ * Writes a MSR record of the fake device.
+ *
+ *  - fd: FD to the device.
+ *  - msr: MSR to write.
+ *  - data: Content of the MSR.
+ */
+static void writemsr(int32_t fd, int32_t msr, uint64_t data) {
+	uint64_t record[2] = { 1, data };
+
+	if (pwrite(fd, record, sizeof(record), (off_t)msr * 16) != sizeof(record)) {
+		exit_error(1, "ERROR: Couldn't write the device: %s\n", strerror(errno));
+	}
+}
+
+
+/*
+ * Returns the raw *_STATUS counter after the given number of
+ * steps. Each counter starts a little below it's wraparound,
+ * so it wraps about halfway through.
+ *
+ *  - step: Steps taken.
+ *  - joules: Joules per step.
+ *  - unit: Joules per raw unit.
+ */
+static uint32_t getcounter(uint32_t step, double joules, double unit) {
+	uint32_t start = UINT32_MAX - (uint32_t)(STEPS / 2 * joules / unit);
+
+	return start + (uint32_t)(step * joules / unit);
+}
+
+
+/*
+ * Writes the *_STATUS counters after the given number of steps.
+ *
+ *  - fd: FD to the device.
+ *  - step: Steps taken.
+ */
+static void writecounters(int32_t fd, uint32_t step) {
+	writemsr(fd, PKG_STATUS, getcounter(step, PKG_STEP, 1 / 16384.0));
+	writemsr(fd, PP0_STATUS, getcounter(step, PP0_STEP, 1 / 16384.0));
+	writemsr(fd, DRAM_STATUS, getcounter(step, DRAM_STEP, DRAMUNIT));
+}
+
+
+/*
+ * Checks the energy of a domain, prints an error
+ * if it's off. Returns true if it matches.
+ *
+ *  - energy: Accumulated energy.
+ *  - domain: Domain to check.
+ *  - joules: Joules per step.
+ *  - unit: Joules per raw unit.
+ */
+static bool check(const energy_t *energy, domain_e domain, double joules,
+		double unit) {
+	double expected = (getcounter(STEPS, joules, unit)
+		- getcounter(0, joules, unit)) * unit;
+
+	printf("%s: %.6f J, expected %.6f J\n", domains[domain].key,
+			energy->domain[domain], expected);
+
+	if (fabs(energy->domain[domain] - expected) > unit / 2) {
+		printf("ERROR: %s energy is off\n", domains[domain].key);
+		return false;
+	}
+
+	return true;
+}
+
+
+// ----
+
+
+int main(void) {
+	char path[] = "/tmp/testfile.XXXXXX";
+	int32_t fd;
+
+	if ((fd = mkstemp(path)) == -1) {
+		exit_error(1, "ERROR: Couldn't create %s: %s\n", path, strerror(errno));
+	}
+
+	writemsr(fd, UNIT_MULTIPLIER, UNITS);
+	writecounters(fd, 0);
+
+	options.backend = &backend_file;
+	options.device = path;
+	options.cpufamily = "Skylake";
+	options.cputype = SERVER;
+
+	openbackend();
+	initdomains();
+	startsamplers(PERIOD);
+
+	for (uint32_t s = 1; s <= STEPS; s++) {
+		usleep(STEP);
+		writecounters(fd, s);
+	}
+
+	// Wait for a sample taken after the last step.
+	uint64_t written = gettime();
+	sample_t sample;
+	energy_t energy;
+
+	do {
+		usleep(PERIOD / 1000);
+		getsample(0, &sample);
+	} while (sample.timestamp <= written);
+	getjoules(&sample, &sample.total, &energy);
+
+	stopsamplers();
+	closebackend();
+
+	close(fd);
+	unlink(path);
+
+	bool ok = true;
+
+	ok &= check(&energy, DOMAIN_PKG, PKG_STEP, 1 / 16384.0);
+	ok &= check(&energy, DOMAIN_PP0, PP0_STEP, 1 / 16384.0);
+	ok &= check(&energy, DOMAIN_DRAM, DRAM_STEP, DRAMUNIT);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Checks the powercap backend against a fake sysfs tree in a
+ * temporary directory: a package zone with a core and a DRAM
+ * subzone. The package counter is advanced in large steps,
+ * wrapping at max_energy_range_uj several times and the
+ * emulated 32 bit PKG_STATUS as well, the energy read must
+ * match exactly. Writing PKG_LIMIT must change only the
+ * constraints that differ, writing back what was read must
+ * leave the tree alone. Linux only, build with
+ * 'make testpowercap'.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/main.h"
+#include "../src/msr.h"
+
+
+// ----
+
+
+// Range of energy_uj, as given by most CPUs.
+#define RANGE UINT64_C(262143328850)
+
+// Steps and microjoules per step of the package zone. 50 kJ
+// per step wrap energy_uj every few steps, and in total the
+// emulated PKG_STATUS about twice.
+#define STEPS 10
+#define STEP UINT64_C(50000000000)
+
+// Energy unit of the emulated UNIT_MULTIPLIER.
+#define UNIT 16384
+
+// Maximum number of files in the tree.
+#define FILES 32
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+// Root of the tree.
+static char root[] = "/tmp/testpowercap.XXXXXX";
+
+// Files and directories created, removed in reverse.
+static char created[FILES][128];
+static uint32_t ncreated;
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Creates a directory of the tree.
+ *
+ *  - dir: Directory relative to the root.
+ */
+static void makedir(const char *dir) {
+	char *path = created[ncreated++];
+
+	snprintf(path, sizeof(created[0]), "%s/%s", root, dir);
+
+	if (mkdir(path, 0755) == -1) {
+		exit_error(1, "ERROR: Couldn't create %s: %s\n", path, strerror(errno));
+	}
+}
+
+
+/*
+ * Writes a file of the tree, creating it if necessary.
+ *
+ *  - file: File relative to the root.
+ *  - fmt: Format of the content.
+ *  - ...: Content list.
+ */
+static void writefile(const char *file, const char *fmt, ...) {
+	char path[128];
+	struct stat sb;
+	va_list vl;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", root, file);
+
+	if (stat(path, &sb) == -1) {
+		snprintf(created[ncreated++], sizeof(created[0]), "%s", path);
+	}
+
+	if (!(f = fopen(path, "w"))) {
+		exit_error(1, "ERROR: Couldn't write %s: %s\n", path, strerror(errno));
+	}
+
+	va_start(vl, fmt);
+	vfprintf(f, fmt, vl);
+	va_end(vl);
+
+	fclose(f);
+}
+
+
+/*
+ * Reads a number from a file of the tree.
+ *
+ *  - file: File relative to the root.
+ */
+static uint64_t readfile(const char *file) {
+	char path[128];
+	uint64_t value = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", root, file);
+
+	if (!(f = fopen(path, "r"))) {
+		exit_error(1, "ERROR: Couldn't read %s: %s\n", path, strerror(errno));
+	}
+
+	if (fscanf(f, "%" SCNu64, &value) != 1) {
+		exit_error(1, "ERROR: No number in %s\n", path);
+	}
+
+	fclose(f);
+
+	return value;
+}
+
+
+/*
+ * Writes a zone of the tree.
+ *
+ *  - dir: Directory of the zone relative to the root.
+ *  - name: Name of the zone.
+ *  - energy: Initial energy_uj.
+ */
+static void writezone(const char *dir, const char *name, uint64_t energy) {
+	char file[64];
+
+	makedir(dir);
+
+	snprintf(file, sizeof(file), "%s/name", dir);
+	writefile(file, "%s\n", name);
+	snprintf(file, sizeof(file), "%s/max_energy_range_uj", dir);
+	writefile(file, "%" PRIu64 "\n", RANGE);
+	snprintf(file, sizeof(file), "%s/energy_uj", dir);
+	writefile(file, "%" PRIu64 "\n", energy);
+}
+
+
+/*
+ * Removes the tree.
+ */
+static void removetree(void) {
+	for (uint32_t i = ncreated; i > 0; i--) {
+		if (unlink(created[i - 1]) == -1) {
+			rmdir(created[i - 1]);
+		}
+	}
+
+	rmdir(root);
+}
+
+
+/*
+ * Checks a condition, prints an error if it failed.
+ * Returns the condition.
+ *
+ *  - ok: Condition.
+ *  - what: What was checked.
+ */
+static bool check(bool ok, const char *what) {
+	if (!ok) {
+		printf("ERROR: %s\n", what);
+	}
+
+	return ok;
+}
+
+
+// ----
+
+
+int main(void) {
+	const backend_t *backend = &backend_powercap;
+	char device[64];
+	bool ok = true;
+
+	if (!mkdtemp(root)) {
+		exit_error(1, "ERROR: Couldn't create %s: %s\n", root, strerror(errno));
+	}
+
+	// Starts a little below the wrap.
+	uint64_t energy = RANGE - STEP / 2;
+
+	writezone("intel-rapl:0", "package-0", energy);
+	writezone("intel-rapl:0/intel-rapl:0:0", "core", 1000);
+	writezone("intel-rapl:0/intel-rapl:0:1", "dram", 2000);
+
+	// PL1 95 W over 28 s, PL2 118 W over 2.44 ms. The
+	// window of PL1 isn't exactly representable.
+	writefile("intel-rapl:0/enabled", "1\n");
+	writefile("intel-rapl:0/constraint_0_power_limit_uw", "95000000\n");
+	writefile("intel-rapl:0/constraint_0_time_window_us", "28000000\n");
+	writefile("intel-rapl:0/constraint_0_max_power_uw", "120000000\n");
+	writefile("intel-rapl:0/constraint_1_power_limit_uw", "118000000\n");
+	writefile("intel-rapl:0/constraint_1_time_window_us", "2440\n");
+
+	snprintf(device, sizeof(device), "%s/intel-rapl:0", root);
+
+	int32_t fd = backend->open(device);
+
+	if (fd == -1) {
+		removetree();
+		exit_error(1, "ERROR: Couldn't open %s: %s\n", device, strerror(errno));
+	}
+
+	uint64_t data;
+
+	ok &= check(backend->read(fd, PP0_STATUS, &data), "core zone not found");
+	ok &= check(backend->read(fd, DRAM_STATUS, &data), "dram zone not found");
+	ok &= check(!backend->read(fd, PP1_STATUS, &data), "nonexistent zone found");
+
+	// Summed up like the samplers do.
+	uint64_t last;
+	uint64_t total = 0;
+
+	ok &= check(backend->read(fd, PKG_STATUS, &last), "PKG_STATUS not readable");
+
+	for (uint32_t s = 0; s < STEPS; s++) {
+		energy += STEP;
+
+		if (energy > RANGE) {
+			energy -= RANGE;
+		}
+
+		writefile("intel-rapl:0/energy_uj", "%" PRIu64 "\n", energy);
+
+		if (!backend->read(fd, PKG_STATUS, &data)) {
+			ok = check(false, "PKG_STATUS not readable");
+			break;
+		}
+
+		total += (uint32_t)(data - last);
+		last = data;
+	}
+
+	printf("pkg: %" PRIu64 " units, expected %" PRIu64 " units\n",
+			total, STEPS * STEP / 1000000 * UNIT);
+
+	ok &= check(total == STEPS * STEP / 1000000 * UNIT, "energy across the wraps is off");
+
+	// PL1 is lowered to 60 W, nothing else changes.
+	pkg_limit_msr_t limit;
+
+	ok &= check(backend->read(fd, PKG_LIMIT, &data), "PKG_LIMIT not readable");
+	memcpy(&limit, &data, sizeof(limit));
+
+	ok &= check(limit.power_limit_1 == 95 * 8 && limit.power_limit_2 == 118 * 8,
+			"PKG_LIMIT doesn't match the constraints");
+
+	ok &= check(backend->write(fd, PKG_LIMIT, data), "PKG_LIMIT not writable");
+	ok &= check(readfile("intel-rapl:0/constraint_0_time_window_us") == 28000000,
+			"writing back PKG_LIMIT changed the window");
+
+	limit.power_limit_1 = 60 * 8;
+	memcpy(&data, &limit, sizeof(data));
+
+	ok &= check(backend->write(fd, PKG_LIMIT, data), "PKG_LIMIT not writable");
+
+	printf("PL1: %" PRIu64 " uW, PL2: %" PRIu64 " uW\n",
+			readfile("intel-rapl:0/constraint_0_power_limit_uw"),
+			readfile("intel-rapl:0/constraint_1_power_limit_uw"));
+
+	ok &= check(readfile("intel-rapl:0/constraint_0_power_limit_uw") == 60000000,
+			"PL1 not written through");
+	ok &= check(readfile("intel-rapl:0/constraint_1_power_limit_uw") == 118000000,
+			"PL2 changed");
+	ok &= check(readfile("intel-rapl:0/constraint_0_time_window_us") == 28000000,
+			"the window changed");
+	ok &= check(readfile("intel-rapl:0/enabled") == 1, "the limit was disabled");
+
+	backend->close(fd);
+	removetree();
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
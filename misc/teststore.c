@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Checks that the time series store round trips. Records with
+ * delta of delta timestamps at the boundaries of each encoding
+ * width are written through store.c and read back through
+ * pmts.h, every timestamp and value must come back unchanged.
+ * A hand made file checks that the search skips holes and
+ * the reader picks the right shadow copy. The store is created
+ * in /tmp or the directory given by -d.
+ * Build with 'make teststore'.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/domain.h"
+#include "../src/main.h"
+#include "../src/msr.h"
+#include "../src/pmts.h"
+#include "../src/store.h"
+
+
+// ----
+
+
+// Interval between two records in milliseconds,
+// before the delta of delta is applied.
+#define INTERVAL 10000
+
+// Delta of delta of each record in milliseconds. Both
+// ends of each width and one past them, in both orders.
+static const int64_t dods[] = {
+	0, 63, -63, 64, -64, -64, 64, 65, -65,
+	255, -255, 256, -256, -256, 256, 257, -257,
+	2047, -2047, 2048, -2048, -2048, 2048, 2049, -2049,
+	5000, -5000, 0
+};
+
+// Number of records.
+#define RECORDS (sizeof(dods) / sizeof(dods[0]))
+
+
+// ----
+
+
+// Options, normally set by main.c.
+options_t options;
+
+// Domains, normally probed by domain.c.
+domain_t domains[DOMAINS] = {
+	[DOMAIN_PKG] = { "Package", "pkg", PKG_STATUS, 0, false, true }
+};
+
+
+// ----
+
+
+/*
+ * Prints a message to stderr and exits with error code.
+ *
+ *  - code: Exit code.
+ *  - fmt: Format of message.
+ *  - ...: Message list.
+ */
+void exit_error(int32_t code, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	vfprintf(stderr, fmt, vl);
+
+	exit(code);
+}
+
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t gettime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * Puts a block with one record into a slot of a hand made file.
+ *
+ *  - file: Start of the file.
+ *  - slot: Offset in the file in PMTS_BLOCK units.
+ *  - time: Time of the record in milliseconds.
+ */
+static void putblock(uint8_t *file, uint64_t slot, uint64_t time) {
+	pmts_block_t *block = (pmts_block_t *)(file + slot * PMTS_BLOCK);
+	double value = 1000.0;
+	uint64_t raw;
+
+	memcpy(&raw, &value, sizeof(raw));
+
+	for (uint32_t i = 0; i < 8; i++) {
+		block->data[i] = time >> (56 - i * 8);
+		block->data[i + 8] = raw >> (56 - i * 8);
+	}
+
+	block->magic = PMTS_BLOCK_MAGIC;
+	block->first = time;
+	block->last = time;
+	block->records = 1;
+	block->bits = 128;
+	block->checksum = pmts_checksum(block);
+}
+
+
+/*
+ * Checks the search and the shadow slots on a hand made file
+ * of 5 blocks, block n holds a record at n seconds. Returns
+ * false on failure.
+ *
+ *  - path: File to create.
+ *  - hole: Block that wasn't written.
+ *  - shadow: Time of the newest shadow copy in milliseconds.
+ *  - from: Time to search for in milliseconds.
+ *  - expected: Time of the first record found.
+ */
+static bool testseek(const char *path, uint64_t hole, uint64_t shadow,
+		uint64_t from, uint64_t expected) {
+	static uint8_t data[(5 + 1 + PMTS_SHADOWS) * PMTS_BLOCK];
+	pmts_header_t *header = (pmts_header_t *)data;
+
+	memset(data, 0, sizeof(data));
+	header->magic = PMTS_MAGIC;
+	header->version = PMTS_VERSION;
+	header->block = PMTS_BLOCK;
+	header->columns = 1;
+
+	for (uint64_t n = 0; n < 5; n++) {
+		if (n != hole) {
+			putblock(data, n + 1 + PMTS_SHADOWS, n * 1000);
+		}
+	}
+
+	// An older copy in the other slot.
+	putblock(data, 1, shadow - 500);
+	putblock(data, 2, shadow);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd == -1 || write(fd, data, sizeof(data)) != sizeof(data)) {
+		exit_error(1, "ERROR: Couldn't write %s\n", path);
+	}
+
+	close(fd);
+
+	pmts_file_t file;
+	pmts_cursor_t cursor;
+	uint64_t time = UINT64_MAX;
+	double values[PMTS_COLUMNS];
+
+	if (!pmts_open(path, &file)) {
+		exit_error(1, "ERROR: Couldn't open %s\n", path);
+	}
+
+	for (uint64_t n = pmts_seek(&file, from); n < file.blocks; n++) {
+		pmts_begin(&cursor, &file, n);
+
+		if (pmts_next(&cursor, &time, values)) {
+			break;
+		}
+	}
+
+	pmts_close(&file);
+	unlink(path);
+
+	if (time != expected) {
+		printf("ERROR: Search for %" PRIu64 " ms with block %" PRIu64 " missing found %" PRIu64
+				" ms, expected %" PRIu64 " ms\n", from, hole, time, expected);
+		return false;
+	}
+
+	return true;
+}
+
+
+// ----
+
+
+int main(int argc, char *argv[]) {
+	const char *parent = "/tmp";
+	char dir[256];
+	char path[512];
+	int32_t ch;
+
+	while ((ch = getopt(argc, argv, "d:")) != -1) {
+		switch (ch) {
+			case 'd':
+				parent = optarg;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: teststore [-d directory]\n");
+				return 1;
+		}
+	}
+
+	snprintf(dir, sizeof(dir), "%s/teststore.XXXXXX", parent);
+
+	if (!mkdtemp(dir)) {
+		exit_error(1, "%s\n", "ERROR: Couldn't create the store directory");
+	}
+
+	options.packages = 1;
+	openstore(dir);
+
+	// The first sample is the baseline, each later
+	// one becomes a record. Package power is the
+	// record number in watts.
+	uint64_t times[RECORDS + 1];
+	int64_t delta = INTERVAL;
+	energy_t total;
+
+	memset(&total, 0, sizeof(total));
+	times[0] = 1000000;
+
+	storesample(times[0] * 1000000, &total);
+
+	for (uint32_t i = 1; i <= RECORDS; i++) {
+		delta += dods[i - 1];
+		times[i] = times[i - 1] + delta;
+		total.domain[DOMAIN_PKG] += i * delta / 1000.0;
+
+		storesample(times[i] * 1000000, &total);
+	}
+
+	closestore();
+
+	// Read it back.
+	DIR *d = opendir(dir);
+	struct dirent *entry;
+	uint32_t n = 0;
+	bool ok = true;
+
+	if (!d) {
+		exit_error(1, "ERROR: Couldn't open %s\n", dir);
+	}
+
+	while ((entry = readdir(d))) {
+		if (entry->d_name[0] == '.') {
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+		pmts_file_t file;
+		pmts_cursor_t cursor;
+		uint64_t time;
+		uint64_t first = 0;
+		double values[PMTS_COLUMNS];
+
+		if (!pmts_open(path, &file)) {
+			exit_error(1, "ERROR: Couldn't open %s\n", path);
+		}
+
+		for (uint64_t b = 0; b < file.blocks; b++) {
+			pmts_begin(&cursor, &file, b);
+
+			while (pmts_next(&cursor, &time, values)) {
+				if (n == 0) {
+					first = time - (times[1] - times[0]);
+				}
+
+				n++;
+
+				if (n > RECORDS) {
+					break;
+				}
+
+				if (time - first != times[n] - times[0]) {
+					printf("ERROR: Record %u at %+" PRId64 " ms, expected %+" PRId64 " ms\n",
+							n, (int64_t)(time - first), (int64_t)(times[n] - times[0]));
+					ok = false;
+				}
+
+				if (fabs(values[0] - n) > 0.001) {
+					printf("ERROR: Record %u has %.3f W, expected %u W\n", n, values[0], n);
+					ok = false;
+				}
+			}
+		}
+
+		pmts_close(&file);
+		unlink(path);
+	}
+
+	closedir(d);
+
+	if (n != RECORDS) {
+		printf("ERROR: %u records, expected %zu\n", n, RECORDS);
+		ok = false;
+	}
+
+	// The shadow copy is the last block, unless
+	// it's stale because that block is complete.
+	snprintf(path, sizeof(path), "%s/seek.pmts", dir);
+
+	ok &= testseek(path, 2, 5000, 2500, 3000);
+	ok &= testseek(path, 2, 5000, 3500, 4000);
+	ok &= testseek(path, 3, 5000, 2500, 4000);
+	ok &= testseek(path, 1, 5000, 4500, 5000);
+	ok &= testseek(path, 5, 4000, 4500, UINT64_MAX);
+
+	rmdir(dir);
+
+	printf("%s\n", ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
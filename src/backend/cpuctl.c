@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * FreeBSD cpuctl(4) backend. Each CPU is represented by one
+ * /dev/cpuctlN device, MSRs and CPUID are queried through
+ * ioctls on it. There's no way to batch several reads.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/cpuctl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "../main.h"
+#include "../msr.h"
+
+
+// --------
+
+
+/*
+ * Returns true if cpuctl(4) is loaded.
+ */
+static bool cpuctl_probe(void) {
+	struct stat sb;
+
+	return stat("/dev/cpuctl0", &sb) == 0;
+}
+
+
+/*
+ * Opens the given cpuctl(4) device.
+ *
+ *  - device: Device to open.
+ */
+static int32_t cpuctl_open(const char *device) {
+	return open(device, O_RDWR);
+}
+
+
+/*
+ * Reads the given MSR.
+ *
+ *  - fd: FD to the cpuctl(4) device.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool cpuctl_read(int32_t fd, int32_t msr, uint64_t *data) {
+	cpuctl_msr_args_t args;
+
+	args.msr = msr;
+
+	if (ioctl(fd, CPUCTL_RDMSR, &args) == -1) {
+		return false;
+	}
+
+	*data = args.data;
+
+	return true;
+}
+
+
+/*
+ * Writes the given MSR.
+ *
+ *  - fd: FD to the cpuctl(4) device.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+static bool cpuctl_write(int32_t fd, int32_t msr, uint64_t data) {
+	cpuctl_msr_args_t args;
+
+	args.msr = msr;
+	args.data = data;
+
+	if (ioctl(fd, CPUCTL_WRMSR, &args) == -1) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Queries the given CPUID leaf.
+ *
+ *  - fd: FD to the cpuctl(4) device.
+ *  - level: CPUID leaf.
+ *  - level_type: CPUID subleaf.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool cpuctl_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	cpuctl_cpuid_count_args_t cpuid;
+
+	cpuid.level = level;
+	cpuid.level_type = level_type;
+
+	if (ioctl(fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
+		return false;
+	}
+
+	memcpy(data, cpuid.data, sizeof(cpuid.data));
+
+	return true;
+}
+
+
+/*
+ * Closes the given cpuctl(4) device.
+ *
+ *  - fd: FD to close.
+ */
+static void cpuctl_close(int32_t fd) {
+	close(fd);
+}
+
+
+/*
+ * Returns the package id of a CPU, the upper bits of the
+ * x2APIC id. The number of lower bits is given by the core
+ * level. Returns false if the CPU doesn't exist.
+ *
+ *  - cpu: Number of the CPU.
+ *  - id: Filled with the package id.
+ */
+static bool cpuctl_packageid(int32_t cpu, uint32_t *id) {
+	uint32_t data[4];
+	char path[32];
+	int32_t fd;
+
+	snprintf(path, sizeof(path), "/dev/cpuctl%i", cpu);
+
+	if ((fd = cpuctl_open(path)) == -1) {
+		return false;
+	}
+
+	if (!cpuctl_cpuid(fd, 0xb, 1, data)) {
+		cpuctl_close(fd);
+		return false;
+	}
+
+	cpuctl_close(fd);
+
+	*id = data[3] >> (data[0] & 0x1f);
+
+	return true;
+}
+
+
+/*
+ * Returns the cpuctl(4) device of the given package. The
+ * packages are numbered in order of their first CPU.
+ *
+ *  - package: Package to look up.
+ *  - device: Filled with the device.
+ *  - len: Length of device.
+ *  - cpu: Filled with the CPU of the device.
+ */
+static bool cpuctl_package(uint32_t package, char *device, size_t len,
+		int32_t *cpu) {
+	uint32_t ids[MAX_PACKAGES];
+	uint32_t count = 0;
+	char path[32];
+
+	for (int32_t i = 0; count < MAX_PACKAGES; i++) {
+		uint32_t id;
+
+		if (!cpuctl_packageid(i, &id)) {
+			break;
+		}
+
+		snprintf(path, sizeof(path), "/dev/cpuctl%i", i);
+
+		uint32_t j;
+
+		for (j = 0; j < count && ids[j] != id; j++);
+
+		if (j < count) {
+			continue;
+		}
+
+		if (count == package) {
+			snprintf(device, len, "%s", path);
+			*cpu = i;
+
+			return true;
+		}
+
+		ids[count++] = id;
+	}
+
+	return false;
+}
+
+
+/*
+ * Opens the cpuctl(4) device of the n-th CPU of the given
+ * package. The topology is determined on first use.
+ *
+ *  - package: Package of the CPU.
+ *  - n: Number of the CPU within the package.
+ *  - cpu: Filled with the number of the CPU.
+ */
+static int32_t cpuctl_opencpu(uint32_t package, uint32_t n, int32_t *cpu) {
+	static uint32_t packages[MAX_CPUS];
+	static uint32_t count;
+	char path[32];
+
+	if (!count) {
+		uint32_t ids[MAX_PACKAGES];
+		uint32_t known = 0;
+		uint32_t id;
+
+		for (; count < MAX_CPUS && cpuctl_packageid(count, &id); count++) {
+			uint32_t j;
+
+			for (j = 0; j < known && ids[j] != id; j++);
+
+			if (j == known && known < MAX_PACKAGES) {
+				ids[known++] = id;
+			}
+
+			packages[count] = j;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (packages[i] != package || n-- > 0) {
+			continue;
+		}
+
+		snprintf(path, sizeof(path), "/dev/cpuctl%u", i);
+		*cpu = i;
+
+		return cpuctl_open(path);
+	}
+
+	return -1;
+}
+
+
+// --------
+
+
+const backend_t backend_cpuctl = {
+	.name = "cpuctl",
+	.device = "/dev/cpuctl0",
+	.emulated = false,
+	.probe = cpuctl_probe,
+	.open = cpuctl_open,
+	.read = cpuctl_read,
+	.readbatch = NULL,
+	.write = cpuctl_write,
+	.cpuid = cpuctl_cpuid,
+	.close = cpuctl_close,
+	.package = cpuctl_package,
+	.opencpu = cpuctl_opencpu,
+	.readcpus = NULL,
+	.unit = NULL,
+	.next = NULL
+};
+
+
+// --------
+
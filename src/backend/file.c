@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * File backend. Instead of real hardware the MSRs and CPUID
+ * leafs are read from a regular file. The file may be altered
+ * while powermon is running, e.g. by a script advancing the
+ * *_STATUS counters. This allows to run powermon without root
+ * privileges, on unsupported CPUs and on other machines.
+ *
+ * The file is a sparse array of 16 byte records, each record
+ * consists of two 64 bit words in host byte order:
+ *
+ *  - MSR n is at offset n * 16. The first word is non-zero if
+ *    the MSR exists, the second word is the MSRs content.
+ *  - The CPUID leafs follow the MSRs at FILE_CPUID. The basic
+ *    leaf n is at FILE_CPUID + n * 16, the extended leaf
+ *    0x80000000 + n at FILE_CPUID + (0x100 + n) * 16. Each
+ *    record holds EAX, EBX, ECX and EDX as 32 bit words.
+ *    Subleafs aren't supported.
+ *  - The MSRs of single CPUs follow the CPUID leafs at FILE_CPUS.
+ *    MSR n of CPU m is at FILE_CPUS + (m * FILE_CPUMSRS + n) * 16,
+ *    only MSRs below FILE_CPUMSRS can be given per CPU. A CPU
+ *    exists if it has a TSC_COUNTER. MSRs not given for a CPU
+ *    are read from the records above, like package wide MSRs
+ *    can be read from each CPU of the package.
+ *
+ * Everything not present in the file reads as nonexistent.
+ * Writes go to the package wide records of MSRs that exist,
+ * so a script can model how the CPU reacts to them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../main.h"
+#include "../msr.h"
+
+
+// --------
+
+
+// Offset of the first CPUID leaf, right behind the MSRs.
+#define FILE_CPUID (UINT64_C(0x100000000) * 16)
+
+// Offset of the MSRs of the first CPU, behind the CPUID leafs.
+#define FILE_CPUS (FILE_CPUID + 0x200 * 16)
+
+// MSRs per CPU.
+#define FILE_CPUMSRS 0x1000
+
+// Highest FD that can be a CPU.
+#define FILE_MAXFD 4096
+
+
+// --------
+
+
+// CPU + 1 of each FD opened by file_opencpu(),
+// 0 for a package device.
+static uint32_t cpuof[FILE_MAXFD];
+
+
+// --------
+
+
+/*
+ * Reads the record at the given offset. Returns
+ * false if it doesn't exist.
+ *
+ *  - fd: FD to the file.
+ *  - offset: Offset of the record.
+ *  - data: Filled with the records content.
+ */
+static bool file_record(int32_t fd, off_t offset, uint64_t *data) {
+	uint64_t record[2];
+
+	if (pread(fd, record, sizeof(record), offset) != sizeof(record)) {
+		return false;
+	}
+
+	if (!record[0]) {
+		errno = ENOENT;
+		return false;
+	}
+
+	*data = record[1];
+
+	return true;
+}
+
+
+// --------
+
+
+/*
+ * The file backend is never selected automatically,
+ * it must be requested with -b.
+ */
+static bool file_probe(void) {
+	return false;
+}
+
+
+/*
+ * Opens the given file.
+ *
+ *  - device: File to open.
+ */
+static int32_t file_open(const char *device) {
+	return open(device, options.writable ? O_RDWR : O_RDONLY);
+}
+
+
+/*
+ * Reads the given MSR from the file.
+ *
+ *  - fd: FD to the file.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool file_read(int32_t fd, int32_t msr, uint64_t *data) {
+	if (fd < FILE_MAXFD && cpuof[fd] && (uint32_t)msr < FILE_CPUMSRS) {
+		off_t offset = FILE_CPUS + ((off_t)(cpuof[fd] - 1) * FILE_CPUMSRS + msr) * 16;
+
+		if (file_record(fd, offset, data)) {
+			return true;
+		}
+	}
+
+	return file_record(fd, (off_t)(uint32_t)msr * 16, data);
+}
+
+
+/*
+ * Writes the given MSR into the file.
+ *
+ *  - fd: FD to the file.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+static bool file_write(int32_t fd, int32_t msr, uint64_t data) {
+	uint64_t record[2] = { 1, data };
+	uint64_t old;
+
+	if (!file_record(fd, (off_t)(uint32_t)msr * 16, &old)) {
+		return false;
+	}
+
+	if (pwrite(fd, record, sizeof(record), (off_t)(uint32_t)msr * 16) != sizeof(record)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Reads the given CPUID leaf from the file.
+ *
+ *  - fd: FD to the file.
+ *  - level: CPUID leaf.
+ *  - level_type: Unused.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool file_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	(void)level_type;
+
+	if ((level & 0x7fffff00) != 0) {
+		errno = ENOENT;
+		return false;
+	}
+
+	uint64_t index = (level & 0xff) + ((level & 0x80000000) ? 0x100 : 0);
+
+	if (pread(fd, data, 4 * sizeof(uint32_t), FILE_CPUID + index * 16) != 4 * sizeof(uint32_t)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Closes the given file.
+ *
+ *  - fd: FD to close.
+ */
+static void file_close(int32_t fd) {
+	if (fd < FILE_MAXFD) {
+		cpuof[fd] = 0;
+	}
+
+	close(fd);
+}
+
+
+/*
+ * Opens the n-th CPU of the given package. The CPUs are
+ * numbered within the file of each package.
+ *
+ *  - package: Package of the CPU.
+ *  - n: Number of the CPU within the package.
+ *  - cpu: Filled with the number of the CPU.
+ */
+static int32_t file_opencpu(uint32_t package, uint32_t n, int32_t *cpu) {
+	uint64_t data;
+	int32_t fd;
+
+	if (package >= options.packages) {
+		return -1;
+	}
+
+	if ((fd = file_open(options.devices[package])) == -1) {
+		return -1;
+	}
+
+	off_t offset = FILE_CPUS + ((off_t)n * FILE_CPUMSRS + TSC_COUNTER) * 16;
+
+	if (fd >= FILE_MAXFD || !file_record(fd, offset, &data)) {
+		close(fd);
+		return -1;
+	}
+
+	cpuof[fd] = n + 1;
+	*cpu = n;
+
+	return fd;
+}
+
+
+// --------
+
+
+const backend_t backend_file = {
+	.name = "file",
+	.device = NULL,
+	.emulated = false,
+	.probe = file_probe,
+	.open = file_open,
+	.read = file_read,
+	.readbatch = NULL,
+	.write = file_write,
+	.cpuid = file_cpuid,
+	.close = file_close,
+	.package = NULL,
+	.opencpu = file_opencpu,
+	.readcpus = NULL,
+	.unit = NULL,
+	.next = NULL
+};
+
+
+// --------
+
@@ -0,0 +1,764 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Linux msr(4) backend. Each CPU is represented by one
+ * /dev/cpu/N/msr device. The MSR is selected by the file
+ * offset, so reading it is just one pread() on a FD that
+ * is kept open for the whole runtime. Linux has a cpuid(4)
+ * device too, but the CPUID leafs we're interested in are
+ * identical on all CPUs. So we're just executing CPUID.
+ *
+ * Batches of MSRs are read through an io_uring, created for
+ * each opened device. All reads of a batch are submitted and
+ * reaped with just one io_uring_enter(). If the kernel is too
+ * old, io_uring is forbidden or the reads are refused with
+ * EINVAL we're falling back to pread().
+ * The MSRs of single CPUs are read through one larger io_uring
+ * shared by all CPUs. The msr(4) device can't be read without
+ * blocking, so the kernel hands the reads to it's workers and
+ * they're executed in parallel.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define LINUX_URING
+#endif
+#endif
+#endif
+
+#include "../main.h"
+#include "../msr.h"
+#include "linux.h"
+
+
+// --------
+
+
+#ifdef LINUX_URING
+
+// Number of submission queue entries. Larger
+// batches are split into several submissions.
+#define URING_ENTRIES 16
+
+// Number of submission queue entries of the
+// io_uring used for the CPUs.
+#define URING_CPUENTRIES 256
+
+// Highest FD that gets an io_uring.
+#define URING_MAXFD 256
+
+/*
+ * An io_uring and it's mapped rings.
+ */
+typedef struct uring_t {
+	// FD of the ring itself.
+	int32_t fd;
+
+	// Number of submission queue entries.
+	uint32_t entries;
+
+	// Submission queue.
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	struct io_uring_sqe *sqes;
+
+	// Completion queue.
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	// Mappings, needed to unmap them.
+	void *sq_ptr;
+	size_t sq_len;
+	void *cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+} uring_t;
+
+// io_uring of each device, indexed by the devices FD.
+static uring_t *rings[URING_MAXFD];
+
+// io_uring shared by all CPUs, created on first use.
+static uring_t *cpuring;
+
+// Set if creating cpuring failed.
+static bool nocpuring;
+
+#endif
+
+
+// --------
+
+
+// Number of online CPUs and the package each
+// belongs to, sorted by CPU number.
+static int32_t topology_cpus[MAX_CPUS];
+static uint32_t topology_packages[MAX_CPUS];
+static uint32_t topology_count;
+
+// Set once the topology was read.
+static bool topology_read;
+
+
+// --------
+
+
+#ifdef LINUX_URING
+
+
+// --------
+
+
+/*
+ * Destroys the given io_uring.
+ *
+ *  - ring: io_uring to destroy.
+ */
+static void uring_destroy(uring_t *ring) {
+	if (ring->sqes && ring->sqes != MAP_FAILED) {
+		munmap(ring->sqes, ring->sqes_len);
+	}
+
+	if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED && ring->cq_ptr != ring->sq_ptr) {
+		munmap(ring->cq_ptr, ring->cq_len);
+	}
+
+	if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED) {
+		munmap(ring->sq_ptr, ring->sq_len);
+	}
+
+	close(ring->fd);
+	free(ring);
+}
+
+
+/*
+ * Creates an io_uring. Returns NULL if the
+ * kernel doesn't support io_uring.
+ *
+ *  - entries: Number of submission queue entries.
+ */
+static uring_t *uring_create(uint32_t entries) {
+	struct io_uring_params params;
+	uring_t *ring;
+
+	if (!(ring = calloc(1, sizeof(uring_t)))) {
+		return NULL;
+	}
+
+	memset(&params, 0, sizeof(params));
+
+	if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->entries = params.sq_entries;
+
+	// IORING_OP_READ was added together with IORING_FEAT_RW_CUR_POS
+	// in Linux 5.6, older kernels would fail every single read.
+	if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+		uring_destroy(ring);
+		return NULL;
+	}
+
+	ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_len > ring->sq_len) {
+			ring->sq_len = ring->cq_len;
+		}
+
+		ring->cq_len = ring->sq_len;
+	}
+
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+	if (ring->sq_ptr == MAP_FAILED) {
+		uring_destroy(ring);
+		return NULL;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+		if (ring->cq_ptr == MAP_FAILED) {
+			uring_destroy(ring);
+			return NULL;
+		}
+	}
+
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sqes == MAP_FAILED) {
+		uring_destroy(ring);
+		return NULL;
+	}
+
+	ring->sq_tail = (uint32_t *)((char *)ring->sq_ptr + params.sq_off.tail);
+	ring->sq_mask = (uint32_t *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+	ring->sq_array = (uint32_t *)((char *)ring->sq_ptr + params.sq_off.array);
+
+	ring->cq_head = (uint32_t *)((char *)ring->cq_ptr + params.cq_off.head);
+	ring->cq_tail = (uint32_t *)((char *)ring->cq_ptr + params.cq_off.tail);
+	ring->cq_mask = (uint32_t *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+	return ring;
+}
+
+
+/*
+ * Reads up to ring->entries MSRs through the io_uring.
+ * Submission and completion is done with one syscall.
+ *
+ *  - ring: io_uring to use.
+ *  - fds: FD to the msr(4) device of each read.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs content.
+ *  - count: Number of MSRs.
+ */
+static bool uring_read(uring_t *ring, const int32_t *fds, const int32_t *msrs,
+		uint64_t *data, size_t count) {
+	// We're the only producer, no need for barriers here.
+	uint32_t tail = *ring->sq_tail;
+	uint32_t mask = *ring->sq_mask;
+
+	for (size_t i = 0; i < count; i++) {
+		uint32_t index = tail & mask;
+		struct io_uring_sqe *sqe = &ring->sqes[index];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = fds[i];
+		sqe->off = (uint32_t)msrs[i];
+		sqe->addr = (uint64_t)(uintptr_t)&data[i];
+		sqe->len = sizeof(uint64_t);
+		sqe->user_data = i;
+
+		ring->sq_array[index] = index;
+		tail++;
+	}
+
+	__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+	if (syscall(__NR_io_uring_enter, ring->fd, count, count,
+				IORING_ENTER_GETEVENTS, NULL, 0) != (long)count) {
+		return false;
+	}
+
+	// Reap all completions, even if one of them failed.
+	// Otherwise they would end up in the next batch.
+	uint32_t head = *ring->cq_head;
+	size_t reaped = 0;
+	bool ok = true;
+
+	while (reaped < count) {
+		uint32_t cqtail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+		if (head == cqtail) {
+			break;
+		}
+
+		for (; head != cqtail; head++, reaped++) {
+			struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+			if (cqe->res != sizeof(uint64_t)) {
+				errno = (cqe->res < 0) ? -cqe->res : EIO;
+				ok = false;
+			}
+		}
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return ok && reaped == count;
+}
+
+#endif
+
+
+// --------
+
+
+/*
+ * Returns the number of the first CPU belonging to the
+ * given package or -1 if there's no such package. The
+ * packages are numbered in order of their physical id.
+ *
+ *  - package: Package to look up.
+ *  - id: Filled with the packages physical id.
+ */
+int32_t linux_packagecpu(uint32_t package, int32_t *id) {
+	// Physical id and first CPU of each package,
+	// sorted by physical id.
+	int32_t ids[MAX_PACKAGES];
+	int32_t cpus[MAX_PACKAGES];
+	uint32_t count = 0;
+
+	struct dirent *entry;
+	char path[512];
+	char buf[16];
+	DIR *dir;
+
+	if (!(dir = opendir("/sys/devices/system/cpu"))) {
+		return -1;
+	}
+
+	while ((entry = readdir(dir))) {
+		if (strncmp(entry->d_name, "cpu", 3) || !isdigit((unsigned char)entry->d_name[3])) {
+			continue;
+		}
+
+		int32_t cpu = strtol(entry->d_name + 3, NULL, 10);
+		int32_t fd;
+		ssize_t num;
+
+		// Offline CPUs have no topology.
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/%s/topology/physical_package_id",
+				entry->d_name);
+
+		if ((fd = open(path, O_RDONLY)) == -1) {
+			continue;
+		}
+
+		num = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+
+		if (num <= 0) {
+			continue;
+		}
+
+		buf[num] = '\0';
+		int32_t physid = strtol(buf, NULL, 10);
+
+		uint32_t i;
+
+		for (i = 0; i < count && ids[i] < physid; i++);
+
+		if (i < count && ids[i] == physid) {
+			if (cpu < cpus[i]) {
+				cpus[i] = cpu;
+			}
+		} else if (count < MAX_PACKAGES) {
+			memmove(&ids[i + 1], &ids[i], (count - i) * sizeof(int32_t));
+			memmove(&cpus[i + 1], &cpus[i], (count - i) * sizeof(int32_t));
+			ids[i] = physid;
+			cpus[i] = cpu;
+			count++;
+		}
+	}
+
+	closedir(dir);
+
+	if (package >= count) {
+		return -1;
+	}
+
+	*id = ids[package];
+
+	return cpus[package];
+}
+
+
+/*
+ * Reads the package of each online CPU. The packages are
+ * numbered like by linux_packagecpu().
+ */
+static void linux_readtopology(void) {
+	int32_t ids[MAX_PACKAGES];
+	uint32_t packages = 0;
+	char path[128];
+	char buf[16];
+
+	topology_read = true;
+
+	while (packages < MAX_PACKAGES && linux_packagecpu(packages, &ids[packages]) != -1) {
+		packages++;
+	}
+
+	// CPU numbers may have gaps, for example
+	// when CPUs were taken offline.
+	for (int32_t cpu = 0; cpu < MAX_CPUS * 4 && topology_count < MAX_CPUS; cpu++) {
+		int32_t fd;
+		ssize_t num;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", cpu);
+
+		if ((fd = open(path, O_RDONLY)) == -1) {
+			continue;
+		}
+
+		num = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+
+		if (num <= 0) {
+			continue;
+		}
+
+		buf[num] = '\0';
+		int32_t physid = strtol(buf, NULL, 10);
+
+		for (uint32_t p = 0; p < packages; p++) {
+			if (ids[p] == physid) {
+				topology_cpus[topology_count] = cpu;
+				topology_packages[topology_count] = p;
+				topology_count++;
+				break;
+			}
+		}
+	}
+}
+
+
+// --------
+
+
+/*
+ * Returns true if the msr(4) module is loaded.
+ */
+static bool linux_probe(void) {
+	struct stat sb;
+
+	return stat("/dev/cpu/0/msr", &sb) == 0;
+}
+
+
+/*
+ * Opens the given msr(4) device.
+ *
+ *  - device: Device to open.
+ */
+static int32_t linux_open(const char *device) {
+	int32_t fd;
+
+	if ((fd = open(device, options.writable ? O_RDWR : O_RDONLY)) == -1) {
+		return -1;
+	}
+
+#ifdef LINUX_URING
+	if (fd < URING_MAXFD) {
+		rings[fd] = uring_create(URING_ENTRIES);
+	}
+#endif
+
+	return fd;
+}
+
+
+/*
+ * Reads the given MSR.
+ *
+ *  - fd: FD to the msr(4) device.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool linux_read(int32_t fd, int32_t msr, uint64_t *data) {
+	if (pread(fd, data, sizeof(*data), (uint32_t)msr) != sizeof(*data)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Writes the given MSR. The kernel may refuse it,
+ * see msr.allow_writes.
+ *
+ *  - fd: FD to the msr(4) device.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+static bool linux_write(int32_t fd, int32_t msr, uint64_t data) {
+	if (pwrite(fd, &data, sizeof(data), (uint32_t)msr) != sizeof(data)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Reads several MSRs. If the device has an io_uring the
+ * reads are submitted through it, else pread() is used.
+ *
+ *  - fd: FD to the msr(4) device.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs content.
+ *  - count: Number of MSRs.
+ */
+static bool linux_readbatch(int32_t fd, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+#ifdef LINUX_URING
+	if (fd < URING_MAXFD && rings[fd]) {
+		int32_t fds[URING_ENTRIES];
+
+		for (size_t i = 0; i < URING_ENTRIES; i++) {
+			fds[i] = fd;
+		}
+
+		bool ok = true;
+
+		for (size_t i = 0; ok && i < count; i += URING_ENTRIES) {
+			size_t num = (count - i < URING_ENTRIES) ? count - i : URING_ENTRIES;
+
+			ok = uring_read(rings[fd], fds, msrs + i, data + i, num);
+		}
+
+		if (ok) {
+			return true;
+		}
+
+		// The kernel doesn't know IORING_OP_READ after
+		// all, use pread() from now on.
+		if (errno != EINVAL) {
+			return false;
+		}
+
+		uring_destroy(rings[fd]);
+		rings[fd] = NULL;
+	}
+#endif
+
+	for (size_t i = 0; i < count; i++) {
+		if (!linux_read(fd, msrs[i], &data[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * Queries the given CPUID leaf.
+ *
+ *  - fd: Unused.
+ *  - level: CPUID leaf.
+ *  - level_type: CPUID subleaf.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool linux_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	(void)fd;
+
+#if defined(__i386__) || defined(__x86_64__)
+	__cpuid_count(level, level_type, data[0], data[1], data[2], data[3]);
+
+	return true;
+#else
+	(void)level;
+	(void)level_type;
+	(void)data;
+
+	errno = ENOTSUP;
+
+	return false;
+#endif
+}
+
+
+/*
+ * Closes the given msr(4) device.
+ *
+ *  - fd: FD to close.
+ */
+static void linux_close(int32_t fd) {
+#ifdef LINUX_URING
+	if (fd < URING_MAXFD && rings[fd]) {
+		uring_destroy(rings[fd]);
+		rings[fd] = NULL;
+	}
+
+	// Destroyed with the last package.
+	if (cpuring && fd == options.fds[0]) {
+		uring_destroy(cpuring);
+		cpuring = NULL;
+		nocpuring = false;
+	}
+#endif
+
+	close(fd);
+}
+
+
+/*
+ * Returns the msr(4) device of the given package.
+ *
+ *  - package: Package to look up.
+ *  - device: Filled with the device.
+ *  - len: Length of device.
+ *  - cpu: Filled with the CPU of the device.
+ */
+static bool linux_package(uint32_t package, char *device, size_t len,
+		int32_t *cpu) {
+	int32_t id;
+
+	if ((*cpu = linux_packagecpu(package, &id)) == -1) {
+		return false;
+	}
+
+	snprintf(device, len, "/dev/cpu/%i/msr", *cpu);
+
+	return true;
+}
+
+
+/*
+ * Opens the msr(4) device of the n-th CPU of the given package.
+ *
+ *  - package: Package of the CPU.
+ *  - n: Number of the CPU within the package.
+ *  - cpu: Filled with the number of the CPU.
+ */
+static int32_t linux_opencpu(uint32_t package, uint32_t n, int32_t *cpu) {
+	char device[32];
+
+	if (!topology_read) {
+		linux_readtopology();
+	}
+
+	for (uint32_t i = 0; i < topology_count; i++) {
+		if (topology_packages[i] != package || n-- > 0) {
+			continue;
+		}
+
+		snprintf(device, sizeof(device), "/dev/cpu/%i/msr", topology_cpus[i]);
+		*cpu = topology_cpus[i];
+
+		// Read through the shared io_uring.
+		return open(device, O_RDONLY);
+	}
+
+	return -1;
+}
+
+
+/*
+ * Reads MSRs of several CPUs. All reads go through one
+ * io_uring, if it's not available pread() is used.
+ *
+ *  - fds: FD to the msr(4) device of each MSR.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs content.
+ *  - count: Number of MSRs.
+ */
+static bool linux_readcpus(const int32_t *fds, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+#ifdef LINUX_URING
+	if (!cpuring && !nocpuring) {
+		nocpuring = !(cpuring = uring_create(URING_CPUENTRIES));
+	}
+
+	if (cpuring) {
+		bool ok = true;
+
+		for (size_t i = 0; ok && i < count; i += cpuring->entries) {
+			size_t num = (count - i < cpuring->entries) ? count - i : cpuring->entries;
+
+			ok = uring_read(cpuring, fds + i, msrs + i, data + i, num);
+		}
+
+		if (ok) {
+			return true;
+		}
+
+		// Like in linux_readbatch().
+		if (errno != EINVAL) {
+			return false;
+		}
+
+		uring_destroy(cpuring);
+		cpuring = NULL;
+		nocpuring = true;
+	}
+#endif
+
+	for (size_t i = 0; i < count; i++) {
+		if (!linux_read(fds[i], msrs[i], &data[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// --------
+
+
+const backend_t backend_linux = {
+	.name = "linux",
+	.device = "/dev/cpu/0/msr",
+	.emulated = false,
+	.probe = linux_probe,
+	.open = linux_open,
+	.read = linux_read,
+	.readbatch = linux_readbatch,
+	.write = linux_write,
+	.cpuid = linux_cpuid,
+	.close = linux_close,
+	.package = linux_package,
+	.opencpu = linux_opencpu,
+	.readcpus = linux_readcpus,
+	.unit = NULL,
+	.next = NULL
+};
+
+
+// --------
+
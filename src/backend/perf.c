@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Linux perf_event backend. Instead of reading the MSRs the
+ * energy counters are read through the kernels power PMU,
+ * which doesn't need root privileges or the msr(4) driver.
+ * All energy events of a package are opened as one group,
+ * one read() on the group leader returns all of them.
+ *
+ * The power PMU gives 64 bit counters which never wrap. To
+ * let the rest of powermon work unaltered they're exposed
+ * as emulated *_STATUS MSRs, in the unit advertised by an
+ * emulated UNIT_MULTIPLIER. All other MSRs don't exist.
+ *
+ * The device is a CPU of the package to monitor. If it's
+ * a path instead, it's taken as a stub of the power PMU:
+ * a directory with the same events/ layout as the sysfs
+ * event source and a file 'group' holding the result of a
+ * grouped read (number of events, then each value as 64
+ * bit word) in the order of the events table below. This
+ * allows to test without the PMU.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "../msr.h"
+#include "linux.h"
+
+
+// --------
+
+
+// Event source of the power PMU.
+#define PERF_SOURCE "/sys/bus/event_source/devices/power"
+
+// Emulated UNIT_MULTIPLIER: 1/8 watt, 1/16384 joule
+// and 1/1024 seconds, just like most real CPUs.
+#define PERF_UNITS 0xa0e03
+
+// Energy unit in the emulated UNIT_MULTIPLIER.
+#define PERF_ENERGY_UNIT 16384.0
+
+// Highest FD that can become a group leader.
+#define PERF_MAXFD 256
+
+/*
+ * Energy events and the MSRs they're emulating.
+ */
+static const struct {
+	const char *name;
+	int32_t msr;
+} events[] = {
+	{ "energy-pkg", PKG_STATUS },
+	{ "energy-cores", PP0_STATUS },
+	{ "energy-gpu", PP1_STATUS },
+	{ "energy-ram", DRAM_STATUS },
+	{ "energy-psys", PLATFORM_STATUS }
+};
+
+#define PERF_EVENTS (sizeof(events) / sizeof(events[0]))
+
+/*
+ * A group of events, belonging to one package.
+ */
+typedef struct perfgroup_t {
+	// FDs of the group members. The
+	// first one is the group leader.
+	int32_t fds[PERF_EVENTS];
+
+	// Index into events for each member.
+	size_t event[PERF_EVENTS];
+
+	// Scale to joule for each member.
+	double scale[PERF_EVENTS];
+
+	// Number of members.
+	size_t count;
+
+	// True if this is a stub.
+	bool stub;
+} perfgroup_t;
+
+// Groups, indexed by their leaders FD.
+static perfgroup_t *groups[PERF_MAXFD];
+
+
+// --------
+
+
+/*
+ * Reads the given file into buf, stripping the trailing
+ * newline. Returns false if the file couldn't be read.
+ *
+ *  - path: File to read.
+ *  - buf: Buffer to fill.
+ *  - len: Length of buf.
+ */
+static bool readfile(const char *path, char *buf, size_t len) {
+	int32_t fd;
+	ssize_t num;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return false;
+	}
+
+	num = read(fd, buf, len - 1);
+	close(fd);
+
+	if (num <= 0) {
+		return false;
+	}
+
+	buf[num] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return true;
+}
+
+
+/*
+ * Closes all members of the given group and frees it.
+ *
+ *  - group: Group to destroy.
+ */
+static void destroygroup(perfgroup_t *group) {
+	for (size_t i = group->count; i > 0; i--) {
+		close(group->fds[i - 1]);
+	}
+
+	free(group);
+}
+
+
+/*
+ * Reads the whole group at once and fills value with
+ * each members counter in joule. Returns false on error.
+ *
+ *  - group: Group to read.
+ *  - joules: Filled with the values, one per member.
+ */
+static bool readgroup(perfgroup_t *group, double *joules) {
+	uint64_t buf[1 + PERF_EVENTS];
+	size_t len = (1 + group->count) * sizeof(uint64_t);
+	ssize_t num;
+
+	if (group->stub) {
+		num = pread(group->fds[0], buf, len, 0);
+	} else {
+		num = read(group->fds[0], buf, len);
+	}
+
+	if (num != (ssize_t)len || buf[0] != group->count) {
+		errno = EIO;
+		return false;
+	}
+
+	for (size_t i = 0; i < group->count; i++) {
+		joules[i] = buf[1 + i] * group->scale[i];
+	}
+
+	return true;
+}
+
+
+// --------
+
+
+/*
+ * Returns true if the kernel has a power PMU.
+ */
+static bool perf_probe(void) {
+	struct stat sb;
+
+	return stat(PERF_SOURCE "/type", &sb) == 0;
+}
+
+
+/*
+ * Opens all energy events present on this CPU as one
+ * group. Returns the FD of the group leader.
+ *
+ *  - device: CPU number or path to a stub.
+ */
+static int32_t perf_open(const char *device) {
+	struct perf_event_attr attr;
+	perfgroup_t *group;
+	const char *source;
+	char path[256];
+	char buf[64];
+	int32_t cpu = 0;
+	uint32_t type = 0;
+
+	if (!(group = calloc(1, sizeof(perfgroup_t)))) {
+		return -1;
+	}
+
+	if (device[0] == '/') {
+		group->stub = true;
+		source = device;
+	} else {
+		cpu = strtol(device, NULL, 10);
+		source = PERF_SOURCE;
+
+		if (!readfile(PERF_SOURCE "/type", buf, sizeof(buf))) {
+			free(group);
+			return -1;
+		}
+
+		type = strtoul(buf, NULL, 10);
+	}
+
+	for (size_t i = 0; i < PERF_EVENTS; i++) {
+		int32_t fd;
+
+		// Only events present on this CPU.
+		snprintf(path, sizeof(path), "%s/events/%s", source, events[i].name);
+
+		if (!readfile(path, buf, sizeof(buf)) || strncmp(buf, "event=", 6)) {
+			continue;
+		}
+
+		memset(&attr, 0, sizeof(attr));
+		attr.type = type;
+		attr.size = sizeof(attr);
+		attr.config = strtoull(buf + 6, NULL, 16);
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		snprintf(path, sizeof(path), "%s/events/%s.scale", source, events[i].name);
+
+		if (!readfile(path, buf, sizeof(buf))) {
+			continue;
+		}
+
+		if (group->stub) {
+			if (group->count == 0) {
+				snprintf(path, sizeof(path), "%s/group", source);
+				fd = open(path, O_RDONLY);
+			} else {
+				fd = dup(group->fds[0]);
+			}
+		} else {
+			fd = syscall(__NR_perf_event_open, &attr, -1, cpu,
+					group->count ? group->fds[0] : -1, 0);
+		}
+
+		if (fd == -1) {
+			int32_t error = errno;
+			destroygroup(group);
+			errno = error;
+
+			return -1;
+		}
+
+		group->fds[group->count] = fd;
+		group->event[group->count] = i;
+		group->scale[group->count] = strtod(buf, NULL);
+		group->count++;
+	}
+
+	if (!group->count || group->fds[0] >= PERF_MAXFD) {
+		destroygroup(group);
+		errno = ENODEV;
+
+		return -1;
+	}
+
+	groups[group->fds[0]] = group;
+
+	return group->fds[0];
+}
+
+
+/*
+ * Reads several emulated MSRs with one read of the group.
+ *
+ *  - fd: FD of the group leader.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs content.
+ *  - count: Number of MSRs.
+ */
+static bool perf_readbatch(int32_t fd, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+	perfgroup_t *group = groups[fd];
+	double joules[PERF_EVENTS];
+	bool sampled = false;
+
+	for (size_t i = 0; i < count; i++) {
+		if (msrs[i] == UNIT_MULTIPLIER) {
+			data[i] = PERF_UNITS;
+			continue;
+		}
+
+		size_t member;
+
+		for (member = 0; member < group->count; member++) {
+			if (events[group->event[member]].msr == msrs[i]) {
+				break;
+			}
+		}
+
+		if (member == group->count) {
+			errno = ENOENT;
+			return false;
+		}
+
+		if (!sampled) {
+			if (!readgroup(group, joules)) {
+				return false;
+			}
+
+			sampled = true;
+		}
+
+		// Truncated to 32 bit, just like the real MSRs.
+		data[i] = (uint32_t)(uint64_t)(joules[member] * PERF_ENERGY_UNIT);
+	}
+
+	return true;
+}
+
+
+/*
+ * Reads one emulated MSR.
+ *
+ *  - fd: FD of the group leader.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool perf_read(int32_t fd, int32_t msr, uint64_t *data) {
+	return perf_readbatch(fd, &msr, data, 1);
+}
+
+
+/*
+ * Queries the given CPUID leaf. Just like the Linux
+ * backend we're executing CPUID.
+ *
+ *  - fd: Unused.
+ *  - level: CPUID leaf.
+ *  - level_type: CPUID subleaf.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool perf_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	return backend_linux.cpuid(fd, level, level_type, data);
+}
+
+
+/*
+ * Closes the given group.
+ *
+ *  - fd: FD of the group leader.
+ */
+static void perf_close(int32_t fd) {
+	destroygroup(groups[fd]);
+	groups[fd] = NULL;
+}
+
+
+/*
+ * Returns the CPU number of the given package.
+ *
+ *  - package: Package to look up.
+ *  - device: Filled with the CPU number.
+ *  - len: Length of device.
+ *  - cpu: Filled with the CPU number.
+ */
+static bool perf_package(uint32_t package, char *device, size_t len,
+		int32_t *cpu) {
+	int32_t id;
+
+	if ((*cpu = linux_packagecpu(package, &id)) == -1) {
+		return false;
+	}
+
+	snprintf(device, len, "%i", *cpu);
+
+	return true;
+}
+
+
+// --------
+
+
+const backend_t backend_perf = {
+	.name = "perf",
+	.device = "0",
+	.emulated = true,
+	.probe = perf_probe,
+	.open = perf_open,
+	.read = perf_read,
+	.readbatch = perf_readbatch,
+	.write = NULL,
+	.cpuid = perf_cpuid,
+	.close = perf_close,
+	.package = perf_package,
+	.opencpu = NULL,
+	.readcpus = NULL,
+	.unit = NULL,
+	.next = NULL
+};
+
+
+// --------
+
@@ -0,0 +1,818 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Linux powercap backend. The energy counters are read from
+ * the intel-rapl zones in sysfs, which doesn't need the msr(4)
+ * driver. The zone tree is discovered once when the device is
+ * opened and all energy_uj and max_energy_range_uj files are
+ * kept open, each sample is just one pread() per zone.
+ *
+ * The zones count microjoules and wrap at their individual
+ * max_energy_range_uj. The wraparounds are handled here, the
+ * accumulated energy is exposed as emulated *_STATUS MSRs in
+ * the unit advertised by an emulated UNIT_MULTIPLIER. So the
+ * rest of powermon works unaltered. The constraints of the
+ * package zone are exposed as emulated PKG_LIMIT, constraint
+ * 0 is PL1 and constraint 1 is PL2, and it's maximum power as
+ * emulated PKG_INFO. PKG_LIMIT can be written if the device
+ * was opened for writing. All other MSRs don't exist.
+ *
+ * The device is the package zone, for example
+ * /sys/class/powercap/intel-rapl:0. Since only regular files
+ * are read, a fake tree in any directory works as well. The
+ * psys zone is machine wide, it's only added to the first
+ * package opened.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../main.h"
+#include "../msr.h"
+#include "linux.h"
+
+
+// --------
+
+
+// Package zone used by default.
+#define POWERCAP_ZONE "/sys/class/powercap/intel-rapl:0"
+
+// Emulated UNIT_MULTIPLIER: 1/8 watt, 1/16384 joule
+// and 1/1024 seconds, just like most real CPUs.
+#define POWERCAP_UNITS 0xa0e03
+
+// Energy unit in the emulated UNIT_MULTIPLIER.
+#define POWERCAP_ENERGY_UNIT 16384
+
+// Microjoule at which the emulated 32 bit energy
+// counters wrap, 2^32 energy units.
+#define POWERCAP_ENERGY_WRAP ((1ull << 32) / POWERCAP_ENERGY_UNIT * 1000000)
+
+// Power and time unit in the emulated UNIT_MULTIPLIER.
+#define POWERCAP_POWER_UNIT 8
+#define POWERCAP_TIME_UNIT 1024
+
+// Maximum number of zones per package.
+#define POWERCAP_ZONES 8
+
+// Highest FD that can become a package.
+#define POWERCAP_MAXFD 256
+
+/*
+ * Zone names and the MSRs they're emulating.
+ */
+static const struct {
+	const char *name;
+	int32_t msr;
+} names[] = {
+	{ "package", PKG_STATUS },
+	{ "core", PP0_STATUS },
+	{ "uncore", PP1_STATUS },
+	{ "dram", DRAM_STATUS },
+	{ "psys", PLATFORM_STATUS }
+};
+
+#define POWERCAP_NAMES (sizeof(names) / sizeof(names[0]))
+
+/*
+ * One zone of a package.
+ */
+typedef struct zone_t {
+	// FD to energy_uj.
+	int32_t energy;
+
+	// FD to max_energy_range_uj.
+	int32_t range;
+
+	// Emulated MSR.
+	int32_t msr;
+
+	// Value at which energy_uj wraps.
+	uint64_t max;
+
+	// Last value of energy_uj.
+	uint64_t last;
+
+	// Energy accumulated since open, modulo
+	// the wrap of the emulated MSR.
+	uint64_t total;
+} zone_t;
+
+/*
+ * All zones of a package. The package zone is the first.
+ */
+typedef struct package_t {
+	zone_t zones[POWERCAP_ZONES];
+	size_t count;
+
+	// Directory of the package zone.
+	char dir[512];
+} package_t;
+
+// Packages, indexed by the FD of their package zone.
+static package_t *packages[POWERCAP_MAXFD];
+
+// Package owning the psys zone, -1 if none.
+static int32_t psysowner = -1;
+
+
+// --------
+
+
+/*
+ * Reads an unsigned number from the start of the given FD.
+ * Returns false if there's no number.
+ *
+ *  - fd: FD to read from.
+ *  - value: Filled with the number.
+ */
+static bool readvalue(int32_t fd, uint64_t *value) {
+	char buf[32];
+	char *end;
+	ssize_t num;
+
+	if ((num = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+		return false;
+	}
+
+	buf[num] = '\0';
+	*value = strtoull(buf, &end, 10);
+
+	return end != buf;
+}
+
+
+/*
+ * Reads an unsigned number from the given file of the
+ * package zone. Returns false if there's no number.
+ *
+ *  - package: Package to read from.
+ *  - name: Name of the file.
+ *  - value: Filled with the number.
+ */
+static bool readattr(const package_t *package, const char *name, uint64_t *value) {
+	char path[600];
+	int32_t fd;
+
+	snprintf(path, sizeof(path), "%s/%s", package->dir, name);
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return false;
+	}
+
+	bool ret = readvalue(fd, value);
+	close(fd);
+
+	return ret;
+}
+
+
+/*
+ * Writes an unsigned number into the given file of
+ * the package zone.
+ *
+ *  - package: Package to write to.
+ *  - name: Name of the file.
+ *  - value: Number to write.
+ */
+static bool writeattr(const package_t *package, const char *name, uint64_t value) {
+	char path[600];
+	char buf[32];
+	int32_t fd;
+
+	snprintf(path, sizeof(path), "%s/%s", package->dir, name);
+
+	if ((fd = open(path, O_WRONLY)) == -1) {
+		return false;
+	}
+
+	int32_t len = snprintf(buf, sizeof(buf), "%" PRIu64 "\n", value);
+	bool ret = write(fd, buf, len) == len;
+	close(fd);
+
+	return ret;
+}
+
+
+/*
+ * Converts a time window in microseconds to the
+ * 2^Y * (1 + F / 4) time units of PKG_LIMIT.
+ *
+ *  - us: Window in microseconds.
+ *  - y: Filled with the exponent.
+ *  - f: Filled with the fraction.
+ */
+static void encodewindow(uint64_t us, uint32_t *y, uint32_t *f) {
+	uint64_t units = us * POWERCAP_TIME_UNIT / 1000000;
+
+	*y = 0;
+	*f = 0;
+
+	while (*y < 31 && (UINT64_C(2) << *y) <= units) {
+		(*y)++;
+	}
+
+	// The largest fraction not above the window.
+	while (*f < 3 && (UINT64_C(1) << *y) * (4 + *f + 1) / 4 <= units) {
+		(*f)++;
+	}
+}
+
+
+/*
+ * Returns the given PKG_LIMIT time window in microseconds.
+ *
+ *  - y: Exponent.
+ *  - f: Fraction.
+ */
+static uint64_t decodewindow(uint32_t y, uint32_t f) {
+	return (UINT64_C(1) << y) * (4 + f) * 1000000 / (4 * POWERCAP_TIME_UNIT);
+}
+
+
+/*
+ * Emulates PKG_LIMIT from the constraints of the package zone.
+ *
+ *  - package: Package to read.
+ *  - data: Filled with the emulated MSR.
+ */
+static bool readlimit(const package_t *package, uint64_t *data) {
+	uint64_t enabled;
+	uint64_t power;
+	uint64_t window;
+	uint32_t y;
+	uint32_t f;
+
+	if (!readattr(package, "enabled", &enabled)
+			|| !readattr(package, "constraint_0_power_limit_uw", &power)
+			|| !readattr(package, "constraint_0_time_window_us", &window)) {
+		errno = ENOENT;
+		return false;
+	}
+
+	pkg_limit_msr_t limit;
+	memset(&limit, 0, sizeof(limit));
+
+	encodewindow(window, &y, &f);
+	limit.power_limit_1 = power * POWERCAP_POWER_UNIT / 1000000;
+	limit.limit_enabled_1 = enabled != 0;
+	limit.clamp_enabled_1 = 1;
+	limit.limit_time_window_y_1 = y;
+	limit.limit_time_window_f_1 = f;
+
+	// Not all packages have a short term constraint.
+	if (readattr(package, "constraint_1_power_limit_uw", &power)) {
+		window = 0;
+		readattr(package, "constraint_1_time_window_us", &window);
+		encodewindow(window, &y, &f);
+
+		limit.power_limit_2 = power * POWERCAP_POWER_UNIT / 1000000;
+		limit.limit_enabled_2 = enabled != 0;
+		limit.clamp_enabled_2 = 1;
+		limit.limit_time_window_y_2 = y;
+		limit.limit_time_window_f_2 = f;
+	}
+
+	memcpy(data, &limit, sizeof(*data));
+
+	return true;
+}
+
+
+/*
+ * Applies an emulated PKG_LIMIT to the constraints of the
+ * package zone. Only fields differing from the current
+ * constraints are written, so writing back what was read
+ * doesn't change anything.
+ *
+ *  - package: Package to write.
+ *  - data: The emulated MSR.
+ */
+static bool writelimit(const package_t *package, uint64_t data) {
+	pkg_limit_msr_t cur;
+	pkg_limit_msr_t limit;
+	uint64_t raw;
+
+	if (!readlimit(package, &raw)) {
+		return false;
+	}
+
+	memcpy(&cur, &raw, sizeof(cur));
+	memcpy(&limit, &data, sizeof(limit));
+
+	if (limit.limit_enabled_1 != cur.limit_enabled_1
+			&& !writeattr(package, "enabled", limit.limit_enabled_1)) {
+		return false;
+	}
+
+	if (limit.power_limit_1 != cur.power_limit_1
+			&& !writeattr(package, "constraint_0_power_limit_uw",
+				(uint64_t)limit.power_limit_1 * 1000000 / POWERCAP_POWER_UNIT)) {
+		return false;
+	}
+
+	if ((limit.limit_time_window_y_1 != cur.limit_time_window_y_1
+				|| limit.limit_time_window_f_1 != cur.limit_time_window_f_1)
+			&& !writeattr(package, "constraint_0_time_window_us",
+				decodewindow(limit.limit_time_window_y_1, limit.limit_time_window_f_1))) {
+		return false;
+	}
+
+	if (limit.power_limit_2 != cur.power_limit_2
+			&& !writeattr(package, "constraint_1_power_limit_uw",
+				(uint64_t)limit.power_limit_2 * 1000000 / POWERCAP_POWER_UNIT)) {
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * Emulates PKG_INFO from the maximum power of the
+ * long term constraint. The minimum isn't known.
+ *
+ *  - package: Package to read.
+ *  - data: Filled with the emulated MSR.
+ */
+static bool readinfo(const package_t *package, uint64_t *data) {
+	uint64_t power;
+
+	if (!readattr(package, "constraint_0_max_power_uw", &power)) {
+		errno = ENOENT;
+		return false;
+	}
+
+	info_msr_t info;
+	memset(&info, 0, sizeof(info));
+
+	info.thermal_spec_power = power * POWERCAP_POWER_UNIT / 1000000;
+	info.maximum_power = info.thermal_spec_power;
+
+	memcpy(data, &info, sizeof(*data));
+
+	return true;
+}
+
+
+/*
+ * Closes all zones of the given package and frees it.
+ *
+ *  - package: Package to destroy.
+ */
+static void destroypackage(package_t *package) {
+	for (size_t i = package->count; i > 0; i--) {
+		close(package->zones[i - 1].range);
+		close(package->zones[i - 1].energy);
+	}
+
+	free(package);
+}
+
+
+/*
+ * Adds the zone in the given directory to the package.
+ * Zones with unknown names are silently ignored, as are
+ * zones which are already part of the package.
+ *
+ *  - package: Package to add the zone to.
+ *  - dir: Directory of the zone.
+ */
+static bool addzone(package_t *package, const char *dir) {
+	char path[512];
+	char name[32];
+	zone_t *zone;
+	ssize_t num;
+	int32_t fd;
+
+	snprintf(path, sizeof(path), "%s/name", dir);
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		return false;
+	}
+
+	num = read(fd, name, sizeof(name) - 1);
+	close(fd);
+
+	if (num <= 0) {
+		return false;
+	}
+
+	name[num] = '\0';
+	name[strcspn(name, "\n")] = '\0';
+
+	// Only names we know, some packages are named package-N.
+	size_t i;
+
+	for (i = 0; i < POWERCAP_NAMES; i++) {
+		if (!strncmp(name, names[i].name, strlen(names[i].name))) {
+			break;
+		}
+	}
+
+	if (i == POWERCAP_NAMES || package->count == POWERCAP_ZONES) {
+		return true;
+	}
+
+	for (size_t j = 0; j < package->count; j++) {
+		if (package->zones[j].msr == names[i].msr) {
+			return true;
+		}
+	}
+
+	zone = &package->zones[package->count];
+	zone->msr = names[i].msr;
+
+	snprintf(path, sizeof(path), "%s/energy_uj", dir);
+
+	if ((zone->energy = open(path, O_RDONLY)) == -1) {
+		return false;
+	}
+
+	snprintf(path, sizeof(path), "%s/max_energy_range_uj", dir);
+
+	if ((zone->range = open(path, O_RDONLY)) == -1) {
+		close(zone->energy);
+		return false;
+	}
+
+	if (!readvalue(zone->range, &zone->max) || !readvalue(zone->energy, &zone->last)) {
+		close(zone->range);
+		close(zone->energy);
+		return false;
+	}
+
+	zone->total = 0;
+	package->count++;
+
+	return true;
+}
+
+
+/*
+ * Samples the given zone, adding the energy consumed
+ * since the last sample to the zones total.
+ *
+ *  - zone: Zone to sample.
+ */
+static bool samplezone(zone_t *zone) {
+	uint64_t cur;
+
+	if (!readvalue(zone->energy, &cur)) {
+		return false;
+	}
+
+	if (cur >= zone->last) {
+		zone->total += cur - zone->last;
+	} else {
+		// The range may change, e.g. after a firmware
+		// update. Only reread it when it's needed.
+		readvalue(zone->range, &zone->max);
+		zone->total += (zone->max - zone->last) + cur;
+	}
+
+	zone->last = cur;
+
+	// Keeps the conversion into energy units from
+	// overflowing on long runs.
+	zone->total %= POWERCAP_ENERGY_WRAP;
+
+	return true;
+}
+
+
+// --------
+
+
+/*
+ * Returns true if the kernel has an intel-rapl powercap zone.
+ */
+static bool powercap_probe(void) {
+	struct stat sb;
+
+	return stat(POWERCAP_ZONE "/energy_uj", &sb) == 0;
+}
+
+
+/*
+ * Discovers all zones of the given package. Returns the
+ * FD of the package zones energy_uj.
+ *
+ *  - device: Directory of the package zone.
+ */
+static int32_t powercap_open(const char *device) {
+	package_t *package;
+	struct dirent *entry;
+	char path[512];
+	DIR *dir;
+
+	if (!(package = calloc(1, sizeof(package_t)))) {
+		return -1;
+	}
+
+	snprintf(package->dir, sizeof(package->dir), "%s", device);
+
+	// The package zone itself.
+	if (!addzone(package, device) || package->count != 1
+			|| package->zones[0].msr != PKG_STATUS) {
+		destroypackage(package);
+		errno = ENODEV;
+
+		return -1;
+	}
+
+	// Subzones are directories named after the
+	// package, e.g. intel-rapl:0:0 in intel-rapl:0.
+	const char *base = strrchr(device, '/');
+	base = base ? base + 1 : device;
+
+	if ((dir = opendir(device))) {
+		while ((entry = readdir(dir))) {
+			if (strncmp(entry->d_name, base, strlen(base)) || entry->d_name[strlen(base)] != ':') {
+				continue;
+			}
+
+			snprintf(path, sizeof(path), "%s/%s", device, entry->d_name);
+			addzone(package, path);
+		}
+
+		closedir(dir);
+	}
+
+	// The platform zone is a sibling of the packages.
+	snprintf(path, sizeof(path), "%s/..", device);
+
+	if (psysowner == -1 && (dir = opendir(path))) {
+		while ((entry = readdir(dir))) {
+			if (entry->d_name[0] == '.' || !strcmp(entry->d_name, base)) {
+				continue;
+			}
+
+			char name[32];
+			int32_t fd;
+			ssize_t num;
+
+			snprintf(path, sizeof(path), "%s/../%s/name", device, entry->d_name);
+
+			if ((fd = open(path, O_RDONLY)) == -1) {
+				continue;
+			}
+
+			num = read(fd, name, sizeof(name) - 1);
+			close(fd);
+
+			if (num > 0 && !strncmp(name, "psys", 4)) {
+				snprintf(path, sizeof(path), "%s/../%s", device, entry->d_name);
+				addzone(package, path);
+			}
+		}
+
+		closedir(dir);
+	}
+
+	if (package->zones[0].energy >= POWERCAP_MAXFD) {
+		destroypackage(package);
+		errno = EMFILE;
+
+		return -1;
+	}
+
+	packages[package->zones[0].energy] = package;
+
+	if (package->zones[package->count - 1].msr == PLATFORM_STATUS) {
+		psysowner = package->zones[0].energy;
+	}
+
+	return package->zones[0].energy;
+}
+
+
+/*
+ * Reads several emulated MSRs.
+ *
+ *  - fd: FD of the package zone.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs content.
+ *  - count: Number of MSRs.
+ */
+static bool powercap_readbatch(int32_t fd, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+	package_t *package = packages[fd];
+
+	for (size_t i = 0; i < count; i++) {
+		if (msrs[i] == UNIT_MULTIPLIER) {
+			data[i] = POWERCAP_UNITS;
+			continue;
+		}
+
+		if (msrs[i] == PKG_LIMIT) {
+			if (!readlimit(package, &data[i])) {
+				return false;
+			}
+
+			continue;
+		}
+
+		if (msrs[i] == PKG_INFO) {
+			if (!readinfo(package, &data[i])) {
+				return false;
+			}
+
+			continue;
+		}
+
+		zone_t *zone = NULL;
+
+		for (size_t j = 0; j < package->count; j++) {
+			if (package->zones[j].msr == msrs[i]) {
+				zone = &package->zones[j];
+				break;
+			}
+		}
+
+		if (!zone) {
+			errno = ENOENT;
+			return false;
+		}
+
+		if (!samplezone(zone)) {
+			return false;
+		}
+
+		// Wraps at 32 bit, just like the real MSRs.
+		data[i] = zone->total * POWERCAP_ENERGY_UNIT / 1000000;
+	}
+
+	return true;
+}
+
+
+/*
+ * Reads one emulated MSR.
+ *
+ *  - fd: FD of the package zone.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool powercap_read(int32_t fd, int32_t msr, uint64_t *data) {
+	return powercap_readbatch(fd, &msr, data, 1);
+}
+
+
+/*
+ * Writes one emulated MSR, only PKG_LIMIT can be written.
+ *
+ *  - fd: FD of the package zone.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+static bool powercap_write(int32_t fd, int32_t msr, uint64_t data) {
+	if (msr != PKG_LIMIT) {
+		errno = EPERM;
+		return false;
+	}
+
+	return writelimit(packages[fd], data);
+}
+
+
+/*
+ * Queries the given CPUID leaf. Just like the Linux
+ * backend we're executing CPUID.
+ *
+ *  - fd: Unused.
+ *  - level: CPUID leaf.
+ *  - level_type: CPUID subleaf.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool powercap_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	return backend_linux.cpuid(fd, level, level_type, data);
+}
+
+
+/*
+ * Closes all zones of the given package.
+ *
+ *  - fd: FD of the package zone.
+ */
+static void powercap_close(int32_t fd) {
+	destroypackage(packages[fd]);
+	packages[fd] = NULL;
+
+	if (psysowner == fd) {
+		psysowner = -1;
+	}
+}
+
+
+/*
+ * Returns the package zone of the given package. The
+ * zones are named after the physical id of the package.
+ *
+ *  - package: Package to look up.
+ *  - device: Filled with the directory of the zone.
+ *  - len: Length of device.
+ *  - cpu: Filled with a CPU of the package.
+ */
+static bool powercap_package(uint32_t package, char *device, size_t len,
+		int32_t *cpu) {
+	char path[256];
+	char name[32];
+	char expected[32];
+	int32_t id;
+
+	if ((*cpu = linux_packagecpu(package, &id)) == -1) {
+		return false;
+	}
+
+	snprintf(expected, sizeof(expected), "package-%i", id);
+
+	for (uint32_t i = 0; i < 2 * MAX_PACKAGES; i++) {
+		int32_t fd;
+		ssize_t num;
+
+		snprintf(path, sizeof(path), "/sys/class/powercap/intel-rapl:%u/name", i);
+
+		if ((fd = open(path, O_RDONLY)) == -1) {
+			continue;
+		}
+
+		num = read(fd, name, sizeof(name) - 1);
+		close(fd);
+
+		if (num <= 0) {
+			continue;
+		}
+
+		name[num] = '\0';
+		name[strcspn(name, "\n")] = '\0';
+
+		if (!strcmp(name, expected)) {
+			snprintf(device, len, "/sys/class/powercap/intel-rapl:%u", i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// --------
+
+
+const backend_t backend_powercap = {
+	.name = "powercap",
+	.device = POWERCAP_ZONE,
+	.emulated = true,
+	.probe = powercap_probe,
+	.open = powercap_open,
+	.read = powercap_read,
+	.readbatch = powercap_readbatch,
+	.write = powercap_write,
+	.cpuid = powercap_cpuid,
+	.close = powercap_close,
+	.package = powercap_package,
+	.opencpu = NULL,
+	.readcpus = NULL,
+	.unit = NULL,
+	.next = NULL
+};
+
+
+// --------
+
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Replay backend. Reads a recording written with --record, see
+ * record.h for the format, and feeds it back sample by sample.
+ * The *_STATUS and throttling MSRs read as the current sample,
+ * the MSRs read only once and the CPUID leafs as recorded.
+ * Everything else reads as nonexistent.
+ *
+ * The device is the recording, optionally followed by '#' and
+ * the package to replay. Without a package number package 0 is
+ * replayed. With --replay all packages are replayed.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../main.h"
+#include "../msr.h"
+#include "../record.h"
+
+
+// --------
+
+
+// Maximum number of open recordings.
+#define REPLAY_MAXFD 256
+
+// Maximum number of MSRs per sample and read only once.
+#define REPLAY_MAXMSRS 64
+
+
+// --------
+
+
+/*
+ * One package of an open recording.
+ */
+typedef struct replay_t {
+	// The recording.
+	FILE *file;
+
+	// Package replayed.
+	uint32_t package;
+
+	// Header of the recording.
+	recordheader_t header;
+
+	// *_STATUS and throttling MSRs of each sample.
+	int32_t msrs[REPLAY_MAXMSRS];
+
+	// Energy unit each of them was recorded in.
+	double units[REPLAY_MAXMSRS];
+
+	// MSRs read only once.
+	recordstatic_t statics[REPLAY_MAXMSRS];
+
+	// Counters of the current sample.
+	uint32_t raw[REPLAY_MAXMSRS];
+} replay_t;
+
+
+// --------
+
+
+// Open recordings, indexed by FD.
+static replay_t *replays[REPLAY_MAXFD];
+
+
+// --------
+
+
+/*
+ * Reads the given data from the recording.
+ *
+ *  - file: Recording to read from.
+ *  - data: Filled with the data.
+ *  - size: Size of data.
+ */
+static bool readrecord(FILE *file, void *data, size_t size) {
+	return fread(data, size, 1, file) == 1;
+}
+
+
+/*
+ * Reads the header of the given recording. Returns false
+ * if it's not a recording or unsupported.
+ *
+ *  - replay: Replay to read into.
+ */
+static bool readheader(replay_t *replay) {
+	recordheader_t *header = &replay->header;
+
+	if (!readrecord(replay->file, header, sizeof(*header))
+			|| header->magic != RECORD_MAGIC
+			|| header->version != RECORD_VERSION
+			|| header->domains > REPLAY_MAXMSRS
+			|| header->statics > REPLAY_MAXMSRS) {
+		errno = EINVAL;
+		return false;
+	}
+
+	if (!readrecord(replay->file, replay->msrs, header->domains * sizeof(int32_t))
+			|| !readrecord(replay->file, replay->units, header->domains * sizeof(double))
+			|| !readrecord(replay->file, replay->statics,
+				header->statics * sizeof(recordstatic_t))) {
+		errno = EINVAL;
+		return false;
+	}
+
+	return true;
+}
+
+
+// --------
+
+
+/*
+ * The replay backend is never selected automatically,
+ * it must be requested with -b or --replay.
+ */
+static bool replay_probe(void) {
+	return false;
+}
+
+
+/*
+ * Opens the given recording.
+ *
+ *  - device: Recording to open, optionally followed
+ *            by '#' and the package number.
+ */
+static int32_t replay_open(const char *device) {
+	replay_t *replay;
+	char path[512];
+
+	snprintf(path, sizeof(path), "%s", device);
+
+	if (!(replay = calloc(1, sizeof(replay_t)))) {
+		return -1;
+	}
+
+	char *package = strrchr(path, '#');
+
+	if (package) {
+		*package++ = '\0';
+		replay->package = strtoul(package, NULL, 10);
+	}
+
+	if (!(replay->file = fopen(path, "rb"))) {
+		free(replay);
+		return -1;
+	}
+
+	int32_t fd = fileno(replay->file);
+
+	if (!readheader(replay) || replay->package >= replay->header.packages
+			|| fd >= REPLAY_MAXFD) {
+		int32_t error = (fd >= REPLAY_MAXFD) ? EMFILE : EINVAL;
+
+		fclose(replay->file);
+		free(replay);
+		errno = error;
+
+		return -1;
+	}
+
+	replays[fd] = replay;
+
+	return fd;
+}
+
+
+/*
+ * Reads the given MSR.
+ *
+ *  - fd: FD to the recording.
+ *  - msr: MSR to read.
+ *  - data: Filled with the MSRs content.
+ */
+static bool replay_read(int32_t fd, int32_t msr, uint64_t *data) {
+	replay_t *replay = replays[fd];
+
+	for (uint32_t i = 0; i < replay->header.domains; i++) {
+		if (replay->msrs[i] == msr) {
+			*data = replay->raw[i];
+			return true;
+		}
+	}
+
+	for (uint32_t i = 0; i < replay->header.statics; i++) {
+		if (replay->statics[i].package == replay->package
+				&& replay->statics[i].msr == msr) {
+			*data = replay->statics[i].value;
+			return true;
+		}
+	}
+
+	errno = ENOENT;
+	return false;
+}
+
+
+/*
+ * Returns the given recorded CPUID leaf.
+ *
+ *  - fd: FD to the recording.
+ *  - level: CPUID leaf.
+ *  - level_type: Unused.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static bool replay_cpuid(int32_t fd, uint32_t level, uint32_t level_type,
+		uint32_t data[4]) {
+	const uint32_t leafs[RECORD_LEAFS] = RECORD_LEAF_LIST;
+	replay_t *replay = replays[fd];
+
+	(void)level_type;
+
+	for (uint32_t i = 0; i < RECORD_LEAFS; i++) {
+		if (leafs[i] == level) {
+			memcpy(data, replay->header.cpuid[i], 4 * sizeof(uint32_t));
+			return true;
+		}
+	}
+
+	errno = ENOENT;
+	return false;
+}
+
+
+/*
+ * Closes the given recording.
+ *
+ *  - fd: FD to close.
+ */
+static void replay_close(int32_t fd) {
+	replay_t *replay = replays[fd];
+
+	fclose(replay->file);
+	free(replay);
+
+	replays[fd] = NULL;
+}
+
+
+/*
+ * Each package of the recording given with --replay is
+ * replayed through it's own FD.
+ *
+ *  - package: Package to return.
+ *  - device: Filled with the device.
+ *  - len: Length of device.
+ *  - cpu: Always -1, there's nothing to pin to.
+ */
+static bool replay_package(uint32_t package, char *device, size_t len,
+		int32_t *cpu) {
+	replay_t replay;
+	bool valid = false;
+
+	if (!options.replay) {
+		return false;
+	}
+
+	memset(&replay, 0, sizeof(replay));
+
+	if ((replay.file = fopen(options.replay, "rb"))) {
+		valid = readheader(&replay);
+		fclose(replay.file);
+	}
+
+	// Package 0 is always tried, so opening
+	// it reports what's wrong.
+	if (package && (!valid || package >= replay.header.packages)) {
+		return false;
+	}
+
+	snprintf(device, len, "%s#%u", options.replay, package);
+	*cpu = -1;
+
+	return true;
+}
+
+
+/*
+ * Returns the unit the given MSR was recorded in.
+ *
+ *  - fd: FD to the recording.
+ *  - msr: *_STATUS MSR.
+ *  - unit: Filled with the unit in joule.
+ */
+static bool replay_unit(int32_t fd, int32_t msr, double *unit) {
+	replay_t *replay = replays[fd];
+
+	for (uint32_t i = 0; i < replay->header.domains; i++) {
+		if (replay->msrs[i] == msr) {
+			*unit = replay->units[i];
+			return true;
+		}
+	}
+
+	errno = ENOENT;
+	return false;
+}
+
+
+/*
+ * Advances to the next sample of the replayed package.
+ * Returns it's wall clock time, the recorded time moved
+ * by the offset in the header.
+ *
+ *  - fd: FD to the recording.
+ */
+static uint64_t replay_next(int32_t fd) {
+	replay_t *replay = replays[fd];
+	recordsample_t sample;
+
+	while (readrecord(replay->file, &sample, sizeof(sample))) {
+		if (sample.package != replay->package) {
+			if (fseek(replay->file, replay->header.domains * sizeof(uint32_t), SEEK_CUR)) {
+				return 0;
+			}
+
+			continue;
+		}
+
+		if (!readrecord(replay->file, replay->raw,
+					replay->header.domains * sizeof(uint32_t))) {
+			return 0;
+		}
+
+		return sample.timestamp + replay->header.realtime;
+	}
+
+	return 0;
+}
+
+
+// --------
+
+
+const backend_t backend_replay = {
+	.name = "replay",
+	.device = NULL,
+	.emulated = false,
+	.probe = replay_probe,
+	.open = replay_open,
+	.read = replay_read,
+	.readbatch = NULL,
+	.write = NULL,
+	.cpuid = replay_cpuid,
+	.close = replay_close,
+	.package = replay_package,
+	.opencpu = NULL,
+	.readcpus = NULL,
+	.unit = replay_unit,
+	.next = replay_next
+};
+
+
+// --------
+
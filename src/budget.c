@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "budget.h"
+#include "limits.h"
+#include "main.h"
+
+
+// --------
+
+
+// Seconds between two reads of PKG_LIMIT. The limits
+// rarely change, no need to read them every update.
+#define BUDGET_REFRESH 10.0
+
+
+// --------
+
+
+/*
+ * Model of one package.
+ */
+typedef struct model_t {
+	// State as returned by getbudget().
+	budget_t budget;
+
+	// The averages are initialized.
+	bool started;
+
+	// PKG_LIMIT was read and can be read.
+	bool read;
+	bool known;
+
+	// Seconds since PKG_LIMIT was read.
+	double age;
+} model_t;
+
+
+// --------
+
+
+// Model of each package.
+static model_t models[MAX_PACKAGES];
+
+
+// --------
+
+
+/*
+ * Advances an exponentially weighted moving average by an
+ * interval of constant power. Exact for any interval, so it
+ * doesn't matter how often we're sampling.
+ *
+ *  - average: Average to advance.
+ *  - power: Power during the interval in watts.
+ *  - seconds: Length of the interval.
+ *  - window: Time constant of the average.
+ */
+static double advance(double average, double power, double seconds,
+		double window) {
+	if (window <= 0) {
+		return power;
+	}
+
+	return power + (average - power) * exp(-seconds / window);
+}
+
+
+// --------
+
+
+/*
+ * Updates the model.
+ */
+void updatebudget(uint32_t package, double power, double seconds) {
+	model_t *model = &models[package];
+	budget_t *budget = &model->budget;
+
+	if (seconds <= 0) {
+		return;
+	}
+
+	if (!model->read || model->age >= BUDGET_REFRESH) {
+		model->known = getpkglimits(package, &budget->limits);
+		model->read = true;
+		model->age = 0;
+	}
+
+	model->age += seconds;
+
+	if (!model->known) {
+		return;
+	}
+
+	const pkglimits_t *limits = &budget->limits;
+
+	// There's no history before the first interval,
+	// assume the package was running at this power.
+	if (!model->started) {
+		budget->average1 = power;
+		budget->average2 = power;
+		model->started = true;
+	} else {
+		budget->average1 = advance(budget->average1, power, seconds, limits->window1);
+		budget->average2 = advance(budget->average2, power, seconds, limits->window2);
+	}
+
+	if (limits->pl1 <= 0) {
+		budget->energy = 0;
+		budget->seconds = -1;
+		return;
+	}
+
+	// Energy above PL1 that brings the average to PL1.
+	budget->energy = (limits->pl1 - budget->average1) * limits->window1;
+
+	if (budget->energy < 0) {
+		budget->energy = 0;
+	}
+
+	// The package can't draw more than PL2.
+	double draw = (limits->pl2 > 0 && power > limits->pl2) ? limits->pl2 : power;
+
+	if (budget->average1 >= limits->pl1) {
+		budget->seconds = 0;
+	} else if (draw <= limits->pl1) {
+		budget->seconds = -1;
+	} else {
+		// Solve pl1 = draw + (average1 - draw) * e^(-t / window1).
+		budget->seconds = limits->window1
+			* log((draw - budget->average1) / (draw - limits->pl1));
+	}
+}
+
+
+/*
+ * Rereads PKG_LIMIT with the next update.
+ */
+void refreshbudget(uint32_t package) {
+	models[package].read = false;
+}
+
+
+/*
+ * Returns the state.
+ */
+bool getbudget(uint32_t package, budget_t *budget) {
+	const model_t *model = &models[package];
+
+	if (!model->known || !model->started || model->budget.limits.pl1 <= 0) {
+		return false;
+	}
+
+	*budget = model->budget;
+
+	return true;
+}
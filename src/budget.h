@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Model of the package power limits. The PMU compares the power
+ * averaged over the time window of each limit with the limit, the
+ * average is an exponentially weighted moving average with the
+ * window as time constant. PL2 caps short bursts, PL1 the long term
+ * power. As long as the PL1 average is below PL1 the package may
+ * draw up to PL2, once it reaches PL1 the frequency is clamped.
+ * The same averages are calculated from the measured package
+ * energy. The distance of the PL1 average to PL1 is the turbo
+ * budget, from the current power follows when it's used up.
+ */
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "limits.h"
+
+
+// --------
+
+
+/*
+ * State of the power limits of one package.
+ */
+typedef struct budget_t {
+	// The limits, reread every few seconds.
+	pkglimits_t limits;
+
+	// Power averaged over the PL1 and PL2 windows in watts.
+	double average1;
+	double average2;
+
+	// Energy that can be spent above PL1 before PL1
+	// clamps, in joule.
+	double energy;
+
+	// Seconds until PL1 clamps if the current power
+	// continues, negative if it never clamps.
+	double seconds;
+} budget_t;
+
+
+// --------
+
+
+/*
+ * Updates the model of the given package with the power
+ * measured over the last interval. The limits are reread
+ * every few seconds, so changes are picked up. Not thread
+ * safe, must be called from the main thread.
+ *
+ *  - package: Package to update.
+ *  - power: Mean package power over the interval in watts.
+ *  - seconds: Length of the interval in seconds.
+ */
+void updatebudget(uint32_t package, double power, double seconds);
+
+
+/*
+ * Makes the next update reread the limits of the given
+ * package, e.g. because they were just changed.
+ *
+ *  - package: Package to refresh.
+ */
+void refreshbudget(uint32_t package);
+
+
+/*
+ * Returns the state of the given package. Returns false
+ * if PL1 is unknown or not enabled.
+ *
+ *  - package: Package to query.
+ *  - budget: Filled with the state.
+ */
+bool getbudget(uint32_t package, budget_t *budget);
+
+
+// --------
+
+#endif // BUDGET_H_
@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "budget.h"
+#include "cap.h"
+#include "domain.h"
+#include "limits.h"
+#include "main.h"
+#include "msr.h"
+
+
+// --------
+
+
+// Proportional, integral and derivative gain. The
+// output is in watts, the error in watts too.
+#define CAP_KP 0.5
+#define CAP_KI 0.3
+#define CAP_KD 0.05
+
+// PL1 stays within this fraction of the target, so a long
+// phase below the target doesn't open the limit up.
+#define CAP_BAND 0.25
+
+// Errors below this fraction of the target are noise.
+#define CAP_DEADBAND 0.05
+
+
+// --------
+
+
+/*
+ * Controller of one package.
+ */
+typedef struct controller_t {
+	// PKG_LIMIT before we started.
+	uint64_t original;
+
+	// PKG_LIMIT as last written.
+	uint64_t current;
+
+	// Share of the target in watts.
+	double target;
+
+	// Range PL1 is kept in, in watts. The band around
+	// the target, within the range of PKG_INFO.
+	double minimum;
+	double maximum;
+
+	// Largest integrated error in watt seconds.
+	double windup;
+
+	// Watts per PKG_LIMIT unit.
+	double unit;
+
+	// Integrated error in watt seconds.
+	double integral;
+
+	// Error of the last step, NAN before the first.
+	double error;
+
+	// PL1 currently set in watts.
+	double limit;
+} controller_t;
+
+
+// --------
+
+
+// Controller of each package.
+static controller_t controllers[MAX_PACKAGES];
+
+// Number of packages under control, 0 if closed.
+static uint32_t count;
+
+
+// --------
+
+
+/*
+ * Sets PL1 of the given package. The limit is enabled and
+ * allowed to clamp below the requested frequency, everything
+ * else is kept. Returns false if the write failed.
+ *
+ *  - package: Package to set.
+ *  - watts: New PL1.
+ */
+static bool setlimit(uint32_t package, double watts) {
+	controller_t *ctrl = &controllers[package];
+	uint64_t raw;
+	pkg_limit_msr_t limit;
+	double units = round(watts / ctrl->unit);
+
+	if (units > 0x7fff) {
+		units = 0x7fff;
+	}
+
+	memcpy(&limit, &ctrl->current, sizeof(limit));
+	limit.power_limit_1 = (uint64_t)units;
+	limit.limit_enabled_1 = 1;
+	limit.clamp_enabled_1 = 1;
+	memcpy(&raw, &limit, sizeof(raw));
+
+	ctrl->limit = units * ctrl->unit;
+
+	// Unchanged limits aren't written again.
+	if (raw == ctrl->current) {
+		return true;
+	}
+
+	if (!setmsr(package, PKG_LIMIT, raw)) {
+		return false;
+	}
+
+	ctrl->current = raw;
+	refreshbudget(package);
+
+	return true;
+}
+
+
+// --------
+
+
+/*
+ * Saves the limits and sets the initial PL1.
+ */
+void opencap(double watts) {
+	int32_t msrs[2] = { UNIT_MULTIPLIER, PKG_LIMIT };
+
+	if (!checkmsr(PKG_LIMIT)) {
+		exit_error(1, "%s\n", "ERROR: The backend doesn't know PKG_LIMIT");
+	}
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		controller_t *ctrl = &controllers[p];
+		powerlimits_t info;
+		uint64_t data[2];
+
+		getmsrs(p, msrs, data, 2);
+		getpowerlimits(p, &info);
+
+		unit_msr_t units;
+		pkg_limit_msr_t limit;
+
+		memcpy(&units, &data[0], sizeof(units));
+		memcpy(&limit, &data[1], sizeof(limit));
+
+		if (limit.lock_enabled) {
+			exit_error(1, "ERROR: PKG_LIMIT of package %u is locked\n", p);
+		}
+
+		memset(ctrl, 0, sizeof(*ctrl));
+		ctrl->original = data[1];
+		ctrl->current = data[1];
+		ctrl->target = watts / options.packages;
+		ctrl->unit = 1.0 / (double)B2POW(units.power);
+		ctrl->error = NAN;
+
+		// Without a minimum at least one unit, without
+		// a maximum whatever fits into PKG_LIMIT.
+		double minimum = info.minimum_power > 0 ? info.minimum_power : ctrl->unit;
+		double maximum = info.maximum_power > 0 ? info.maximum_power
+			: (info.thermal_spec_power > 0 ? info.thermal_spec_power : 0x7fff * ctrl->unit);
+
+		if (ctrl->target < minimum || ctrl->target > maximum) {
+			fprintf(stderr, "Package %u can't be capped to %.2fW, using %.2fW to %.2fW\n",
+					p, ctrl->target, minimum, maximum);
+		}
+
+		ctrl->minimum = fmin(fmax(ctrl->target * (1 - CAP_BAND), minimum), maximum);
+		ctrl->maximum = fmin(fmax(ctrl->target * (1 + CAP_BAND), minimum), maximum);
+		ctrl->windup = CAP_BAND * ctrl->target / CAP_KI;
+
+		count = p + 1;
+
+		if (!setlimit(p, fmin(fmax(ctrl->target, ctrl->minimum), ctrl->maximum))) {
+			exit_error(1, "ERROR: Couldn't write PKG_LIMIT of package %u: %s\n", p, strerror(errno));
+		}
+	}
+}
+
+
+/*
+ * Runs one step.
+ */
+void updatecap(uint32_t package, double power, double seconds) {
+	if (package >= count || seconds <= 0) {
+		return;
+	}
+
+	controller_t *ctrl = &controllers[package];
+	double error = ctrl->target - power;
+	double derivative = isnan(ctrl->error) ? 0 : (error - ctrl->error) / seconds;
+
+	// Crossing the target by more than the noise means the
+	// load changed, what was integrated before is obsolete.
+	if (error * ctrl->error < 0 && fabs(error) > CAP_DEADBAND * ctrl->target) {
+		ctrl->integral = 0;
+	}
+
+	// The integral term alone stays within the band.
+	double integral = fmin(fmax(ctrl->integral + error * seconds, -ctrl->windup),
+			ctrl->windup);
+
+	double output = ctrl->target + CAP_KP * error + CAP_KI * integral
+		+ CAP_KD * derivative;
+
+	// No windup while the output is saturated and
+	// the error pushes it further out.
+	if ((output > ctrl->maximum && error > 0) || (output < ctrl->minimum && error < 0)) {
+		integral = ctrl->integral;
+		output = ctrl->target + CAP_KP * error + CAP_KI * integral
+			+ CAP_KD * derivative;
+	}
+
+	ctrl->integral = integral;
+	ctrl->error = error;
+
+	if (!setlimit(package, fmin(fmax(output, ctrl->minimum), ctrl->maximum))) {
+		exit_error(1, "ERROR: Couldn't write PKG_LIMIT of package %u: %s\n",
+				package, strerror(errno));
+	}
+}
+
+
+/*
+ * Returns the current PL1.
+ */
+double getcap(uint32_t package) {
+	return package < count ? controllers[package].limit : 0;
+}
+
+
+/*
+ * Restores the limits. Called at exit, it must
+ * work on partially opened controllers.
+ */
+void closecap(void) {
+	uint32_t packages = count;
+
+	// exit_error() below ends up here again.
+	count = 0;
+
+	for (uint32_t p = 0; p < packages; p++) {
+		if (controllers[p].current == controllers[p].original) {
+			continue;
+		}
+
+		if (!setmsr(p, PKG_LIMIT, controllers[p].original)) {
+			fprintf(stderr, "ERROR: Couldn't restore PKG_LIMIT of package %u: %s\n",
+					p, strerror(errno));
+		}
+	}
+}
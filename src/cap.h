@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+
+/*
+ * Software power capping. A PID controller per package compares
+ * the measured package power with it's share of the target and
+ * moves PL1 in PKG_LIMIT until they match. The target is the
+ * feed forward, the controller only corrects for the difference
+ * between the limit and what's actually drawn, e.g. because the
+ * PMU's estimate is off. PL1 is kept within a band around the
+ * target and within the minimum and maximum power from PKG_INFO.
+ * PL2 isn't touched, bursts up to it remain possible. Locked
+ * limits are left alone, the original limits are restored when
+ * the controller is closed.
+ */
+
+#ifndef CAP_H_
+#define CAP_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+
+// --------
+
+
+/*
+ * Saves the current PKG_LIMIT of all packages and sets PL1
+ * to the share of each package of the target. Aborts the
+ * program if a limit is locked or can't be written.
+ *
+ *  - watts: Package power of the whole machine to cap to.
+ */
+void opencap(double watts);
+
+
+/*
+ * Runs one step of the controller of the given package.
+ * Not thread safe, must be called from the main thread.
+ *
+ *  - package: Package to control.
+ *  - power: Package power since the last step in watts.
+ *  - seconds: Time since the last step.
+ */
+void updatecap(uint32_t package, double power, double seconds);
+
+
+/*
+ * Returns the PL1 currently set for the given package in
+ * watts, 0 if the controller isn't running.
+ *
+ *  - package: Package to query.
+ */
+double getcap(uint32_t package);
+
+
+/*
+ * Restores the original PKG_LIMIT of all packages.
+ */
+void closecap(void);
+
+
+// --------
+
+#endif // CAP_H_
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "cgroups.h"
+#include "main.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Slots in the index of the cgroup table, a power of 2.
+// At most half of them are used to keep the probes short.
+#define CGROUPS_SLOTS 65536
+
+// Maximum number of cgroups, including removed ones.
+#define CGROUPS_MAX (CGROUPS_SLOTS / 2)
+
+// Deepest level walked below the root.
+#define CGROUPS_DEPTH 32
+
+// Time the counters of a removed cgroup are kept
+// in nanoseconds.
+#define CGROUPS_EXPIRE (3600ULL * 1000 * 1000 * 1000)
+
+
+// --------
+
+
+// The cgroups, without holes. Only as much as used
+// is backed by memory.
+static cgroup_t *cgroups;
+
+// Number of cgroups.
+static uint32_t used;
+
+// Index into cgroups, open addressing with linear probing.
+// Each slot holds the index + 1, 0 for a free slot.
+static uint32_t *slots;
+
+// Number of the current scan.
+static uint32_t generation;
+
+// Root of the subtree.
+static const char *rootdir;
+
+// File with the CPU usage that worked last, either
+// cpu.stat for cgroup v2 or cpuacct.usage for v1.
+static const char *usagefile = "cpu.stat";
+
+// /proc/stat, kept open.
+static int32_t statfd = -1;
+
+// Nanoseconds per clock tick.
+static uint64_t ticklength;
+
+// CPU time used by the whole system in nanoseconds,
+// as read by the last scan and during the last interval.
+static uint64_t busy;
+static uint64_t busydelta;
+
+
+// --------
+
+
+/*
+ * Returns the home slot of a path, FNV-1a.
+ *
+ *  - path: Path of the cgroup.
+ */
+static uint32_t hashpath(const char *path) {
+	uint32_t hash = 2166136261u;
+
+	for (const char *c = path; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	}
+
+	return hash & (CGROUPS_SLOTS - 1);
+}
+
+
+/*
+ * Returns the slot of a path. If it's not in the
+ * index, the free slot ending the probe sequence.
+ *
+ *  - path: Path of the cgroup.
+ */
+static uint32_t findslot(const char *path) {
+	uint32_t slot = hashpath(path);
+
+	while (slots[slot] && strcmp(cgroups[slots[slot] - 1].path, path)) {
+		slot = (slot + 1) & (CGROUPS_SLOTS - 1);
+	}
+
+	return slot;
+}
+
+
+/*
+ * Returns a cgroup, adding it if it's not in the
+ * table. Returns NULL if the table is full.
+ *
+ *  - path: Path of the cgroup.
+ *  - added: Set to 1 if the cgroup was added.
+ */
+static cgroup_t *findcgroup(const char *path, uint32_t *added) {
+	uint32_t slot = findslot(path);
+
+	*added = 0;
+
+	if (slots[slot]) {
+		return &cgroups[slots[slot] - 1];
+	}
+
+	if (used >= CGROUPS_MAX) {
+		return NULL;
+	}
+
+	cgroup_t *cgroup = &cgroups[used];
+
+	memset(cgroup, 0, sizeof(cgroup_t));
+	snprintf(cgroup->path, sizeof(cgroup->path), "%s", path);
+	slots[slot] = ++used;
+	*added = 1;
+
+	return cgroup;
+}
+
+
+/*
+ * Removes a cgroup. The following slots of the probe
+ * sequence are shifted back, so no tombstones are needed.
+ * The last cgroup is moved into the gap.
+ *
+ *  - index: Index of the cgroup.
+ */
+static void removecgroup(uint32_t index) {
+	uint32_t hole = findslot(cgroups[index].path);
+	uint32_t slot = hole;
+
+	for (;;) {
+		slot = (slot + 1) & (CGROUPS_SLOTS - 1);
+
+		if (!slots[slot]) {
+			break;
+		}
+
+		// Entries whose home is cyclically in (hole, slot]
+		// are reachable without the hole and stay.
+		uint32_t home = hashpath(cgroups[slots[slot] - 1].path);
+
+		if (((slot - home) & (CGROUPS_SLOTS - 1)) < ((slot - hole) & (CGROUPS_SLOTS - 1))) {
+			continue;
+		}
+
+		slots[hole] = slots[slot];
+		hole = slot;
+	}
+
+	slots[hole] = 0;
+	used--;
+
+	if (index != used) {
+		cgroups[index] = cgroups[used];
+		slots[findslot(cgroups[index].path)] = index + 1;
+	}
+}
+
+
+/*
+ * Reads a small file of a cgroup. Returns false if
+ * it doesn't exist or can't be read.
+ *
+ *  - parent: Directory of the cgroup's parent.
+ *  - name: Name of the cgroup.
+ *  - file: Name of the file.
+ *  - buf: Filled with the contents, 0 terminated.
+ *  - size: Size of buf.
+ */
+static bool readfile(int32_t parent, const char *name, const char *file,
+		char *buf, size_t size) {
+	char path[CGROUP_PATH + 32];
+	int32_t fd;
+	ssize_t len;
+
+	snprintf(path, sizeof(path), "%s/%s", name, file);
+
+	if ((fd = openat(parent, path, O_RDONLY | O_CLOEXEC)) == -1) {
+		return false;
+	}
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+
+	if (len <= 0) {
+		return false;
+	}
+
+	buf[len] = '\0';
+
+	return true;
+}
+
+
+/*
+ * Reads the CPU usage of a cgroup and it's children.
+ * cgroup v2 has it in cpu.stat, v1 in cpuacct.usage.
+ * The file that worked last is tried first. Returns
+ * false if the directory isn't a cgroup.
+ *
+ *  - parent: Directory of the cgroup's parent.
+ *  - name: Name of the cgroup.
+ *  - usage: Filled with the usage in nanoseconds.
+ */
+static bool readusage(int32_t parent, const char *name, uint64_t *usage) {
+	char buf[512];
+
+	for (uint32_t i = 0; i < 2; i++) {
+		if (readfile(parent, name, usagefile, buf, sizeof(buf))) {
+			char *field = strstr(buf, "usage_usec ");
+
+			if (field) {
+				*usage = strtoull(field + strlen("usage_usec "), NULL, 10) * 1000;
+				return true;
+			} else if (!strcmp(usagefile, "cpuacct.usage")) {
+				*usage = strtoull(buf, NULL, 10);
+				return true;
+			}
+		}
+
+		usagefile = strcmp(usagefile, "cpu.stat") ? "cpu.stat" : "cpuacct.usage";
+	}
+
+	return false;
+}
+
+
+/*
+ * Reads the CPU time used by the whole system from
+ * the first line of /proc/stat. Idle and iowait time
+ * is left out, steal time wasn't used by this system.
+ */
+static uint64_t readbusy(void) {
+	char buf[256];
+	ssize_t len = pread(statfd, buf, sizeof(buf) - 1, 0);
+
+	if (len <= 0) {
+		return busy;
+	}
+
+	buf[len] = '\0';
+
+	// cpu user nice system idle iowait irq softirq
+	uint64_t ticks[7] = { 0 };
+	char *field = buf + strlen("cpu");
+
+	for (uint32_t i = 0; i < 7; i++) {
+		ticks[i] = strtoull(field, &field, 10);
+	}
+
+	return (ticks[0] + ticks[1] + ticks[2] + ticks[5] + ticks[6]) * ticklength;
+}
+
+
+/*
+ * Updates a cgroup and walks it's children. Returns the CPU
+ * time the cgroup and it's children used since the last scan.
+ *
+ *  - parent: Directory of the cgroup's parent.
+ *  - name: Name of the cgroup.
+ *  - path: Path of the cgroup, children are appended.
+ *  - len: Length of the path.
+ *  - depth: Level below the root.
+ */
+static uint64_t walk(int32_t parent, const char *name, char *path, size_t len, uint32_t depth) {
+	struct stat st;
+	uint64_t usage;
+	uint32_t added;
+	cgroup_t *cgroup;
+
+	if (fstatat(parent, name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISDIR(st.st_mode)
+			|| !readusage(parent, name, &usage)
+			|| !(cgroup = findcgroup(len ? path : "/", &added))) {
+		return 0;
+	}
+
+	// New, recreated or counter reset. Everything was
+	// used since the last scan, except in the first.
+	uint64_t delta;
+
+	if (added || cgroup->removed || usage < cgroup->usage) {
+		delta = (generation > 1) ? usage : 0;
+	} else {
+		delta = usage - cgroup->usage;
+	}
+
+	cgroup->usage = usage;
+	cgroup->generation = generation;
+	cgroup->removed = 0;
+	cgroup->delta = delta;
+
+	// Directories without subdirectories have a link
+	// count of 2, on the cgroup filesystem as well. Most
+	// cgroups are leafs and aren't opened at all. Some
+	// filesystems always report 1 for directories.
+	if (st.st_nlink == 2 || depth >= CGROUPS_DEPTH) {
+		return delta;
+	}
+
+	int32_t fd;
+	DIR *dir;
+
+	if ((fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		return delta;
+	}
+
+	if (!(dir = fdopendir(fd))) {
+		close(fd);
+		return delta;
+	}
+
+	// The usage includes the children. Their part is
+	// subtracted, so that each cgroup gets it's own.
+	uint64_t children = 0;
+	struct dirent *entry;
+
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)) {
+			continue;
+		}
+
+		// Too long names are skipped, names that can't be
+		// written into JSON without escaping as well.
+		size_t namelen = strlen(entry->d_name);
+
+		if (len + namelen + 2 > CGROUP_PATH || strpbrk(entry->d_name, "\"\\")) {
+			continue;
+		}
+
+		path[len] = '/';
+		memcpy(path + len + 1, entry->d_name, namelen + 1);
+
+		children += walk(dirfd(dir), entry->d_name, path, len + 1 + namelen, depth + 1);
+
+		path[len] = '\0';
+	}
+
+	closedir(dir);
+
+	cgroup->delta = (delta > children) ? delta - children : 0;
+
+	return delta;
+}
+
+
+// --------
+
+
+/*
+ * Allocates the cgroup table.
+ */
+void opencgroups(const char *root) {
+	struct stat st;
+
+	if (stat(root, &st) == -1 || !S_ISDIR(st.st_mode) || strlen(root) >= CGROUP_PATH) {
+		exit_error(1, "ERROR: Couldn't open cgroup %s\n", root);
+	}
+
+	// calloc()ed memory is mapped lazily, only the
+	// cgroups ever used are backed by memory.
+	if (!(cgroups = calloc(CGROUPS_MAX, sizeof(cgroup_t)))
+			|| !(slots = calloc(CGROUPS_SLOTS, sizeof(uint32_t)))) {
+		exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+	}
+
+	if ((statfd = open("/proc/stat", O_RDONLY | O_CLOEXEC)) == -1) {
+		exit_error(1, "ERROR: Couldn't open /proc/stat: %s\n", strerror(errno));
+	}
+
+	rootdir = root;
+	ticklength = 1000000000 / sysconf(_SC_CLK_TCK);
+}
+
+
+/*
+ * Walks the subtree.
+ */
+uint32_t scancgroups(void) {
+	char path[CGROUP_PATH] = "";
+	uint32_t present = 0;
+
+	generation++;
+	walk(AT_FDCWD, rootdir, path, 0, 0);
+
+	uint64_t cur = readbusy();
+
+	busydelta = (generation > 1 && cur > busy) ? cur - busy : 0;
+	busy = cur;
+
+	// Expired counters of removed cgroups are dropped.
+	// The last cgroup is moved into the gap and checked
+	// next.
+	uint64_t now = gettime();
+
+	for (uint32_t i = 0; i < used;) {
+		if (cgroups[i].removed && now - cgroups[i].removed > CGROUPS_EXPIRE) {
+			removecgroup(i);
+		} else {
+			i++;
+		}
+	}
+
+	// Cgroups not seen in this scan were removed,
+	// they're reported once and then kept silent.
+	for (uint32_t i = 0; i < used; i++) {
+		cgroup_t *cgroup = &cgroups[i];
+
+		if (cgroup->generation == generation) {
+			cgroup->changed = false;
+			present++;
+		} else {
+			cgroup->changed = !cgroup->removed;
+			cgroup->delta = 0;
+
+			if (!cgroup->removed) {
+				cgroup->removed = now;
+			}
+		}
+	}
+
+	return present;
+}
+
+
+/*
+ * Splits the energy between the cgroups.
+ */
+void attributecgroups(double pkg, double pp0) {
+	uint64_t total = 0;
+
+	for (uint32_t i = 0; i < used; i++) {
+		total += cgroups[i].delta;
+	}
+
+	// /proc/stat counts in ticks, the cgroups in
+	// nanoseconds. Never hand out more than all.
+	if (busydelta > total) {
+		total = busydelta;
+	}
+
+	for (uint32_t i = 0; i < used; i++) {
+		cgroup_t *cgroup = &cgroups[i];
+
+		if (!cgroup->delta) {
+			continue;
+		}
+
+		double share = (double)cgroup->delta / total;
+
+		cgroup->cputime += cgroup->delta;
+		cgroup->pkg_energy += pkg * share;
+		cgroup->pp0_energy += pp0 * share;
+		cgroup->changed = true;
+	}
+}
+
+
+/*
+ * Returns the next changed cgroup.
+ */
+const cgroup_t *nextcgroup(uint32_t *iter) {
+	while (*iter < used) {
+		const cgroup_t *cgroup = &cgroups[(*iter)++];
+
+		if (cgroup->changed) {
+			return cgroup;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Looks up a cgroup.
+ */
+const cgroup_t *getcgroup(const char *path) {
+	uint32_t slot = findslot(path);
+
+	return slots[slot] ? &cgroups[slots[slot] - 1] : NULL;
+}
+
+
+/*
+ * Frees everything.
+ */
+void closecgroups(void) {
+	if (!cgroups) {
+		return;
+	}
+
+	close(statfd);
+	statfd = -1;
+
+	free(cgroups);
+	free(slots);
+	cgroups = NULL;
+	slots = NULL;
+	used = 0;
+}
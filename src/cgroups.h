@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef CGROUPS_H_
+#define CGROUPS_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------
+
+
+// Longest path of a cgroup below the root,
+// including the terminating 0.
+#define CGROUP_PATH 256
+
+
+/*
+ * A cgroup, as tracked by scancgroups().
+ */
+typedef struct cgroup_t {
+	// Path relative to the root given to opencgroups(),
+	// "/" for the root itself.
+	char path[CGROUP_PATH];
+
+	// Number of the last scan the cgroup was seen in.
+	uint32_t generation;
+
+	// Set if the counters changed or the cgroup was
+	// removed during the last interval.
+	bool changed;
+
+	// CPU usage of the cgroup and all it's children
+	// in nanoseconds, as read by the last scan.
+	uint64_t usage;
+
+	// CPU time used by the cgroup itself, without it's
+	// children, during the last interval and in total.
+	uint64_t delta;
+	uint64_t cputime;
+
+	// Share of the package and x86 cores energy
+	// since the cgroup was first seen in joule.
+	double pkg_energy;
+	double pp0_energy;
+
+	// Time the cgroup was removed, 0 while it exists.
+	uint64_t removed;
+} cgroup_t;
+
+
+// --------
+
+
+/*
+ * Allocates the cgroup table. Aborts the program on error.
+ *
+ *  - root: Directory of the cgroup subtree.
+ */
+void opencgroups(const char *root);
+
+
+/*
+ * Walks the subtree and updates the CPU usage of all cgroups.
+ * The counters of removed cgroups are kept for a while, a cgroup
+ * recreated under the same path continues counting. Returns the
+ * number of cgroups.
+ */
+uint32_t scancgroups(void);
+
+
+/*
+ * Splits the energy consumed during the last interval between
+ * the cgroups, in proportion to their share of the CPU time used
+ * by the whole system. Energy of idle CPUs and of work outside
+ * the subtree isn't attributed.
+ *
+ *  - pkg: Package energy in joule.
+ *  - pp0: x86 cores energy in joule.
+ */
+void attributecgroups(double pkg, double pp0);
+
+
+/*
+ * Returns the next cgroup which changed during the last
+ * interval, NULL after the last one.
+ *
+ *  - iter: Position, set to 0 before the first call.
+ */
+const cgroup_t *nextcgroup(uint32_t *iter);
+
+
+/*
+ * Returns a cgroup, NULL if it's unknown.
+ *
+ *  - path: Path of the cgroup.
+ */
+const cgroup_t *getcgroup(const char *path);
+
+
+/*
+ * Frees the cgroup table.
+ */
+void closecgroups(void);
+
+
+// --------
+
+#endif // CGROUPS_H_
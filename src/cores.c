@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cores.h"
+#include "main.h"
+#include "msr.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// C-state residency MSRs.
+#define PC2_RESIDENCY  0x60d
+#define PC3_RESIDENCY  0x3f8
+#define PC6_RESIDENCY  0x3f9
+#define PC7_RESIDENCY  0x3fa
+#define PC8_RESIDENCY  0x630
+#define PC9_RESIDENCY  0x631
+#define PC10_RESIDENCY 0x632
+#define CC3_RESIDENCY  0x3fc
+#define CC6_RESIDENCY  0x3fd
+#define CC7_RESIDENCY  0x3fe
+
+// MSRs read from each CPU before the C-states.
+#define CORE_TSC   0
+#define CORE_MPERF 1
+#define CORE_APERF 2
+#define CORE_MSRS  3
+
+// Maximum number of MSRs read per update.
+#define CORE_READS (MAX_CPUS * (CORE_MSRS + CSTATES))
+
+
+// --------
+
+
+cstate_t cstates[CSTATES] = {
+	[CSTATE_PC2]  = { "PC2",  PC2_RESIDENCY,  true,  false },
+	[CSTATE_PC3]  = { "PC3",  PC3_RESIDENCY,  true,  false },
+	[CSTATE_PC6]  = { "PC6",  PC6_RESIDENCY,  true,  false },
+	[CSTATE_PC7]  = { "PC7",  PC7_RESIDENCY,  true,  false },
+	[CSTATE_PC8]  = { "PC8",  PC8_RESIDENCY,  true,  false },
+	[CSTATE_PC9]  = { "PC9",  PC9_RESIDENCY,  true,  false },
+	[CSTATE_PC10] = { "PC10", PC10_RESIDENCY, true,  false },
+	[CSTATE_CC3]  = { "CC3",  CC3_RESIDENCY,  false, false },
+	[CSTATE_CC6]  = { "CC6",  CC6_RESIDENCY,  false, false },
+	[CSTATE_CC7]  = { "CC7",  CC7_RESIDENCY,  false, false }
+};
+
+
+// --------
+
+
+// The CPUs and their devices.
+static core_t cores[MAX_CPUS];
+static int32_t cpufds[MAX_CPUS];
+static uint32_t count;
+
+// All MSRs read per update and the device of each. Each
+// CPU has CORE_MSRS followed by the present core C-states,
+// the first CPU of a package then the package C-states.
+static int32_t fds[CORE_READS];
+static int32_t msrs[CORE_READS];
+static uint32_t reads;
+
+// Index of the first MSR of each CPU and of the
+// package C-states of each package in reads.
+static uint32_t coreread[MAX_CPUS];
+static uint32_t packageread[MAX_PACKAGES];
+
+// CPU the package C-states are read from.
+static uint32_t packagecore[MAX_PACKAGES];
+
+// Package residency during the last interval.
+static double packageresidency[MAX_PACKAGES][CSTATES];
+
+// Data of all reads by the last update and
+// the one before.
+static uint64_t data[2][CORE_READS];
+
+// Index of the last update into data,
+// time of it, and number of updates.
+static uint32_t last;
+static uint64_t lasttime;
+static uint64_t updates;
+
+
+// --------
+
+
+/*
+ * Appends a read to the list.
+ *
+ *  - fd: Device of the CPU.
+ *  - msr: MSR to read.
+ */
+static void addread(int32_t fd, int32_t msr) {
+	fds[reads] = fd;
+	msrs[reads] = msr;
+	reads++;
+}
+
+
+// --------
+
+
+/*
+ * Opens the MSRs of all CPUs.
+ */
+uint32_t opencores(void) {
+	for (uint32_t p = 0; p < options.packages && count < MAX_CPUS; p++) {
+		int32_t cpus[MAX_CPUS];
+		uint32_t n = opencpus(p, cpufds + count, cpus, MAX_CPUS - count);
+
+		for (uint32_t i = 0; i < n; i++) {
+			cores[count + i].cpu = cpus[i];
+			cores[count + i].package = p;
+		}
+
+		count += n;
+	}
+
+	// Without APERF and MPERF, for example in
+	// virtual machines, there's nothing to show.
+	static const int32_t required[CORE_MSRS] = { TSC_COUNTER, MPERF_COUNTER, APERF_COUNTER };
+	int32_t probefds[CORE_MSRS] = { cpufds[0], cpufds[0], cpufds[0] };
+	uint64_t probe[CORE_MSRS];
+
+	if (!count || !getcpumsrs(probefds, required, probe, CORE_MSRS)) {
+		closecores();
+		return 0;
+	}
+
+	// Which C-states are present depends on the model.
+	for (uint32_t i = 0; i < CSTATES; i++) {
+		cstates[i].present = checkmsr(cstates[i].msr);
+	}
+
+	for (uint32_t c = 0; c < count; c++) {
+		uint32_t p = cores[c].package;
+
+		coreread[c] = reads;
+
+		for (uint32_t i = 0; i < CORE_MSRS; i++) {
+			addread(cpufds[c], required[i]);
+		}
+
+		for (uint32_t i = 0; i < CSTATES; i++) {
+			if (cstates[i].present && !cstates[i].package) {
+				addread(cpufds[c], cstates[i].msr);
+			}
+		}
+
+		if (c == 0 || cores[c - 1].package != p) {
+			packagecore[p] = c;
+			packageread[p] = reads;
+
+			for (uint32_t i = 0; i < CSTATES; i++) {
+				if (cstates[i].present && cstates[i].package) {
+					addread(cpufds[c], cstates[i].msr);
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
+
+/*
+ * Reads all CPUs.
+ */
+void updatecores(void) {
+	uint32_t cur = last ^ 1;
+
+	if (!count) {
+		return;
+	}
+
+	if (!getcpumsrs(fds, msrs, data[cur], reads)) {
+		exit_error(1, "ERROR: Couldn't read the MSRs of the CPUs: %s\n", strerror(errno));
+	}
+
+	uint64_t now = gettime();
+	double seconds = (now - lasttime) / 1000000000.0;
+
+	// The first update is the baseline. The counters
+	// are 64 bit wide, a wraparound takes years.
+	if (updates > 0 && seconds > 0) {
+		for (uint32_t c = 0; c < count; c++) {
+			const uint64_t *prev = &data[last][coreread[c]];
+			const uint64_t *next = &data[cur][coreread[c]];
+
+			uint64_t tsc = next[CORE_TSC] - prev[CORE_TSC];
+			uint64_t mperf = next[CORE_MPERF] - prev[CORE_MPERF];
+			uint64_t aperf = next[CORE_APERF] - prev[CORE_APERF];
+
+			// MPERF counts at the TSC rate, so APERF / MPERF
+			// scales the TSC rate to the actual frequency.
+			cores[c].frequency = mperf ? (tsc / seconds) * ((double)aperf / mperf) / 1000000.0 : 0;
+			cores[c].utilization = tsc ? 100.0 * mperf / tsc : 0;
+
+			if (cores[c].utilization > 100) {
+				cores[c].utilization = 100;
+			}
+
+			// The residency counters count at the TSC rate too.
+			for (uint32_t i = 0, r = CORE_MSRS; i < CSTATES; i++) {
+				if (cstates[i].present && !cstates[i].package) {
+					cores[c].residency[i] = tsc ? 100.0 * (next[r] - prev[r]) / tsc : 0;
+					r++;
+				}
+			}
+		}
+
+		for (uint32_t p = 0; p < options.packages; p++) {
+			uint32_t c = packagecore[p];
+			uint64_t tsc = data[cur][coreread[c] + CORE_TSC] - data[last][coreread[c] + CORE_TSC];
+
+			for (uint32_t i = 0, r = packageread[p]; i < CSTATES; i++) {
+				if (cstates[i].present && cstates[i].package) {
+					packageresidency[p][i] = tsc ? 100.0 * (data[cur][r] - data[last][r]) / tsc : 0;
+					r++;
+				}
+			}
+		}
+	}
+
+	last = cur;
+	lasttime = now;
+	updates++;
+}
+
+
+/*
+ * Returns the residency of a package.
+ */
+void getresidency(uint32_t package, double residency[CSTATES]) {
+	uint32_t cpus = 0;
+
+	memcpy(residency, packageresidency[package], sizeof(double) * CSTATES);
+
+	for (uint32_t c = 0; c < count; c++) {
+		if (cores[c].package != package) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < CSTATES; i++) {
+			if (!cstates[i].package) {
+				residency[i] += cores[c].residency[i];
+			}
+		}
+
+		cpus++;
+	}
+
+	for (uint32_t i = 0; i < CSTATES && cpus; i++) {
+		if (!cstates[i].package) {
+			residency[i] /= cpus;
+		}
+	}
+}
+
+
+/*
+ * Returns all CPUs.
+ */
+uint32_t getcores(const core_t **list) {
+	*list = cores;
+
+	return count;
+}
+
+
+/*
+ * Closes all CPUs.
+ */
+void closecores(void) {
+	closecpus(cpufds, count);
+
+	count = 0;
+	reads = 0;
+	updates = 0;
+}
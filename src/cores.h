@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef CORES_H_
+#define CORES_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------
+
+
+/*
+ * C-states whose residency is tracked. Index into
+ * cstates[] and all per C-state arrays. The package
+ * states come first.
+ */
+typedef enum cstate_e {
+	CSTATE_PC2 = 0,
+	CSTATE_PC3,
+	CSTATE_PC6,
+	CSTATE_PC7,
+	CSTATE_PC8,
+	CSTATE_PC9,
+	CSTATE_PC10,
+	CSTATE_CC3,
+	CSTATE_CC6,
+	CSTATE_CC7,
+	CSTATES
+} cstate_e;
+
+
+/*
+ * Describes one C-state residency counter.
+ */
+typedef struct cstate_t {
+	// Human readable name.
+	const char *name;
+
+	// MSR counting the time spent in the state
+	// at the rate of the TSC.
+	int32_t msr;
+
+	// Counts for the whole package and not
+	// a single core, read from one CPU only.
+	bool package;
+
+	// Set by opencores() if the CPU has the MSR.
+	bool present;
+} cstate_t;
+
+
+/*
+ * A logical CPU, as updated by updatecores().
+ */
+typedef struct core_t {
+	// Number of the CPU.
+	int32_t cpu;
+
+	// Package the CPU belongs to.
+	uint32_t package;
+
+	// Mean frequency while the CPU wasn't halted
+	// during the last interval in MHz.
+	double frequency;
+
+	// Share of the last interval the CPU wasn't
+	// halted, that is was in C0, in percent.
+	double utilization;
+
+	// Share of the last interval spent in each core
+	// C-state in percent. Package states are 0.
+	double residency[CSTATES];
+} core_t;
+
+
+// --------
+
+
+/*
+ * All known C-states.
+ */
+extern cstate_t cstates[CSTATES];
+
+
+// --------
+
+
+/*
+ * Opens the MSRs of all CPUs and probes which C-states
+ * are present. Returns the number of CPUs, 0 if the backend
+ * can't access single CPUs or the CPU lacks APERF and MPERF.
+ */
+uint32_t opencores(void);
+
+
+/*
+ * Reads APERF, MPERF, the TSC and the C-state residency
+ * counters of all CPUs in one batch and updates the values
+ * since the last call.
+ */
+void updatecores(void);
+
+
+/*
+ * Returns the share of the last interval a package spent
+ * in each C-state in percent. The core states are the mean
+ * over all CPUs of the package.
+ *
+ *  - package: Package to query.
+ *  - residency: Filled with the residency of each C-state.
+ */
+void getresidency(uint32_t package, double residency[CSTATES]);
+
+
+/*
+ * Returns all CPUs, ordered by package.
+ *
+ *  - list: Set to the CPUs.
+ */
+uint32_t getcores(const core_t **list);
+
+
+/*
+ * Closes the MSRs of all CPUs.
+ */
+void closecores(void);
+
+
+// --------
+
+#endif // CORES_H_
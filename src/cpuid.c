@@ -29,16 +29,28 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/cpuctl.h>
 #include <sys/errno.h>
-#include <sys/ioctl.h>
 
 #include "cpuid.h"
+#include "msr.h"
 
 
 // --------
 
 
+/*
+ * Queries the given CPUID leaf through the backend.
+ *
+ *  - level: CPUID leaf.
+ *  - data: Filled with EAX, EBX, ECX and EDX.
+ */
+static void querycpuid(uint32_t level, uint32_t data[4]) {
+	if (!options.backend->cpuid(options.fds[0], level, 0, data)) {
+		exit_error(1, "ERROR: Couldn't query CPUID 0x%x: %s\n", level, strerror(errno));
+	}
+}
+
+
 /*
  * Gives the CPU model.
  *
@@ -46,7 +58,7 @@
  *  - model_len: Length of char array passed in 'model'.
  */
 void getcpumodel(char *model, size_t model_len) {
-	cpuctl_cpuid_count_args_t cpuid;
+	uint32_t cpuid[4];
 
 	assert(model_len >= 49);
 
@@ -59,58 +71,38 @@ void getcpumodel(char *model, size_t model_len) {
 
 
 	// Check if supported.
-	cpuid.level = 0x80000000;
-	cpuid.level_type = 0;
+	querycpuid(0x80000000, cpuid);
 
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
-
-	if (cpuid.data[0] < 0x80000004) {
+	if (cpuid[0] < 0x80000004) {
 		strcpy(model, "Unknown CPU Model");
 		return;
 	}
 
 	// Block 0.
-	cpuid.level = 0x80000002;
-	cpuid.level_type = 0;
-
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
+	querycpuid(0x80000002, cpuid);
 
-	memcpy(model, cpuid.data, sizeof(uint32_t));
-	memcpy(model + 4, cpuid.data + 1, sizeof(uint32_t));
-	memcpy(model + 8, cpuid.data + 2, sizeof(uint32_t));
-	memcpy(model + 12, cpuid.data + 3, sizeof(uint32_t));
+	memcpy(model, cpuid, sizeof(uint32_t));
+	memcpy(model + 4, cpuid + 1, sizeof(uint32_t));
+	memcpy(model + 8, cpuid + 2, sizeof(uint32_t));
+	memcpy(model + 12, cpuid + 3, sizeof(uint32_t));
 
 
 	// Block 1.
-	cpuid.level = 0x80000003;
-	cpuid.level_type = 0;
-
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
+	querycpuid(0x80000003, cpuid);
 
-	memcpy(model + 16 , cpuid.data, sizeof(uint32_t));
-	memcpy(model + 20, cpuid.data + 1, sizeof(uint32_t));
-	memcpy(model + 24, cpuid.data + 2, sizeof(uint32_t));
-	memcpy(model + 28, cpuid.data + 3, sizeof(uint32_t));
+	memcpy(model + 16 , cpuid, sizeof(uint32_t));
+	memcpy(model + 20, cpuid + 1, sizeof(uint32_t));
+	memcpy(model + 24, cpuid + 2, sizeof(uint32_t));
+	memcpy(model + 28, cpuid + 3, sizeof(uint32_t));
 
 
 	// Block 2.
-	cpuid.level = 0x80000004;
-	cpuid.level_type = 0;
+	querycpuid(0x80000004, cpuid);
 
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
-
-	memcpy(model + 32 , cpuid.data, sizeof(uint32_t));
-	memcpy(model + 36, cpuid.data + 1, sizeof(uint32_t));
-	memcpy(model + 40, cpuid.data + 2, sizeof(uint32_t));
-	memcpy(model + 44, cpuid.data + 3, sizeof(uint32_t));
+	memcpy(model + 32 , cpuid, sizeof(uint32_t));
+	memcpy(model + 36, cpuid + 1, sizeof(uint32_t));
+	memcpy(model + 40, cpuid + 2, sizeof(uint32_t));
+	memcpy(model + 44, cpuid + 3, sizeof(uint32_t));
 
 	// Remove superfluous whitespaces. For example a Core i7-2620M
 	// returns a string surrounded by a lot of whitespaces.
@@ -148,7 +140,7 @@ void getcpumodel(char *model, size_t model_len) {
  *  - vendor_len: Length of string passed in 'vendor'.
  */
 void getcpuvendor(char *vendor, size_t vendor_len) {
-	cpuctl_cpuid_count_args_t cpuid;
+	uint32_t cpuid[4];
 
 	assert(vendor_len >= 13);
 
@@ -157,17 +149,12 @@ void getcpuvendor(char *vendor, size_t vendor_len) {
 	   stored in EBX, EDX and ECX. In that order. */
 
 
-	cpuid.level = 0x0;
-	cpuid.level_type = 0;
-
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
+	querycpuid(0x0, cpuid);
 
 	// Yes, this is ugly. :)
-	memcpy(vendor, cpuid.data + 1, sizeof(uint32_t));
-	memcpy(vendor + 4, cpuid.data + 3, sizeof(uint32_t));
-	memcpy(vendor + 8, cpuid.data + 2, sizeof(uint32_t));
+	memcpy(vendor, cpuid + 1, sizeof(uint32_t));
+	memcpy(vendor + 4, cpuid + 3, sizeof(uint32_t));
+	memcpy(vendor + 8, cpuid + 2, sizeof(uint32_t));
 	vendor[12] = '\0';
 }
 
@@ -176,18 +163,13 @@ void getcpuvendor(char *vendor, size_t vendor_len) {
  * Returns the CPU family.
  */
 const char *getcpufamily(void) {
-	cpuctl_cpuid_count_args_t cpuid;
-
-	cpuid.level = 0x1;
-	cpuid.level_type = 0;
+	uint32_t cpuid[4];
 
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
+	querycpuid(0x1, cpuid);
 
 	// CPU identifiers are taken from  Intel® 64 and IA-32
     // Architectures Software Developer Manual: Vol 3, Table 35-1.
-	switch (cpuid.data[0] & 0xfffffff0) {
+	switch (cpuid[0] & 0xfffffff0) {
 		// Silvermont.
 		case 0x506d0:
 			return "Silvermont";
@@ -247,18 +229,13 @@ const char *getcpufamily(void) {
  * Returns the CPU type.
  */
 cputype_e getcputype(void) {
-	cpuctl_cpuid_count_args_t cpuid;
+	uint32_t cpuid[4];
 
-	cpuid.level = 0x1;
-	cpuid.level_type = 0;
-
-	if (ioctl(options.fd, CPUCTL_CPUID_COUNT, &cpuid) == -1) {
-		exit_error(1, "ERROR: ioctl CPUCTL_CPUID_COUNT failed: %s\n", errno);
-	}
+	querycpuid(0x1, cpuid);
 
 	// CPU identifiers are taken from  Intel® 64 and IA-32
     // Architectures Software Developer Manual: Vol 4, Table 2-1.
-	switch (cpuid.data[0] & 0xfffffff0) {
+	switch (cpuid[0] & 0xfffffff0) {
 		// Pentium.
 		case 0x00510:
 		case 0x00520:
@@ -349,21 +326,21 @@ cputype_e getcputype(void) {
 		case 0x306c0:
 			return CLIENT;
 
-		// Haswell server.
-		// PP0 is always 0.
+		// Haswell server. PP0 is always 0, but
+		// package and DRAM are counted.
 		case 0x306f0:
-			return UNSUPPORTED;
+			return SERVER;
 
 		// Broadwell client.
 		case 0x306d0:
 		case 0x40670:
 			return CLIENT;
 
-		// Broadwell server.
-		// PP0 is always 0.
+		// Broadwell server. PP0 is always 0, but
+		// package and DRAM are counted.
 		case 0x406f0:
 		case 0x50660:
-			return UNSUPPORTED;
+			return SERVER;
 
 		// Skylake client.
 		case 0x406e0:
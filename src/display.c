@@ -24,139 +24,92 @@
  * SUCH DAMAGE.
  */ 
 
+#include <inttypes.h>
 #include <math.h>
 #include <ncurses.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "budget.h"
+#include "cap.h"
+#include "cores.h"
+#include "domain.h"
+#include "limits.h"
 #include "main.h"
 #include "msr.h"
+#include "rollup.h"
+#include "sampler.h"
+#include "store.h"
 
 
 // --------
 
 
-/*
- * Current state of energy counters (in joule).
- */
-typedef struct energy_t {
-	double dram;
-	double pkg;
-	double pp0;
-	double pp1;
-} energy_t;
-
-/*
- * Multipliers used to calculate actual values from the raw data.
- */
-typedef struct multipliers_t {
-	double energy;
-	double power;
-	double time;
-} multipliers_t;
-
-/*
- * Powerlimits of the package.
- */
-typedef struct powerlimits_t {
-	uint64_t maximum_power;
-	uint64_t minimum_power;
-	uint64_t thermal_spec_power;
-} powerlimits_t;
+// Interval between two updates in nanoseconds.
+#define DISPLAY_INTERVAL (1000 * 1000 * 1000)
 
-/*
- * Maximum value of *_STATUS und *_THROTTLE MSR.
- */
-typedef struct wraparound_t {
-	double status;
-	double throttle;
-} wraparound_t;
+// Samples per update.
+#define DISPLAY_SAMPLES 4
 
 
 // --------
 
 
 /*
- * Fills the given energy_t struct with the current state
- * of the energy counter. The raw values are converted to
- * joule.
+ * Adds the energy in add to sum.
  *
- *  - *energy: Struct to fill.
- *  - *multi: Struct to get correction multipliers from.
+ *  - sum: Struct to add to.
+ *  - add: Struct to add.
  */
-static void getenergy(multipliers_t *multi, energy_t *energy) {
-	// Package.
-	uint64_t msr = getmsr(PKG_STATUS);
-	status_msr_t status = *(status_msr_t *)&msr;
-	energy->pkg = multi->energy * status.total_energy_consumed;
-
-	// PP0.
-	msr = getmsr(PP0_STATUS);
-	status = *(status_msr_t *)&msr;
-	energy->pp0 = multi->energy * status.total_energy_consumed;
-     
-	// PP1.
-	if (options.cputype == CLIENT) {
-		msr = getmsr(PP1_STATUS);
-		status = *(status_msr_t *)&msr;
-		energy->pp1 = multi->energy * status.total_energy_consumed;
-
-		energy->dram = 0;
-	}
-
-	//DRAM.
-	if (options.cputype == SERVER) {
-		msr = getmsr(DRAM_STATUS);
-		status = *(status_msr_t *)&msr;
-		energy->dram = multi->energy * status.total_energy_consumed;
-
-		energy->pp1 = 0;
+static void addenergy(energy_t *sum, const energy_t *add) {
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		sum->domain[i] += add->domain[i];
 	}
 }
 
 
 /*
- * Fills the given multipliers_t struct.
+ * Calculates the power consumption from the energy
+ * consumed in the given sample and it's duration.
  *
- *  - *multipliers: Struct to fill.
+ *  - sample: Sample to calculate from.
+ *  - power: Filled with the power in watts.
  */
-static void getmultipliers(multipliers_t *multipliers) {
-	uint64_t msr = getmsr(UNIT_MULTIPLIER);
-	unit_msr_t units = *(unit_msr_t *)&msr;
-
-	multipliers->energy = 1.0 / (double)B2POW(units.energy);
-	multipliers->power = 1.0 / (double)B2POW(units.power);
-	multipliers->time = 1.0 / (double)B2POW(units.time);
-}
-
+static void getpower(const sample_t *sample, energy_t *power) {
+	if (sample->time <= 0) {
+		memset(power, 0, sizeof(*power));
+		return;
+	}
 
-/*
- * Fills the given powerlimits_t structs.
- * 
- *  - *limits: Struct to fill.
- */
-static void getpowerlimits(powerlimits_t *limits) {
-	uint64_t msr = getmsr(PKG_INFO);
-	info_msr_t values = *(info_msr_t *)&msr;
+	energy_t energy;
+	getjoules(sample, &sample->delta, &energy);
 
-	limits->maximum_power = values.maximum_power / 10;
-	limits->minimum_power = values.minimum_power / 10;
-	limits->thermal_spec_power = values.thermal_spec_power / 10;
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		power->domain[i] = energy.domain[i] / sample->time;
+	}
 }
 
 
 /*
- * Fills the given wraparound_t struct based upon the values
- * in the given multipliers_t.
+ * Returns the column the throttled time of the given counter
+ * is shown in, 0 if it's domain isn't shown.
  *
- *  - *multi: multipliers_t struct to read values from.
- *  - *wrap: Struct to fill.
+ *  - throttle: Counter to show.
  */
-static void getwraparounds(multipliers_t *multi, wraparound_t *wrap) {
-	wrap->status = (double)(multi->energy * 4294967295); // 2^32-1
-	wrap->throttle = (double)(multi->time * 4294967295); // 2^32-1
+static uint32_t throttlecol(const throttle_t *throttle) {
+	switch (throttle->domain) {
+		case DOMAIN_PKG:
+			return 1;
+		case DOMAIN_PP0:
+			return 40;
+		case DOMAIN_DRAM:
+			return (options.cputype == SERVER) ? 60 : 0;
+		default:
+			return 0;
+	}
 }
 
 
@@ -184,31 +137,31 @@ void display(void) {
 	curs_set(0);
 
 
-	// Initialize multipliers.
-	multipliers_t multipliers;
-    getmultipliers(&multipliers);
-
-
-	// Initiale package limits.
+	// Initiale package limits. All packages are
+	// the same, so the machine limit is a multiple.
 	powerlimits_t powerlimits;
-	getpowerlimits(&powerlimits);
-	uint64_t powerlimit = powerlimits.thermal_spec_power < powerlimits.maximum_power
-		? powerlimits.maximum_power : powerlimits.thermal_spec_power;
-
+	getpowerlimits(0, &powerlimits);
+	uint64_t powerlimit = ceil(powerlimits.thermal_spec_power < powerlimits.maximum_power
+		? powerlimits.maximum_power : powerlimits.thermal_spec_power);
+	powerlimit *= options.packages;
+	bool limitknown = powerlimit != 0;
 
-	// Intialize wrap arounds.
-	wraparound_t wraparound;
-	getwraparounds(&multipliers, &wraparound);
 
+	// Counters. Summed over all packages.
+	energy_t total_energy;
+	energy_t power;
+	energy_t package_power[MAX_PACKAGES];
+	energy_t package_total[MAX_PACKAGES];
+	throttled_t throttled;
+	throttled_t package_throttled;
+	sample_t sample;
+	uint64_t missed;
+	uint64_t timestamp = 0;
 
-	// Counters.
-	energy_t cur_energy;
-	energy_t last_energy;
-	energy_t total_energy = {0, 0, 0, 0};
-	energy_t delta_energy = {0, 0, 0, 0};
-	uint32_t count = 0;
 
-	getenergy(&multipliers, &last_energy);
+	// Start sampling. A few samples per update, so
+	// each update sees at least one new sample.
+	startsamplers(DISPLAY_INTERVAL / DISPLAY_SAMPLES);
 
 
 	// Print static fields once
@@ -219,8 +172,16 @@ void display(void) {
 	snprintf(header, sizeof(header), "%s", options.cpumodel);
 	mvprintw(0, 38 - (strlen(header) / 2), header);
 
-	snprintf(header, sizeof(header), "(Arch: %s, Limit: %luW)",
-			options.cpufamily, powerlimit);
+	if (powerlimit) {
+		snprintf(header, sizeof(header), "(Arch: %s, Limit: %luW)",
+				options.cpufamily, powerlimit);
+	} else {
+		snprintf(header, sizeof(header), "(Arch: %s, Limit: unknown)",
+				options.cpufamily);
+
+		// Start scaling the bar from 1W.
+		powerlimit = 1;
+	}
 	mvprintw(1, 38 - (strlen(header) / 2), header);
 
 	// Load bar
@@ -264,137 +225,340 @@ void display(void) {
 		mvprintw(11, 60, "Total: ");
 	}
 
+	// Time throttled to enforce a power limit, below
+	// the domain that's throttled.
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		uint32_t col = throttlecol(&throttles[i]);
+
+		if (throttles[i].present && col) {
+			mvprintw(12, col, "Throttled: ");
+		}
+	}
+
+	// Package power history. Below the per
+	// package lines, if there are any.
+	const char *periods[RESOLUTIONS] = { "Second:", "Minute:", "Hour:" };
+	uint32_t history = options.packages > 1 ? 14 + options.packages : 13;
+
+	attron(A_BOLD);
+	mvprintw(history, 1, "History:");
+	mvprintw(history, 20, "Mean:");
+	mvprintw(history, 40, "Min / Max:");
+	mvprintw(history, 60, "Energy:");
+	attroff(A_BOLD);
+
+	for (uint32_t r = 0; r < RESOLUTIONS; r++) {
+		mvprintw(history + 1 + r, 1, periods[r]);
+	}
+
+	// Frequency and utilization of each package, followed
+	// by each CPU as far as the terminal is high enough.
+	uint32_t corerow = history + 2 + RESOLUTIONS;
+	uint32_t cstaterow = 0;
+	uint32_t numcores = opencores();
+
+	if (numcores) {
+		attron(A_BOLD);
+		mvprintw(corerow, 1, "CPUs:");
+		mvprintw(corerow, 20, "Frequency:");
+		mvprintw(corerow, 40, "C0:");
+		attroff(A_BOLD);
+
+		for (uint32_t p = 0; p < options.packages; p++) {
+			mvprintw(corerow + 1 + p, 1, "Pkg %u:", p);
+		}
+
+		// C-state residency of each package, the package
+		// states on the first line, the core states below.
+		bool anystate = false;
+
+		for (uint32_t i = 0; i < CSTATES; i++) {
+			anystate |= cstates[i].present;
+		}
+
+		if (anystate) {
+			cstaterow = corerow + 1 + options.packages;
+
+			attron(A_BOLD);
+			mvprintw(cstaterow, 1, "C-states:");
+			attroff(A_BOLD);
+
+			for (uint32_t p = 0; p < options.packages; p++) {
+				mvprintw(cstaterow + 1 + p * 2, 1, "Pkg %u:", p);
+			}
+		}
+	}
+
 	while (1) {
-		getenergy(&multipliers, &cur_energy);
-
-		// PKG.
-		if (cur_energy.pkg < last_energy.pkg) {
-			delta_energy.pkg += wraparound.status - last_energy.pkg;
-			delta_energy.pkg += cur_energy.pkg;
-
-			total_energy.pkg += wraparound.status - last_energy.pkg;
-			total_energy.pkg += cur_energy.pkg;
-		} else {
-			delta_energy.pkg += cur_energy.pkg - last_energy.pkg;
-			total_energy.pkg += cur_energy.pkg - last_energy.pkg;
+		// One update every second.
+		usleep(DISPLAY_INTERVAL / 1000);
+
+		// Interrupted by a signal.
+		if (options.stop) {
+			break;
 		}
 
-		// PP0.
-		if (cur_energy.pp0 < last_energy.pp0) {
-			delta_energy.pp0 += wraparound.status - last_energy.pp0;
-			delta_energy.pp0 += cur_energy.pp0;
+		memset(&power, 0, sizeof(power));
+		memset(&total_energy, 0, sizeof(total_energy));
+		memset(&throttled, 0, sizeof(throttled));
+		missed = 0;
+
+		for (uint32_t i = 0; i < options.packages; i++) {
+			getsample(i, &sample);
+
+			if (i == 0) {
+				timestamp = sample.timestamp;
+			}
+
+			getpower(&sample, &package_power[i]);
+			updatecap(i, package_power[i].domain[DOMAIN_PKG], sample.time);
+			updatebudget(i, package_power[i].domain[DOMAIN_PKG], sample.time);
+
+			addenergy(&power, &package_power[i]);
+			getjoules(&sample, &sample.total, &package_total[i]);
+			addenergy(&total_energy, &package_total[i]);
+			missed += sample.missed;
+
+			// Mean over all packages.
+			getthrottled(&sample, &package_throttled);
 
-			total_energy.pp0 += wraparound.status - last_energy.pp0;
-			total_energy.pp0 += cur_energy.pp0;
-		} else {
-			delta_energy.pp0 += cur_energy.pp0 - last_energy.pp0;
-			total_energy.pp0 += cur_energy.pp0 - last_energy.pp0;
+			for (uint32_t t = 0; t < THROTTLES; t++) {
+				throttled.throttle[t] += package_throttled.throttle[t] / options.packages;
+			}
+		}
+
+		addrollup(timestamp, &total_energy);
+		storesample(timestamp, package_total);
+
+		// Total power consumption.
+		mvprintw(5, 1, "%6.2f", power.domain[DOMAIN_PKG]);
+
+		// Without a known limit the bar is
+		// scaled to the highest power seen.
+		if (!limitknown && power.domain[DOMAIN_PKG] > powerlimit) {
+			powerlimit = ceil(power.domain[DOMAIN_PKG]);
 		}
 
-		// PP1.
-		if (cur_energy.pp1 < last_energy.pp1) {
-			delta_energy.pp1 += wraparound.status - last_energy.pp1;
-			delta_energy.pp1 += cur_energy.pp1;
+		uint32_t num_load = floor((67.0 / powerlimit) * power.domain[DOMAIN_PKG]);
+		uint32_t i;
 
-			total_energy.pp1 += wraparound.status - last_energy.pp1;
-			total_energy.pp1 += cur_energy.pp1;
-		} else {
-			delta_energy.pp1 += cur_energy.pp1 - last_energy.pp1;
-			total_energy.pp1 += cur_energy.pp1 - last_energy.pp1;
+		for (i = 0; i < num_load && i <= 66; i++) {
+			mvprintw(5, i + 10, "=");
 		}
 
-		// DRAM.
-		if (cur_energy.dram < last_energy.dram) {
-			delta_energy.dram += wraparound.status - last_energy.dram;
-			delta_energy.dram += cur_energy.dram;
+		mvprintw(5, i + 10, ">");
+
+		for (i++; i <= 66; i++) {
+			mvprintw(5, i + 10, " ");
+		}
 
-			total_energy.dram += wraparound.status - last_energy.dram;
-			total_energy.dram += cur_energy.dram;
-		} else {
-			delta_energy.dram += cur_energy.dram - last_energy.dram;
-			total_energy.dram += cur_energy.dram - last_energy.dram;
+		// Package power consumption.
+		mvprintw(10, 9, "          ");
+		mvprintw(10, 10, "%.2fW", power.domain[DOMAIN_PKG]);
+		mvprintw(11, 8, "%.2fJ", total_energy.domain[DOMAIN_PKG]);
+
+		// Uncore power consumption.
+		mvprintw(10, 29, "          ");
+		mvprintw(10, 29, "%.2fW", power.domain[DOMAIN_PKG] -
+				(power.domain[DOMAIN_PP0] + power.domain[DOMAIN_PP1]));
+		mvprintw(11, 27, "%.2fJ", total_energy.domain[DOMAIN_PKG] -
+				(total_energy.domain[DOMAIN_PP0] + total_energy.domain[DOMAIN_PP1]));
+
+		// x86 cores power consumption.
+		mvprintw(10, 49, "          ");
+		mvprintw(10, 49, "%.2fW", power.domain[DOMAIN_PP0]);
+		mvprintw(11, 47, "%.2fJ", total_energy.domain[DOMAIN_PP0]);
+
+		if (options.cputype == CLIENT) {
+			// GPU power consumption.
+			mvprintw(10, 69, "          ");
+			mvprintw(10, 69, "%.2fW", power.domain[DOMAIN_PP1]);
+			mvprintw(11, 67, "%.2fJ", total_energy.domain[DOMAIN_PP1]);
+		} else if (options.cputype == SERVER) {
+			// DRAM power consumption.
+			mvprintw(10, 69, "          ");
+			mvprintw(10, 69, "%.2fW", power.domain[DOMAIN_DRAM]);
+			mvprintw(11, 67, "%.2fJ", total_energy.domain[DOMAIN_DRAM]);
 		}
 
-		last_energy = cur_energy;
-		count++;
+		// Power limits and the turbo budget left. The budgets
+		// of all packages add up, the first package to clamp
+		// clamps the machine.
+		budget_t first;
+
+		if (getbudget(0, &first)) {
+			budget_t budget;
+			double energy = 0;
+			double seconds = -1;
+
+			for (uint32_t p = 0; p < options.packages; p++) {
+				if (!getbudget(p, &budget)) {
+					continue;
+				}
 
-		if (count == 20) {
-			// Total power consumption.
-			mvprintw(5, 1, "%6.2f", delta_energy.pkg);
+				energy += budget.energy;
+
+				if (budget.seconds >= 0 && (seconds < 0 || budget.seconds < seconds)) {
+					seconds = budget.seconds;
+				}
+			}
 
-			uint32_t num_load = floor((67.0 / powerlimit) * delta_energy.pkg);
-			uint32_t i;
+			mvprintw(3, 1, "                                                                            ");
+			mvprintw(3, 1, "PL1: %.0fW / %.1fs", first.limits.pl1, first.limits.window1);
 
-			for (i = 0; i < num_load && i <= 66; i++) {
-				mvprintw(5, i + 10, "=");
+			if (first.limits.pl2 > 0) {
+				mvprintw(3, 20, "PL2: %.0fW / %.3fs", first.limits.pl2, first.limits.window2);
 			}
 
-			mvprintw(5, i + 10, ">");
+			mvprintw(3, 40, "Budget: %.1fJ", energy);
 
-			for (i++; i <= 66; i++) {
-				mvprintw(5, i + 10, " ");
+			if (seconds >= 0) {
+				mvprintw(3, 60, "Clamp in: %.1fs", seconds);
+			} else {
+				mvprintw(3, 60, "Clamp in: never");
 			}
+		}
+
+		// Throttled share of the last update.
+		for (uint32_t t = 0; t < THROTTLES; t++) {
+			uint32_t col = throttlecol(&throttles[t]);
+
+			if (throttles[t].present && col) {
+				mvprintw(12, col + 11, "        ");
+				mvprintw(12, col + 11, "%.1f%%", throttled.throttle[t]);
+			}
+		}
+
+		// Whole platform, if the CPU knows about it.
+		if (domains[DOMAIN_PLATFORM].present) {
+			mvprintw(7, 60, "Platform:          ");
+			mvprintw(7, 70, "%.2fW", power.domain[DOMAIN_PLATFORM]);
+		}
+
+		// Samples the samplers were too late for.
+		if (missed) {
+			mvprintw(7, 1, "Missed samples: %" PRIu64, missed);
+		}
+
+		// Per package power consumption. Not
+		// necessary if there's just one package.
+		if (options.packages > 1) {
+			for (uint32_t p = 0; p < options.packages; p++) {
+				energy_t *current = &package_power[p];
+
+				mvprintw(13 + p, 1, "Pkg %u:", p);
+
+				mvprintw(13 + p, 10, "          ");
+				mvprintw(13 + p, 10, "%.2fW", current->domain[DOMAIN_PKG]);
+
+				mvprintw(13 + p, 29, "          ");
+				mvprintw(13 + p, 29, "%.2fW", current->domain[DOMAIN_PKG] - (current->domain[DOMAIN_PP0] + current->domain[DOMAIN_PP1]));
 
-			// Package power consumption.
-			mvprintw(10, 9, "          ");
-			mvprintw(10, 10, "%.2fW", delta_energy.pkg);
-			mvprintw(11, 8, "%.2fJ", total_energy.pkg);
-
-			// Uncore power consumption.
-			mvprintw(10, 29, "          ");
-			mvprintw(10, 29, "%.2fW", delta_energy.pkg -
-					(delta_energy.pp0 + delta_energy.pp1));
-			mvprintw(11, 27, "%.2fJ", total_energy.pkg -
-					(total_energy.pp0 + total_energy.pp1));
-
-			// x86 cores power consumption.
-			mvprintw(10, 49, "          ");
-			mvprintw(10, 49, "%.2fW", delta_energy.pp0);
-			mvprintw(11, 47, "%.2fJ", total_energy.pp0);
-
-			if (options.cputype == CLIENT) {
-				// GPU power consumption.
-				mvprintw(10, 69, "          ");
-				mvprintw(10, 69, "%.2fW", delta_energy.pp1);
-				mvprintw(11, 67, "%.2fJ", total_energy.pp1);
-			} else if (options.cputype == SERVER) {
-				// DRAM power consumption.
-				mvprintw(10, 69, "          ");
-				mvprintw(10, 69, "%.2fW", delta_energy.dram);
-				mvprintw(11, 67, "%.2fJ", total_energy.dram);
+				mvprintw(13 + p, 49, "          ");
+				mvprintw(13 + p, 49, "%.2fW", current->domain[DOMAIN_PP0]);
+
+				if (options.cputype == CLIENT) {
+					mvprintw(13 + p, 69, "          ");
+					mvprintw(13 + p, 69, "%.2fW", current->domain[DOMAIN_PP1]);
+				} else if (options.cputype == SERVER) {
+					mvprintw(13 + p, 69, "          ");
+					mvprintw(13 + p, 69, "%.2fW", current->domain[DOMAIN_DRAM]);
+				}
 			}
+		}
 
-			// Print the new data
-			refresh();
+		// Last complete period of each resolution.
+		for (uint32_t r = 0; r < RESOLUTIONS; r++) {
+			rollup_t rollup;
 
-			// Quit?
-			int32_t ch;
+			if (!getrollups(r, &rollup, 1)) {
+				continue;
+			}
+
+			mvprintw(history + 1 + r, 20, "                    ");
+			mvprintw(history + 1 + r, 20, "%.2fW", rollup.energy[DOMAIN_PKG] / rollup.time);
+			mvprintw(history + 1 + r, 40, "                    ");
+			mvprintw(history + 1 + r, 40, "%.2fW / %.2fW", rollup.min[DOMAIN_PKG], rollup.max[DOMAIN_PKG]);
+			mvprintw(history + 1 + r, 60, "%.2fJ", rollup.energy[DOMAIN_PKG]);
+		}
 
-			while ((ch = getch()) != ERR) {
-				switch (ch) {
-					case 'q':
-					case 'Q':
-					case 27:
-						options.stop = 1;
+		// Effective frequency and C0 residency.
+		if (numcores) {
+			const core_t *cores;
+			double busy[MAX_PACKAGES] = { 0 };
+			double c0[MAX_PACKAGES] = { 0 };
+			uint32_t cpus[MAX_PACKAGES] = { 0 };
+			uint32_t row = cstaterow ? cstaterow + 1 + options.packages * 2
+				: corerow + 1 + options.packages;
+
+			updatecores();
+			getcores(&cores);
+
+			for (uint32_t c = 0; c < numcores; c++) {
+				busy[cores[c].package] += cores[c].frequency * cores[c].utilization;
+				c0[cores[c].package] += cores[c].utilization;
+				cpus[cores[c].package]++;
+
+				if (row + c / 4 < (uint32_t)LINES) {
+					mvprintw(row + c / 4, 1 + (c % 4) * 19, "%4d %5.0fMHz %3.0f%%",
+							cores[c].cpu, cores[c].frequency, cores[c].utilization);
 				}
 			}
 
-			if (options.stop) {
-				break;
+			// The frequency is weighted by the time in C0.
+			for (uint32_t p = 0; p < options.packages; p++) {
+				mvprintw(corerow + 1 + p, 20, "                    ");
+				mvprintw(corerow + 1 + p, 20, "%.0fMHz", c0[p] > 0 ? busy[p] / c0[p] : 0);
+				mvprintw(corerow + 1 + p, 40, "                    ");
+				mvprintw(corerow + 1 + p, 40, "%.1f%%", cpus[p] ? c0[p] / cpus[p] : 0);
 			}
 
-			// Cleanup.
-			delta_energy.pkg = 0;
-			delta_energy.pp0 = 0;
-			delta_energy.pp1 = 0;
-			delta_energy.dram = 0;
-			count = 0;
+			// Residency of the present C-states. Each takes
+			// 10 characters, at most 7 states per line.
+			for (uint32_t p = 0; p < options.packages && cstaterow; p++) {
+				double residency[CSTATES];
+				uint32_t col[2] = { 8, 8 };
+
+				getresidency(p, residency);
+
+				for (uint32_t i = 0; i < CSTATES; i++) {
+					uint32_t line = cstates[i].package ? 0 : 1;
+
+					if (!cstates[i].present) {
+						continue;
+					}
+
+					mvprintw(cstaterow + 1 + p * 2 + line, col[line], "%-4s%4.0f%%",
+							cstates[i].name, residency[i]);
+					col[line] += 10;
+				}
+			}
 		}
 
-		// One sample every 50 milliseconds.
-		usleep(50 * 1000);
+		// Print the new data
+		refresh();
+
+		// Quit?
+		int32_t ch;
+
+		while ((ch = getch()) != ERR) {
+			switch (ch) {
+				case 'q':
+				case 'Q':
+				case 27:
+					options.stop = 1;
+			}
+		}
+
+		if (options.stop) {
+			break;
+		}
 	}
 
+	// Stop sampling.
+	stopsamplers();
+	closecores();
+
 	// Quit curses.
 	endwin();
 }
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "domain.h"
+#include "main.h"
+#include "msr.h"
+
+
+// --------
+
+
+/*
+ * Energy unit of a domain differing from UNIT_MULTIPLIER.
+ */
+typedef struct unitoverride_t {
+	// CPU family as returned by getcpufamily().
+	const char *family;
+
+	// CPU type as returned by getcputype().
+	cputype_e type;
+
+	// Domain the unit applies to.
+	domain_e domain;
+
+	// Energy unit in joule.
+	double unit;
+} unitoverride_t;
+
+
+// --------
+
+
+/* The DRAM domain of the Xeons since Haswell-EP ignores
+   UNIT_MULTIPLIER and has a fixed unit of 15.3 microjoule. */
+static const unitoverride_t overrides[] = {
+	{ "Haswell", SERVER, DOMAIN_DRAM, 0.0000153 },
+	{ "Broadwell", SERVER, DOMAIN_DRAM, 0.0000153 },
+	{ "Skylake", SERVER, DOMAIN_DRAM, 0.0000153 }
+};
+
+
+domain_t domains[DOMAINS] = {
+	[DOMAIN_PKG] = { "Package", "pkg", PKG_STATUS, 0, false, false },
+	[DOMAIN_PP0] = { "x86 Cores", "pp0", PP0_STATUS, 0, false, false },
+	[DOMAIN_PP1] = { "GPU", "pp1", PP1_STATUS, 0, false, false },
+	[DOMAIN_DRAM] = { "DRAM", "dram", DRAM_STATUS, 0, false, false },
+	[DOMAIN_PLATFORM] = { "Platform", "platform", PLATFORM_STATUS, 0, true, false }
+};
+
+throttle_t throttles[THROTTLES] = {
+	[THROTTLE_PKG] = { "pkg", PKG_THROTTLE, DOMAIN_PKG, false },
+	[THROTTLE_PP0] = { "pp0", PP0_TIME, DOMAIN_PP0, false },
+	[THROTTLE_DRAM] = { "dram", DRAM_THROTTLE, DOMAIN_DRAM, false }
+};
+
+
+// --------
+
+
+/*
+ * Probes which domains and throttling counters are
+ * present and sets the energy units.
+ */
+void initdomains(void) {
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		domains[i].present = checkmsr(domains[i].msr);
+	}
+
+	// Only domains with a power limit can be throttled.
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		throttles[i].present = domains[throttles[i].domain].present
+			&& checkmsr(throttles[i].msr);
+	}
+
+	// A replay brings the units in effect when it was recorded,
+	// emulated MSRs are already in the emulated unit.
+	if (options.backend->unit) {
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			if (domains[i].present) {
+				options.backend->unit(options.fds[0], domains[i].msr, &domains[i].unit);
+			}
+		}
+	} else if (!options.backend->emulated) {
+		for (size_t i = 0; i < sizeof(overrides) / sizeof(overrides[0]); i++) {
+			if (!strcmp(overrides[i].family, options.cpufamily)
+					&& overrides[i].type == options.cputype) {
+				domains[overrides[i].domain].unit = overrides[i].unit;
+			}
+		}
+	}
+
+	// Given at command line.
+	if (options.dramunit > 0) {
+		domains[DOMAIN_DRAM].unit = options.dramunit;
+	}
+}
+
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef DOMAIN_H_
+#define DOMAIN_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------
+
+
+/*
+ * RAPL domains. Index into domains[] and all
+ * per domain arrays.
+ */
+typedef enum domain_e {
+	DOMAIN_PKG = 0,
+	DOMAIN_PP0,
+	DOMAIN_PP1,
+	DOMAIN_DRAM,
+	DOMAIN_PLATFORM,
+	DOMAINS
+} domain_e;
+
+
+/*
+ * Describes one RAPL domain.
+ */
+typedef struct domain_t {
+	// Human readable name.
+	const char *name;
+
+	// Short name used in machine readable output.
+	const char *key;
+
+	// *_STATUS MSR with the energy counter.
+	int32_t msr;
+
+	// Energy unit in joule. 0 if the unit
+	// from UNIT_MULTIPLIER applies.
+	double unit;
+
+	// Covers the whole platform and not a single
+	// package, read from the first package only.
+	bool platform;
+
+	// Set by initdomains() if the CPU has the domain.
+	bool present;
+} domain_t;
+
+
+/*
+ * Throttling counters. Index into throttles[] and
+ * all per throttling counter arrays.
+ */
+typedef enum throttle_e {
+	THROTTLE_PKG = 0,
+	THROTTLE_PP0,
+	THROTTLE_DRAM,
+	THROTTLES
+} throttle_e;
+
+
+/*
+ * Describes one counter of the time a domain was
+ * throttled to enforce it's power limit.
+ */
+typedef struct throttle_t {
+	// Short name used in machine readable output.
+	const char *key;
+
+	// MSR with the accumulated throttled time.
+	int32_t msr;
+
+	// Domain that is throttled.
+	domain_e domain;
+
+	// Set by initdomains() if the CPU has the counter.
+	bool present;
+} throttle_t;
+
+
+// --------
+
+
+/*
+ * All known domains.
+ */
+extern domain_t domains[DOMAINS];
+
+/*
+ * All known throttling counters.
+ */
+extern throttle_t throttles[THROTTLES];
+
+
+// --------
+
+
+/*
+ * Probes which domains and throttling counters are present
+ * and sets the energy units. Must be called after the backend
+ * was opened and the CPU was identified.
+ */
+void initdomains(void);
+
+
+// --------
+
+#endif // DOMAIN_H_
+
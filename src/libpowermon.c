@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Each thread gets a ring of markers on it's first marker. The
+ * thread is the only writer, the drainer thread the only reader,
+ * so neither needs a lock. The rings are kept in a list, new
+ * ones are pushed with a compare and swap. Rings of exited
+ * threads are freed by the drainer once they're empty.
+ *
+ * The file is line based, all numbers are decimal:
+ *
+ *   C clock realtime           Clock at CLOCK_REALTIME in ns.
+ *   B thread depth clock name  Region begins.
+ *   E thread depth clock       Region ends.
+ *   D thread count             Markers dropped by the thread.
+ *
+ * The depth is the number of regions open on the thread before
+ * the begin and after the end, so pairs can be matched even if
+ * markers were dropped in between.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libpowermon.h"
+
+
+// --------
+
+
+// Markers buffered per thread. Must be a power of 2.
+#define REGION_EVENTS 32768
+
+// Interval the buffers are written in nanoseconds.
+#define REGION_DRAIN (10 * 1000 * 1000)
+
+
+// --------
+
+
+/*
+ * One marker.
+ */
+typedef struct event_t {
+	uint64_t clock;
+
+	// Name of the region, NULL for an end.
+	const char *name;
+
+	// Regions open outside of this one.
+	uint32_t depth;
+} event_t;
+
+
+/*
+ * Markers of one thread.
+ */
+typedef struct ring_t {
+	// Written by the owning thread. The tail is only
+	// read when the ring looks full, limit is where
+	// it was the last time plus the size.
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t limit;
+	uint64_t dropped;
+
+	// Written by the drainer.
+	uint64_t tail __attribute__((aligned(64)));
+	uint64_t reported;
+
+	// Set when the thread exited.
+	uint32_t dead;
+
+	// Number of the thread in the file.
+	uint32_t id;
+
+	struct ring_t *next;
+
+	event_t events[REGION_EVENTS];
+} ring_t;
+
+
+// --------
+
+
+// Ring of the calling thread.
+static __thread ring_t *ring;
+
+// Regions open on the calling thread.
+static __thread uint32_t depth;
+
+// All rings, newest first.
+static ring_t *rings;
+
+// Number of rings ever created.
+static uint32_t threads;
+
+// The file, NULL if PMREGIONS isn't set.
+static FILE *out;
+
+// Initializes everything on the first marker.
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// Frees the ring at thread exit.
+static pthread_key_t key;
+
+// Writes the rings.
+static pthread_t drainer;
+static uint32_t draining;
+static uint32_t stopping;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// --------
+
+
+/*
+ * Returns the clock the markers are stamped with.
+ */
+static inline uint64_t readclock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+/*
+ * Writes the clock together with CLOCK_REALTIME,
+ * so the markers can be converted.
+ */
+static void calibrate(void) {
+	struct timespec ts;
+
+	uint64_t before = readclock();
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t after = readclock();
+
+	fprintf(out, "C %" PRIu64 " %" PRIu64 "\n", before + (after - before) / 2,
+			(uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+
+/*
+ * Writes the markers of all rings and frees the
+ * rings of exited threads.
+ */
+static void drain(void) {
+	pthread_mutex_lock(&lock);
+
+	ring_t *prev = NULL;
+	ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+
+	while (r) {
+		ring_t *next = r->next;
+		uint32_t dead = __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+		for (uint64_t t = r->tail; t != head; t++) {
+			const event_t *e = &r->events[t & (REGION_EVENTS - 1)];
+
+			if (e->name) {
+				fprintf(out, "B %u %u %" PRIu64 " %s\n", r->id, e->depth, e->clock, e->name);
+			} else {
+				fprintf(out, "E %u %u %" PRIu64 "\n", r->id, e->depth, e->clock);
+			}
+		}
+
+		__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+
+		uint64_t dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+
+		if (dropped != r->reported) {
+			fprintf(out, "D %u %" PRIu64 "\n", r->id, dropped - r->reported);
+			r->reported = dropped;
+		}
+
+		// The owner is gone, nothing is added anymore. New rings
+		// are only pushed in front, the head is unlinked with a
+		// compare and swap and retried next time if that fails.
+		if (dead) {
+			if (prev) {
+				prev->next = next;
+				free(r);
+			} else if (__atomic_compare_exchange_n(&rings, &r, next, false,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				free(r);
+			} else {
+				prev = r;
+			}
+		} else {
+			prev = r;
+		}
+
+		r = next;
+	}
+
+	calibrate();
+	fflush(out);
+
+	pthread_mutex_unlock(&lock);
+}
+
+
+/*
+ * Writes the rings until the program exits.
+ */
+static void *drainthread(void *arg) {
+	struct timespec interval = { 0, REGION_DRAIN };
+
+	(void)arg;
+
+	while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		nanosleep(&interval, NULL);
+		drain();
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Stops the drainer and writes what's left.
+ */
+static void finish(void) {
+	if (draining) {
+		__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+		pthread_join(drainer, NULL);
+	}
+
+	drain();
+}
+
+
+/*
+ * Marks the ring of an exiting thread.
+ *
+ *  - arg: The ring.
+ */
+static void detach(void *arg) {
+	ring_t *r = arg;
+
+	ring = NULL;
+	__atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Opens the file and starts the drainer, if PMREGIONS is set.
+ */
+static void init(void) {
+	const char *path = getenv("PMREGIONS");
+
+	if (!path || !*path || !(out = fopen(path, "w"))) {
+		return;
+	}
+
+	fprintf(out, "# libpowermon regions 1\n");
+	calibrate();
+
+	pthread_key_create(&key, detach);
+
+	// The application handles it's signals itself.
+	sigset_t all;
+	sigset_t old;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	draining = pthread_create(&drainer, NULL, drainthread, NULL) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	atexit(finish);
+}
+
+
+/*
+ * Creates the ring of the calling thread. Returns
+ * NULL if the markers are disabled.
+ */
+static ring_t *attach(void) {
+	ring_t *r;
+
+	pthread_once(&once, init);
+
+	if (!out || posix_memalign((void **)&r, 64, sizeof(ring_t))) {
+		return NULL;
+	}
+
+	r->head = 0;
+	r->limit = REGION_EVENTS;
+	r->dropped = 0;
+	r->tail = 0;
+	r->reported = 0;
+	r->dead = 0;
+	r->id = __atomic_fetch_add(&threads, 1, __ATOMIC_RELAXED);
+	r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&rings, &r->next, r, true,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	pthread_setspecific(key, r);
+	ring = r;
+
+	return r;
+}
+
+
+/*
+ * Adds a marker to the ring of the calling thread.
+ *
+ *  - name: Name of the region, NULL for an end.
+ *  - level: Depth of the region.
+ */
+static inline void mark(const char *name, uint32_t level) {
+	ring_t *r = ring;
+
+	if (!r && !(r = attach())) {
+		return;
+	}
+
+	uint64_t head = r->head;
+
+	if (head == r->limit) {
+		r->limit = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) + REGION_EVENTS;
+
+		if (head == r->limit) {
+			__atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	event_t *e = &r->events[head & (REGION_EVENTS - 1)];
+
+	e->clock = readclock();
+	e->name = name;
+	e->depth = level;
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+// --------
+
+
+/*
+ * Starts a region.
+ */
+void pm_region_begin(const char *name) {
+	mark(name ? name : "(null)", depth++);
+}
+
+
+/*
+ * Ends the innermost region.
+ */
+void pm_region_end(void) {
+	if (depth) {
+		mark(NULL, --depth);
+	}
+}
+
+
+/*
+ * Writes the buffered markers.
+ */
+void pm_region_flush(void) {
+	if (out) {
+		drain();
+	}
+}
+
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Region markers for applications. A region is the code between
+ * pm_region_begin() and pm_region_end() on one thread, regions
+ * nest. The markers just put a timestamp into a buffer of the
+ * calling thread, a thread of the library writes the buffers to
+ * the file named by the PMREGIONS environment variable. Without
+ * PMREGIONS the markers do nothing:
+ *
+ *   pm_region_begin("compaction");
+ *   compact(table);
+ *   pm_region_end();
+ *
+ * Link with libpowermon.a and -lpthread, build with 'make
+ * libpowermon'. Run powermon with headless CSV output at the
+ * same time and join both with pmregions:
+ *
+ *   powermon -o csv -i 0.01 > energy.csv &
+ *   PMREGIONS=regions.txt ./service
+ *   pmregions energy.csv regions.txt
+ *
+ * Timestamps are taken from the TSC on x86 and converted to
+ * CLOCK_REALTIME by pmregions. A marker costs a few nanoseconds,
+ * 'make benchregion' builds a benchmark. If a thread marks
+ * faster than the buffer is written, markers are dropped and
+ * the affected regions are left out.
+ */
+
+#ifndef LIBPOWERMON_H_
+#define LIBPOWERMON_H_
+
+
+// --------
+
+
+/*
+ * Starts a region on the calling thread.
+ *
+ *  - name: Name of the region. Only the pointer is
+ *          stored, the string must stay valid until
+ *          the program exits. String literals do.
+ */
+void pm_region_begin(const char *name);
+
+
+/*
+ * Ends the innermost region of the calling thread.
+ */
+void pm_region_end(void);
+
+
+/*
+ * Writes all buffered markers to the file. Called
+ * at exit, only necessary before fork() or _exit().
+ */
+void pm_region_flush(void);
+
+
+// --------
+
+#endif // LIBPOWERMON_H_
+
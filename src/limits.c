@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "limits.h"
+#include "msr.h"
+
+
+// --------
+
+
+/*
+ * Fills the given powerlimits_t struct.
+ */
+void getpowerlimits(uint32_t package, powerlimits_t *limits) {
+	memset(limits, 0, sizeof(*limits));
+
+	// Not all backends know the limits.
+	if (!checkmsr(PKG_INFO)) {
+		return;
+	}
+
+	int32_t msrs[2] = { UNIT_MULTIPLIER, PKG_INFO };
+	uint64_t data[2];
+
+	getmsrs(package, msrs, data, 2);
+
+	unit_msr_t units;
+	info_msr_t values;
+
+	memcpy(&units, &data[0], sizeof(units));
+	memcpy(&values, &data[1], sizeof(values));
+	double unit = 1.0 / (double)B2POW(units.power);
+
+	limits->maximum_power = values.maximum_power * unit;
+	limits->minimum_power = values.minimum_power * unit;
+	limits->thermal_spec_power = values.thermal_spec_power * unit;
+}
+
+
+/*
+ * Fills the given pkglimits_t struct.
+ */
+bool getpkglimits(uint32_t package, pkglimits_t *limits) {
+	memset(limits, 0, sizeof(*limits));
+
+	if (!checkmsr(PKG_LIMIT)) {
+		return false;
+	}
+
+	int32_t msrs[2] = { UNIT_MULTIPLIER, PKG_LIMIT };
+	uint64_t data[2];
+
+	getmsrs(package, msrs, data, 2);
+
+	unit_msr_t units;
+	pkg_limit_msr_t values;
+
+	memcpy(&units, &data[0], sizeof(units));
+	memcpy(&values, &data[1], sizeof(values));
+	double power = 1.0 / (double)B2POW(units.power);
+	double time = 1.0 / (double)B2POW(units.time);
+
+	// The window is 2^Y * (1 + F / 4) time units.
+	limits->pl1 = values.limit_enabled_1 ? values.power_limit_1 * power : 0;
+	limits->pl2 = values.limit_enabled_2 ? values.power_limit_2 * power : 0;
+	limits->window1 = (1u << values.limit_time_window_y_1)
+		* (1.0 + values.limit_time_window_f_1 / 4.0) * time;
+	limits->window2 = (1u << values.limit_time_window_y_2)
+		* (1.0 + values.limit_time_window_f_2 / 4.0) * time;
+	limits->locked = values.lock_enabled;
+
+	return true;
+}
+
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef LIMITS_H_
+#define LIMITS_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------
+
+
+/*
+ * Powerlimits of a package in watts, 0 if unknown.
+ */
+typedef struct powerlimits_t {
+	double maximum_power;
+	double minimum_power;
+	double thermal_spec_power;
+} powerlimits_t;
+
+
+/*
+ * Package power limits as enforced by the PMU.
+ */
+typedef struct pkglimits_t {
+	// Long term limit PL1 and short term limit
+	// PL2 in watts, 0 if not enabled.
+	double pl1;
+	double pl2;
+
+	// Time windows the average power is compared
+	// to the limits over in seconds.
+	double window1;
+	double window2;
+
+	// The limits can't be changed until reset.
+	bool locked;
+} pkglimits_t;
+
+
+// --------
+
+
+/*
+ * Fills the given powerlimits_t struct from PKG_INFO.
+ *
+ *  - package: Package to read.
+ *  - *limits: Struct to fill.
+ */
+void getpowerlimits(uint32_t package, powerlimits_t *limits);
+
+
+/*
+ * Fills the given pkglimits_t struct from PKG_LIMIT. Returns
+ * false if PKG_LIMIT can't be read.
+ *
+ *  - package: Package to read.
+ *  - *limits: Struct to fill.
+ */
+bool getpkglimits(uint32_t package, pkglimits_t *limits);
+
+
+// --------
+
+#endif // LIMITS_H_
+
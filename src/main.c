@@ -24,7 +24,7 @@
  * SUCH DAMAGE.
  */ 
 
-#include <fcntl.h>
+#include <getopt.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -33,12 +33,22 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/errno.h>
-#include <sys/stat.h>
 
+#include "cap.h"
+#include "cgroups.h"
+#include "cores.h"
 #include "cpuid.h"
 #include "display.h"
+#include "domain.h"
 #include "main.h"
+#include "metrics.h"
 #include "msr.h"
+#include "output.h"
+#include "record.h"
+#include "run.h"
+#include "shm.h"
+#include "store.h"
+#include "top.h"
 
 
 // --------
@@ -54,7 +64,17 @@ options_t options;
  * Cleans up at program exit.
  */
 void cleanup(void) {
-	close(options.fd);
+	closecap();
+	closeshm();
+	closemetrics();
+	closecgroups();
+	closestore();
+	stoprecord();
+	closecores();
+
+	if (options.backend) {
+		closebackend();
+	}
 }
 
 
@@ -90,14 +110,34 @@ void sighandler(int sig) {
  * Print usage and exit.
  */
 static void usage(void) {
-	printf("Usage: powermon [-d device] [-f family] [-m model] [-t type] [-v vendor]\n\n");
+	printf("Usage: powermon [-b backend] [-d device] [-f family] [-m model] [-t type] [-v vendor]\n");
+	printf("                [-o format] [-i interval] [-n count] [--dram-unit microjoule]\n");
+	printf("                [--listen address:port] [--record file] [--replay file [--fast]]\n");
+	printf("                [--shm name] [--store directory] [--top] [--cgroup directory]\n");
+	printf("                [--cap watts]\n");
+	printf("       powermon [-r runs] [options] -- command [args]\n\n");
 
 	printf("Options:\n");
-	printf(" -d: cpuctl(4) device.\n");
+	printf(" -b: Backend, one of cpuctl, linux, perf, powercap, file or replay.\n");
+	printf(" -d: Device or file used by the backend, one per package.\n");
 	printf(" -f: CPU family.\n");
+	printf(" -i: Output interval in seconds, default 1.\n");
 	printf(" -m: CPU model.\n");
+	printf(" -n: Number of records to output, default unlimited.\n");
+	printf(" -o: Headless output to stdout, either csv or jsonl.\n");
+	printf(" -r: Number of times the command is run, default 1.\n");
 	printf(" -t: CPU type.\n");
 	printf(" -v: CPU vendor.\n");
+	printf(" --cap: Cap the package power of the machine to the given watts.\n");
+	printf(" --cgroup: Account the energy of the cgroups below the directory, needs -o jsonl.\n");
+	printf(" --dram-unit: Energy unit of the DRAM domain in microjoule.\n");
+	printf(" --fast: Replay as fast as possible instead of at real time.\n");
+	printf(" --listen: Serve Prometheus metrics on http://address:port/metrics.\n");
+	printf(" --record: Record the raw samples into the given file.\n");
+	printf(" --replay: Replay a recording instead of reading the MSRs.\n");
+	printf(" --shm: Publish records in the named POSIX shared memory.\n");
+	printf(" --store: Append the power history to compressed files in the given directory.\n");
+	printf(" --top: Show the processes using the most power.\n");
 
 	exit(1);
 }
@@ -107,20 +147,125 @@ static void usage(void) {
  * Parses the command line options and sets defaults.
  */
 static void parse_cmdoption(int argc, char *argv[]) {
+	static const struct option longopts[] = {
+		{ "cap", required_argument, NULL, 'C' },
+		{ "cgroup", required_argument, NULL, 'G' },
+		{ "dram-unit", required_argument, NULL, 'D' },
+		{ "fast", no_argument, NULL, 'F' },
+		{ "listen", required_argument, NULL, 'L' },
+		{ "record", required_argument, NULL, 'R' },
+		{ "replay", required_argument, NULL, 'P' },
+		{ "shm", required_argument, NULL, 'S' },
+		{ "store", required_argument, NULL, 'T' },
+		{ "top", no_argument, NULL, 'U' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	double interval;
 	int32_t ch;
 
-	while ((ch = getopt(argc, argv, "d:f:hm:t:v:")) != -1) {
+	while ((ch = getopt_long(argc, argv, "+b:d:f:hi:m:n:o:r:t:v:", longopts, NULL)) != -1) {
 		switch (ch) {
+			case 'b':
+				if (!(options.backend = getbackend(optarg))) {
+					exit_error(1, "ERROR: Unknown backend %s\n", optarg);
+				}
+				break;
+
+			case 'C':
+				options.cap = strtod(optarg, NULL);
+				options.writable = true;
+
+				if (options.cap <= 0) {
+					exit_error(1, "ERROR: Invalid power cap %s\n", optarg);
+				}
+				break;
+
 			case 'd':
 				options.device = optarg;
 				break;
 
+			case 'D':
+				options.dramunit = strtod(optarg, NULL) / 1000000.0;
+
+				if (options.dramunit <= 0) {
+					exit_error(1, "ERROR: Invalid DRAM unit %s\n", optarg);
+				}
+				break;
+
+			case 'F':
+				options.fast = true;
+				break;
+
+			case 'G':
+				options.cgroup = optarg;
+				break;
+
+			case 'L':
+				options.listen = optarg;
+				break;
+
+			case 'P':
+				options.replay = optarg;
+				options.backend = &backend_replay;
+				break;
+
+			case 'R':
+				options.record = optarg;
+				break;
+
+			case 'S':
+				options.shm = optarg;
+				break;
+
+			case 'T':
+				options.store = optarg;
+				break;
+
+			case 'U':
+				options.top = true;
+				break;
+
 			case 'f':
 				options.cpufamily = optarg;
 				break;
 
+			case 'i':
+				// Check before the conversion, negative
+				// values don't fit into the uint64_t.
+				interval = strtod(optarg, NULL) * 1000000000.0;
+
+				if (!(interval >= 1 && interval < UINT64_MAX)) {
+					exit_error(1, "ERROR: Invalid interval %s\n", optarg);
+				}
+
+				options.interval = interval;
+				break;
+
 			case 'm':
-				strlcpy(options.cpumodel, optarg, sizeof(options.cpumodel));
+				snprintf(options.cpumodel, sizeof(options.cpumodel), "%s", optarg);
+				break;
+
+			case 'n':
+				options.count = strtoull(optarg, NULL, 10);
+				break;
+
+			case 'o':
+				if (!strcmp(optarg, "csv")) {
+					options.output = OUTPUT_CSV;
+				} else if (!strcmp(optarg, "jsonl")) {
+					options.output = OUTPUT_JSONL;
+				} else {
+					exit_error(1, "ERROR: Unknown output format %s\n", optarg);
+				}
+				break;
+
+			case 'r':
+				options.repeat = strtoul(optarg, NULL, 10);
+
+				if (options.repeat == 0) {
+					exit_error(1, "ERROR: Invalid number of runs %s\n", optarg);
+				}
 				break;
 
 			case 't':
@@ -134,7 +279,7 @@ static void parse_cmdoption(int argc, char *argv[]) {
 				break;
 
 			case 'v':
-				strlcpy(options.cpuvendor, optarg, sizeof(options.cpuvendor));
+				snprintf(options.cpuvendor, sizeof(options.cpuvendor), "%s", optarg);
 				break;
 
 			case '?':
@@ -147,15 +292,49 @@ static void parse_cmdoption(int argc, char *argv[]) {
 	argc -= optind;
 	argv += optind;
 
-	if (!options.device) {
-		options.device = "/dev/cpuctl0";
+	if (!options.interval) {
+		options.interval = 1000000000;
 	}
 
-	if ((options.fd = open(options.device, O_RDWR)) == -1) {
-		exit_error(1, "ERROR: Couldn't open %s: %s\n", 
-				options.device, strerror(errno));
+	// Everything left is the command to measure.
+	if (argc > 0) {
+		if (options.replay) {
+			exit_error(1, "%s\n", "ERROR: Can't run a command while replaying");
+		}
+
+		options.command = argv;
 	}
 
+	// Cgroup records have no place in the CSV columns
+	// and a recording has no cgroups to go with it.
+	if (options.cgroup) {
+		if (options.output != OUTPUT_JSONL) {
+			exit_error(1, "%s\n", "ERROR: --cgroup needs -o jsonl");
+		}
+
+		if (options.replay) {
+			exit_error(1, "%s\n", "ERROR: Can't account cgroups while replaying");
+		}
+	}
+
+	// The controller runs in the main loops of the
+	// display and the headless output only.
+	if (options.cap) {
+		if (options.replay) {
+			exit_error(1, "%s\n", "ERROR: Can't cap the power while replaying");
+		}
+
+		if (options.command || options.top) {
+			exit_error(1, "%s\n", "ERROR: --cap can't be used with a command or --top");
+		}
+	}
+
+	if (!options.repeat) {
+		options.repeat = 1;
+	}
+
+	openbackend();
+
 	if (!options.cpufamily) {
 		options.cpufamily = getcpufamily();
 	}
@@ -208,11 +387,12 @@ static void checkcpu(void) {
 /*
  * powermon is a top-like tool to show realtime power statistics.
  * The data is retrieved from the RAPL interface, exposed through
- * MSR. Only Intel CPUs starting with Sandy Bridge support the
- * interface, other models and vendors are not supported. Client
- * aka desktop CPUs expose the GPU power consumption, server CPUs
- * and it's derivates (for example Socket 2011 desktop models)
- * the DRAM power consumtion instead.
+ * MSR. They're accessed through a backend, see msr.h. Only Intel
+ * CPUs starting with Sandy Bridge support the interface, other
+ * models and vendors are not supported. Client aka desktop CPUs
+ * expose the GPU power consumption, server CPUs and it's
+ * derivates (for example Socket 2011 desktop models) the DRAM
+ * power consumtion instead.
  *
  * All the user needs to do is to start the program with 'powermon'.
  * The command line options are only necessary if the tools in not
@@ -226,14 +406,6 @@ int main(int argc, char *argv[]) {
 	signal(SIGTERM, sighandler);
 
 
-	// If cpuctl(4) isn't loaded there's nothing we could do.
-	struct stat sb;
-
-	if (stat("/dev/cpuctl0", &sb) != 0) {
-		exit_error(1, "%s\n", "ERROR: cpuctl(4) isn't available. Sorry.");
-	}
-
-
 	// Parse options.
 	parse_cmdoption(argc, argv);
 
@@ -242,8 +414,43 @@ int main(int argc, char *argv[]) {
 	checkcpu();
 
 
-	// Setup curses an start the main loop.
-	display();
+	// Find the RAPL domains.
+	initdomains();
+
+
+	// Take over the power limits.
+	if (options.cap) {
+		opencap(options.cap);
+	}
+
+
+	// Record the samples.
+	if (options.record) {
+		startrecord(options.record);
+	}
+
+
+	// Store the power history.
+	if (options.store) {
+		openstore(options.store);
+	}
+
+
+	// Measure a command.
+	if (options.command) {
+		return runcommand();
+	}
+
+
+	// Setup curses an start the main loop, or
+	// write records without any interface.
+	if (options.top) {
+		top();
+	} else if (options.output || options.shm || options.listen || options.store) {
+		output();
+	} else {
+		display();
+	}
 
 
 	// Regular exit.
@@ -31,6 +31,23 @@
 // --------
 
 
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// --------
+
+
+// Maximum number of packages / sockets.
+#define MAX_PACKAGES 16
+
+// Maximum number of logical CPUs.
+#define MAX_CPUS 1024
+
+
+// --------
+
+
 // CPU types.
 typedef enum cputype_e {
 	CLIENT = 0,
@@ -40,13 +57,30 @@ typedef enum cputype_e {
 } cputype_e;
 
 
+// Headless output formats.
+typedef enum outputformat_e {
+	OUTPUT_NONE = 0,
+	OUTPUT_CSV,
+	OUTPUT_JSONL
+} outputformat_e;
+
+
 // Options given at command line.
 typedef struct options_t {
-	// cpuctl device to operate on.
+	// Backend used to access the MSRs.
+	const struct backend_t *backend;
+
+	// Device(s) given at command line.
 	const char *device;
 
-	// FD to cpuctl device.
-	int32_t fd;
+	// Number of packages.
+	uint32_t packages;
+
+	// Device, FD and one CPU of each package.
+	// The CPU is -1 if it's unknown.
+	const char *devices[MAX_PACKAGES];
+	int32_t fds[MAX_PACKAGES];
+	int32_t cpus[MAX_PACKAGES];
 
 	// CPU family string.
 	const char *cpufamily;
@@ -60,6 +94,64 @@ typedef struct options_t {
 	// CPU model
 	char cpumodel[49];
 
+	// DRAM energy unit in joule given at
+	// command line, 0 if none was given.
+	double dramunit;
+
+	// Headless output format, OUTPUT_NONE
+	// for the curses interface.
+	outputformat_e output;
+
+	// Headless output interval in nanoseconds.
+	uint64_t interval;
+
+	// Number of headless records, 0 for no limit.
+	uint64_t count;
+
+	// Shared memory the headless records are
+	// published in, NULL for none.
+	const char *shm;
+
+	// Address the metrics are served on,
+	// NULL for none.
+	const char *listen;
+
+	// Recording written, NULL for none.
+	const char *record;
+
+	// Directory of the time series
+	// store, NULL for none.
+	const char *store;
+
+	// Root of the cgroups whose energy is
+	// accounted, NULL for none.
+	const char *cgroup;
+
+	// Recording replayed, NULL for none.
+	const char *replay;
+
+	// If set the recording is replayed as
+	// fast as possible, else at real time.
+	bool fast;
+
+	// Command to measure and it's arguments,
+	// NULL terminated. NULL for none.
+	char **command;
+
+	// Number of times the command is run.
+	uint32_t repeat;
+
+	// Package power the controller caps the
+	// machine to in watts, 0 for none.
+	double cap;
+
+	// If set the backends open the package
+	// devices for writing.
+	bool writable;
+
+	// If set the process list is shown.
+	bool top;
+
 	// If set the mainloop is broken.
 	uint32_t stop;
 } options_t;
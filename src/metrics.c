@@ -0,0 +1,783 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Prometheus endpoint. A single threaded event loop, epoll(7) on
+ * Linux and kqueue(2) on FreeBSD, accepts scrapes while the main
+ * thread waits for the next interval. The page served on /metrics
+ * is rebuilt once per interval, each scrape is answered from the
+ * prebuilt page. Pages are reference counted, a slow client keeps
+ * it's page while the next one is built.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#if defined(__FreeBSD__)
+#include <sys/event.h>
+#include <sys/time.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include "budget.h"
+#include "domain.h"
+#include "limits.h"
+#include "main.h"
+#include "metrics.h"
+#include "rollup.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Maximum number of concurrent connections.
+#define METRICS_CONNECTIONS 64
+
+// Maximum size of a request.
+#define METRICS_REQUEST 2048
+
+// Connections idle for longer are closed, in nanoseconds.
+#define METRICS_TIMEOUT (UINT64_C(5) * 1000 * 1000 * 1000)
+
+// Maximum size of the /metrics body.
+#define METRICS_BODY (64 * 1024)
+
+// Events handled per wakeup.
+#define METRICS_EVENTS 16
+
+
+// --------
+
+
+/*
+ * A prebuilt response.
+ */
+typedef struct page_t {
+	// Connections sending the page, plus
+	// one while it's the current page.
+	uint32_t refs;
+
+	// Size of data.
+	size_t size;
+
+	// The HTTP response.
+	char data[];
+} page_t;
+
+
+/*
+ * A client connection.
+ */
+typedef struct connection_t {
+	// Socket, -1 if the slot is unused.
+	int32_t fd;
+
+	// Time of the last activity.
+	uint64_t since;
+
+	// The request received so far.
+	char request[METRICS_REQUEST];
+	size_t len;
+
+	// Page sent, NULL for a static response.
+	page_t *page;
+
+	// Response to send.
+	const char *response;
+	size_t size;
+	size_t sent;
+} connection_t;
+
+
+// --------
+
+
+// Response to unknown paths.
+static const char notfound[] =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Type: text/plain\r\n"
+	"Content-Length: 10\r\n"
+	"Connection: close\r\n\r\n"
+	"Not Found\n";
+
+// Response to invalid requests.
+static const char badrequest[] =
+	"HTTP/1.1 400 Bad Request\r\n"
+	"Content-Type: text/plain\r\n"
+	"Content-Length: 12\r\n"
+	"Connection: close\r\n\r\n"
+	"Bad Request\n";
+
+// Response until the first sample arrives.
+static const char unavailable[] =
+	"HTTP/1.1 503 Service Unavailable\r\n"
+	"Content-Type: text/plain\r\n"
+	"Content-Length: 20\r\n"
+	"Connection: close\r\n\r\n"
+	"No sample taken yet\n";
+
+// Listening socket, -1 if closed.
+static int32_t listener = -1;
+
+// epoll or kqueue FD.
+static int32_t poller = -1;
+
+// Client connections.
+static connection_t connections[METRICS_CONNECTIONS];
+
+// Page served on /metrics, NULL until the first sample.
+static page_t *current;
+
+// Limits of each package, they never change.
+static powerlimits_t limits[MAX_PACKAGES];
+
+// Body of the page while it's built.
+static char body[METRICS_BODY];
+
+
+// --------
+
+
+/*
+ * Registers the given socket with the poller, or changes
+ * it's registration. Either reading or writing is polled.
+ *
+ *  - fd: Socket to register.
+ *  - ptr: Returned by pollerwait() for the socket.
+ *  - write: Poll for writing instead of reading.
+ *  - add: The socket is new.
+ */
+static void pollerset(int32_t fd, void *ptr, bool write, bool add) {
+#if defined(__FreeBSD__)
+	struct kevent ev[2];
+	int32_t count = 0;
+
+	if (write) {
+		EV_SET(&ev[count++], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+		EV_SET(&ev[count++], fd, EVFILT_WRITE, EV_ADD, 0, 0, ptr);
+	} else {
+		EV_SET(&ev[count++], fd, EVFILT_READ, EV_ADD, 0, 0, ptr);
+	}
+
+	kevent(poller, ev, count, NULL, 0, NULL);
+#elif defined(__linux__)
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = write ? EPOLLOUT : EPOLLIN;
+	ev.data.ptr = ptr;
+
+	epoll_ctl(poller, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+#endif
+}
+
+
+/*
+ * Waits for sockets getting ready. Returns the number
+ * of ready sockets or -1 on error.
+ *
+ *  - ptrs: Filled with the pointers given to pollerset().
+ *  - max: Maximum number of sockets to return.
+ *  - timeout: Maximum time to wait in milliseconds.
+ */
+static int32_t pollerwait(void **ptrs, int32_t max, int32_t timeout) {
+#if defined(__FreeBSD__)
+	struct kevent ev[METRICS_EVENTS];
+	struct timespec ts;
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	int32_t count = kevent(poller, NULL, 0, ev, max, &ts);
+
+	for (int32_t i = 0; i < count; i++) {
+		ptrs[i] = ev[i].udata;
+	}
+#elif defined(__linux__)
+	struct epoll_event ev[METRICS_EVENTS];
+
+	int32_t count = epoll_wait(poller, ev, max, timeout);
+
+	for (int32_t i = 0; i < count; i++) {
+		ptrs[i] = ev[i].data.ptr;
+	}
+#endif
+
+	return count;
+}
+
+
+// --------
+
+
+/*
+ * Drops one reference to the given page.
+ *
+ *  - page: Page to release.
+ */
+static void releasepage(page_t *page) {
+	if (page && --page->refs == 0) {
+		free(page);
+	}
+}
+
+
+/*
+ * Closes the given connection.
+ *
+ *  - conn: Connection to close.
+ */
+static void closeconnection(connection_t *conn) {
+	close(conn->fd);
+	releasepage(conn->page);
+
+	conn->fd = -1;
+	conn->page = NULL;
+}
+
+
+/*
+ * Accepts all pending connections.
+ *
+ *  - now: Current time.
+ */
+static void acceptconnections(uint64_t now) {
+	int32_t fd;
+
+	while ((fd = accept(listener, NULL, NULL)) != -1) {
+		connection_t *conn = NULL;
+
+		for (uint32_t i = 0; i < METRICS_CONNECTIONS; i++) {
+			if (connections[i].fd == -1) {
+				conn = &connections[i];
+				break;
+			}
+		}
+
+		// Too many clients.
+		if (!conn) {
+			close(fd);
+			continue;
+		}
+
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+		conn->fd = fd;
+		conn->since = now;
+		conn->len = 0;
+		conn->page = NULL;
+		conn->response = NULL;
+		conn->size = 0;
+		conn->sent = 0;
+
+		pollerset(fd, conn, false, true);
+	}
+}
+
+
+/*
+ * Selects the response once the request is complete.
+ *
+ *  - conn: Connection to respond to.
+ */
+static void respond(connection_t *conn) {
+	if (!strncmp(conn->request, "GET /metrics ", 13)
+			|| !strncmp(conn->request, "GET /metrics?", 13)) {
+		if (current) {
+			conn->page = current;
+			conn->page->refs++;
+			conn->response = current->data;
+			conn->size = current->size;
+		} else {
+			conn->response = unavailable;
+			conn->size = sizeof(unavailable) - 1;
+		}
+	} else if (!strncmp(conn->request, "GET ", 4)) {
+		conn->response = notfound;
+		conn->size = sizeof(notfound) - 1;
+	} else {
+		conn->response = badrequest;
+		conn->size = sizeof(badrequest) - 1;
+	}
+
+	pollerset(conn->fd, conn, true, false);
+}
+
+
+/*
+ * Reads the request or sends the response.
+ *
+ *  - conn: Ready connection.
+ *  - now: Current time.
+ */
+static void handleconnection(connection_t *conn, uint64_t now) {
+	ssize_t ret;
+
+	if (conn->fd == -1) {
+		return;
+	}
+
+	conn->since = now;
+
+	if (!conn->response) {
+		ret = read(conn->fd, conn->request + conn->len,
+				sizeof(conn->request) - conn->len - 1);
+
+		if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EINTR)) {
+			closeconnection(conn);
+			return;
+		} else if (ret == -1) {
+			return;
+		}
+
+		conn->len += ret;
+		conn->request[conn->len] = '\0';
+
+		// We only care about the request line, but
+		// the client expects us to read the headers.
+		if (!strstr(conn->request, "\r\n\r\n")) {
+			if (conn->len == sizeof(conn->request) - 1) {
+				conn->request[0] = '\0';
+				respond(conn);
+			}
+
+			return;
+		}
+
+		respond(conn);
+	}
+
+	ret = write(conn->fd, conn->response + conn->sent, conn->size - conn->sent);
+
+	if (ret == -1) {
+		if (errno != EAGAIN && errno != EINTR) {
+			closeconnection(conn);
+		}
+
+		return;
+	}
+
+	conn->sent += ret;
+
+	if (conn->sent == conn->size) {
+		closeconnection(conn);
+	}
+}
+
+
+/*
+ * Appends a formatted string to the body.
+ *
+ *  - used: Bytes used in the body, updated.
+ *  - fmt: Format of the string.
+ *  - ...: Argument list.
+ */
+static void append(size_t *used, const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	int ret = vsnprintf(body + *used, sizeof(body) - *used, fmt, vl);
+	va_end(vl);
+
+	if (ret > 0) {
+		*used += ((size_t)ret < sizeof(body) - *used) ? (size_t)ret
+			: sizeof(body) - *used - 1;
+	}
+}
+
+
+/*
+ * Appends one value for each package and domain.
+ *
+ *  - used: Bytes used in the body, updated.
+ *  - metric: Name of the metric.
+ *  - values: Values of each package.
+ */
+static void appenddomains(size_t *used, const char *metric,
+		const energy_t *values) {
+	for (uint32_t p = 0; p < options.packages; p++) {
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			// Platform wide domains are sampled once.
+			if (!domains[i].present || (domains[i].platform && p != 0)) {
+				continue;
+			}
+
+			append(used, "%s{package=\"%u\",domain=\"%s\"} %.6f\n", metric,
+					p, domains[i].key, values[p].domain[i]);
+		}
+	}
+}
+
+
+/*
+ * Appends one value for each package and throttling counter.
+ *
+ *  - used: Bytes used in the body, updated.
+ *  - metric: Name of the metric.
+ *  - values: Values of each package.
+ */
+static void appendthrottles(size_t *used, const char *metric,
+		const throttled_t *values) {
+	for (uint32_t p = 0; p < options.packages; p++) {
+		for (uint32_t i = 0; i < THROTTLES; i++) {
+			if (!throttles[i].present) {
+				continue;
+			}
+
+			append(used, "%s{package=\"%u\",domain=\"%s\"} %.6f\n", metric,
+					p, throttles[i].key, values[p].throttle[i]);
+		}
+	}
+}
+
+
+/*
+ * Appends mean, minimum and maximum power of the last
+ * complete period of each resolution. Resolutions that
+ * haven't completed a period yet are left out.
+ *
+ *  - used: Bytes used in the body, updated.
+ */
+static void appendrollups(size_t *used) {
+	const char *windows[RESOLUTIONS] = { "1s", "1m", "1h" };
+
+	for (uint32_t r = 0; r < RESOLUTIONS; r++) {
+		rollup_t rollup;
+
+		if (!getrollups(r, &rollup, 1)) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			if (!domains[i].present) {
+				continue;
+			}
+
+			append(used, "powermon_rollup_power_watts{window=\"%s\",stat=\"mean\",domain=\"%s\"} %.6f\n",
+					windows[r], domains[i].key, rollup.energy[i] / rollup.time);
+			append(used, "powermon_rollup_power_watts{window=\"%s\",stat=\"min\",domain=\"%s\"} %.6f\n",
+					windows[r], domains[i].key, rollup.min[i]);
+			append(used, "powermon_rollup_power_watts{window=\"%s\",stat=\"max\",domain=\"%s\"} %.6f\n",
+					windows[r], domains[i].key, rollup.max[i]);
+		}
+	}
+}
+
+
+// --------
+
+
+/*
+ * Starts listening.
+ */
+void openmetrics(const char *address) {
+	struct addrinfo hints;
+	struct addrinfo *res;
+	char host[256];
+
+	// Split into host and port.
+	snprintf(host, sizeof(host), "%s", address);
+	char *port = strrchr(host, ':');
+
+	if (!port) {
+		exit_error(1, "ERROR: Invalid address %s, use host:port\n", address);
+	}
+
+	*port++ = '\0';
+
+	char *name = host;
+
+	if (name[0] == '[' && name[strlen(name) - 1] == ']') {
+		name[strlen(name) - 1] = '\0';
+		name++;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	int32_t ret = getaddrinfo(strlen(name) ? name : NULL, port, &hints, &res);
+
+	if (ret) {
+		exit_error(1, "ERROR: Couldn't resolve %s: %s\n", address, gai_strerror(ret));
+	}
+
+	for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+		int32_t on = 1;
+
+		if ((listener = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == -1) {
+			continue;
+		}
+
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if (bind(listener, ai->ai_addr, ai->ai_addrlen) == 0
+				&& listen(listener, METRICS_CONNECTIONS) == 0) {
+			break;
+		}
+
+		close(listener);
+		listener = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if (listener == -1) {
+		exit_error(1, "ERROR: Couldn't listen on %s: %s\n", address, strerror(errno));
+	}
+
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+#if defined(__FreeBSD__)
+	poller = kqueue();
+#elif defined(__linux__)
+	poller = epoll_create1(0);
+#endif
+
+	if (poller == -1) {
+		exit_error(1, "ERROR: Couldn't create poller: %s\n", strerror(errno));
+	}
+
+	for (uint32_t i = 0; i < METRICS_CONNECTIONS; i++) {
+		connections[i].fd = -1;
+	}
+
+	pollerset(listener, &listener, false, true);
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		getpowerlimits(p, &limits[p]);
+	}
+}
+
+
+/*
+ * Rebuilds the page.
+ */
+void updatemetrics(const energy_t *power, const energy_t *total,
+		const throttled_t *throttled, const throttled_t *throttledtotal,
+		const uint64_t *missed) {
+	size_t used = 0;
+
+	append(&used, "%s", "# HELP powermon_energy_joules_total Energy consumed since start.\n");
+	append(&used, "%s", "# TYPE powermon_energy_joules_total counter\n");
+	appenddomains(&used, "powermon_energy_joules_total", total);
+
+	append(&used, "%s", "# HELP powermon_power_watts Current power consumption.\n");
+	append(&used, "%s", "# TYPE powermon_power_watts gauge\n");
+	appenddomains(&used, "powermon_power_watts", power);
+
+	append(&used, "%s", "# HELP powermon_throttled_seconds_total Time throttled to enforce a power limit since start.\n");
+	append(&used, "%s", "# TYPE powermon_throttled_seconds_total counter\n");
+	appendthrottles(&used, "powermon_throttled_seconds_total", throttledtotal);
+
+	append(&used, "%s", "# HELP powermon_throttled_percent Share of the last interval throttled to enforce a power limit.\n");
+	append(&used, "%s", "# TYPE powermon_throttled_percent gauge\n");
+	appendthrottles(&used, "powermon_throttled_percent", throttled);
+
+	append(&used, "%s", "# HELP powermon_rollup_power_watts Machine power over the last complete window.\n");
+	append(&used, "%s", "# TYPE powermon_rollup_power_watts gauge\n");
+	appendrollups(&used);
+
+	append(&used, "%s", "# HELP powermon_power_limit_watts Power limits from PKG_INFO.\n");
+	append(&used, "%s", "# TYPE powermon_power_limit_watts gauge\n");
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		// Unknown limits are left out.
+		const struct {
+			const char *name;
+			double value;
+		} values[3] = {
+			{ "thermal_spec", limits[p].thermal_spec_power },
+			{ "minimum", limits[p].minimum_power },
+			{ "maximum", limits[p].maximum_power }
+		};
+
+		for (uint32_t i = 0; i < 3; i++) {
+			if (values[i].value > 0) {
+				append(&used, "powermon_power_limit_watts{package=\"%u\",limit=\"%s\"} %.3f\n",
+						p, values[i].name, values[i].value);
+			}
+		}
+	}
+
+	append(&used, "%s", "# HELP powermon_package_limit_watts Power limits PL1 and PL2 from PKG_LIMIT.\n");
+	append(&used, "%s", "# TYPE powermon_package_limit_watts gauge\n");
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		budget_t budget;
+
+		if (!getbudget(p, &budget)) {
+			continue;
+		}
+
+		append(&used, "powermon_package_limit_watts{package=\"%u\",limit=\"pl1\",window=\"%g\"} %.3f\n",
+				p, budget.limits.window1, budget.limits.pl1);
+
+		if (budget.limits.pl2 > 0) {
+			append(&used, "powermon_package_limit_watts{package=\"%u\",limit=\"pl2\",window=\"%g\"} %.3f\n",
+					p, budget.limits.window2, budget.limits.pl2);
+		}
+	}
+
+	append(&used, "%s", "# HELP powermon_turbo_budget_joules Energy above PL1 left before PL1 clamps.\n");
+	append(&used, "%s", "# TYPE powermon_turbo_budget_joules gauge\n");
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		budget_t budget;
+
+		if (getbudget(p, &budget)) {
+			append(&used, "powermon_turbo_budget_joules{package=\"%u\"} %.3f\n", p, budget.energy);
+		}
+	}
+
+	// Left out while the current power doesn't lead to a clamp.
+	append(&used, "%s", "# HELP powermon_pl1_clamp_seconds Predicted time until PL1 clamps at the current power.\n");
+	append(&used, "%s", "# TYPE powermon_pl1_clamp_seconds gauge\n");
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		budget_t budget;
+
+		if (getbudget(p, &budget) && budget.seconds >= 0) {
+			append(&used, "powermon_pl1_clamp_seconds{package=\"%u\"} %.3f\n", p, budget.seconds);
+		}
+	}
+
+	append(&used, "%s", "# HELP powermon_missed_samples_total Sampling deadlines missed.\n");
+	append(&used, "%s", "# TYPE powermon_missed_samples_total counter\n");
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		append(&used, "powermon_missed_samples_total{package=\"%u\"} %" PRIu64 "\n", p, missed[p]);
+	}
+
+	// Headers and body in one piece, a scrape is a single write.
+	char header[256];
+	int32_t len = snprintf(header, sizeof(header),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", used);
+
+	page_t *page = malloc(sizeof(page_t) + len + used);
+
+	if (!page) {
+		return;
+	}
+
+	memcpy(page->data, header, len);
+	memcpy(page->data + len, body, used);
+	page->size = len + used;
+	page->refs = 1;
+
+	releasepage(current);
+	current = page;
+}
+
+
+/*
+ * Serves scrapes.
+ */
+bool servemetrics(uint64_t deadline) {
+	for (;;) {
+		if (options.stop) {
+			return false;
+		}
+
+		uint64_t now = gettime();
+
+		if (now >= deadline) {
+			return true;
+		}
+
+		// Drop idle clients.
+		for (uint32_t i = 0; i < METRICS_CONNECTIONS; i++) {
+			if (connections[i].fd != -1 && now - connections[i].since > METRICS_TIMEOUT) {
+				closeconnection(&connections[i]);
+			}
+		}
+
+		void *ready[METRICS_EVENTS];
+		int32_t count = pollerwait(ready, METRICS_EVENTS,
+				(deadline - now + 999999) / 1000000);
+
+		if (count == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			exit_error(1, "ERROR: Couldn't wait for clients: %s\n", strerror(errno));
+		}
+
+		now = gettime();
+
+		for (int32_t i = 0; i < count; i++) {
+			if (ready[i] == &listener) {
+				acceptconnections(now);
+			} else {
+				handleconnection(ready[i], now);
+			}
+		}
+	}
+}
+
+
+/*
+ * Closes everything.
+ */
+void closemetrics(void) {
+	if (listener == -1) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < METRICS_CONNECTIONS; i++) {
+		if (connections[i].fd != -1) {
+			closeconnection(&connections[i]);
+		}
+	}
+
+	releasepage(current);
+	current = NULL;
+
+	close(poller);
+	close(listener);
+
+	poller = -1;
+	listener = -1;
+}
+
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sampler.h"
+
+
+// --------
+
+
+/*
+ * Starts listening for scrapes on the given address. Aborts
+ * the program on error.
+ *
+ *  - address: Address and port, e.g. 127.0.0.1:9100,
+ *             [::1]:9100 or :9100 for all addresses.
+ */
+void openmetrics(const char *address);
+
+
+/*
+ * Rebuilds the page served on /metrics. Called once per
+ * new sample, scrapes in between are served from the
+ * prebuilt page.
+ *
+ *  - power: Power of each package in watts.
+ *  - total: Energy of each package since start in joule.
+ *  - throttled: Share of the interval each package was
+ *               throttled in percent.
+ *  - throttledtotal: Seconds each package was throttled
+ *                    since start.
+ *  - missed: Missed samples of each package.
+ */
+void updatemetrics(const energy_t *power, const energy_t *total,
+		const throttled_t *throttled, const throttled_t *throttledtotal,
+		const uint64_t *missed);
+
+
+/*
+ * Serves scrapes until the given CLOCK_MONOTONIC time.
+ * Returns false if interrupted by a signal that breaks
+ * the main loop.
+ *
+ *  - deadline: Time to return at in nanoseconds.
+ */
+bool servemetrics(uint64_t deadline);
+
+
+/*
+ * Closes the listening socket and all connections.
+ */
+void closemetrics(void);
+
+
+// --------
+
+#endif // METRICS_H_
+
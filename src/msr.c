@@ -24,12 +24,13 @@
  * SUCH DAMAGE.
  */ 
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <sys/cpuctl.h>
+#include <string.h>
 #include <sys/errno.h>
-#include <sys/ioctl.h>
 
 #include "main.h"
 #include "msr.h"
@@ -38,42 +39,310 @@
 // --------
 
 
+// All backends known to us. The first usable one is the default.
+static const backend_t *backends[] = {
+#ifdef __FreeBSD__
+	&backend_cpuctl,
+#endif
+#ifdef __linux__
+	&backend_linux,
+	&backend_perf,
+	&backend_powercap,
+#endif
+	&backend_file,
+	&backend_replay,
+	NULL
+};
+
+// Serializes the access to the device of each package. The
+// backends keep per device state, e.g. a submission ring,
+// and the samplers share the devices with the main thread.
+static pthread_mutex_t devicelocks[MAX_PACKAGES];
+
+
+// --------
+
+
 /*
- * Checks if the given MSR exists.
+ * Returns the backend with the given name or
+ * NULL if there's no such backend.
  *
- * - msr: MSR to check.
+ *  - name: Name of the backend.
  */
-bool checkmsr(int32_t msr) {
-	cpuctl_msr_args_t args;
+const backend_t *getbackend(const char *name) {
+	for (size_t i = 0; backends[i]; i++) {
+		if (!strcmp(backends[i]->name, name)) {
+			return backends[i];
+		}
+	}
 
-	args.msr = msr;
+	return NULL;
+}
 
-	if (ioctl(options.fd, CPUCTL_RDMSR, &args) == -1)
-	{
-		return false;
+
+/*
+ * Determines the devices of all packages and opens them. The
+ * devices are either given at command line, separated by
+ * commas, or queried from the backend. Returns false if the
+ * first device couldn't be opened, later failures are fatal.
+ *
+ *  - backend: Backend to use.
+ */
+static bool openpackages(const backend_t *backend) {
+	static char names[MAX_PACKAGES][256];
+	uint32_t packages = 0;
+	int32_t cpu;
+
+	if (options.device) {
+		char *list = strdup(options.device);
+
+		for (char *device = strtok(list, ","); device && packages < MAX_PACKAGES;
+				device = strtok(NULL, ",")) {
+			options.devices[packages] = device;
+			options.cpus[packages] = -1;
+			packages++;
+		}
+	} else if (backend->package) {
+		while (packages < MAX_PACKAGES && backend->package(packages,
+					names[packages], sizeof(names[packages]), &cpu)) {
+			options.devices[packages] = names[packages];
+			options.cpus[packages] = cpu;
+			packages++;
+		}
+	}
+
+	// Fall back to the default device.
+	if (!packages) {
+		if (!(options.devices[0] = backend->device)) {
+			return false;
+		}
+
+		options.cpus[0] = -1;
+		packages = 1;
 	}
 
+	for (uint32_t i = 0; i < packages; i++) {
+		if ((options.fds[i] = backend->open(options.devices[i])) == -1) {
+			if (i == 0) {
+				return false;
+			}
+
+			exit_error(1, "ERROR: Couldn't open %s: %s\n",
+					options.devices[i], strerror(errno));
+		}
+	}
+
+	for (uint32_t i = 0; i < packages; i++) {
+		pthread_mutex_init(&devicelocks[i], NULL);
+	}
+
+	options.backend = backend;
+	options.packages = packages;
+
 	return true;
 }
 
 
 /*
- * Reads the given MSR and returns it's data.
+ * Opens the devices of the backend given in options, one for
+ * each package. If no backend was given all backends usable
+ * on this system are tried in order, the first one that can
+ * be opened is used. Sets options.backend, options.packages,
+ * options.devices, options.fds and options.cpus.
+ */
+void openbackend(void) {
+	if (options.backend) {
+		if (!openpackages(options.backend)) {
+			if (!options.devices[0]) {
+				exit_error(1, "ERROR: Backend %s needs a device, specify with -d.\n",
+						options.backend->name);
+			}
+
+			exit_error(1, "ERROR: Couldn't open %s: %s\n",
+					options.devices[0], strerror(errno));
+		}
+
+		return;
+	}
+
+	for (size_t i = 0; backends[i]; i++) {
+		if (backends[i]->probe() && openpackages(backends[i])) {
+			return;
+		}
+	}
+
+	exit_error(1, "%s\n", "ERROR: Neither cpuctl(4), msr(4), the power PMU nor powercap are usable. Sorry.");
+}
+
+
+/*
+ * Closes all devices opened by openbackend().
+ */
+void closebackend(void) {
+	for (uint32_t i = options.packages; i > 0; i--) {
+		options.backend->close(options.fds[i - 1]);
+		pthread_mutex_destroy(&devicelocks[i - 1]);
+	}
+
+	options.packages = 0;
+}
+
+
+/*
+ * Checks if the given MSR exists. Only the
+ * first package is checked.
+ *
+ * - msr: MSR to check.
+ */
+bool checkmsr(int32_t msr) {
+	uint64_t data;
+
+	pthread_mutex_lock(&devicelocks[0]);
+	bool exists = options.backend->read(options.fds[0], msr, &data);
+	pthread_mutex_unlock(&devicelocks[0]);
+
+	return exists;
+}
+
+
+/*
+ * Reads the given MSR of the first
+ * package and returns it's data.
  *
  *  - msr: MSR to read.
  */
 uint64_t getmsr(int32_t msr) {
-	cpuctl_msr_args_t args;
+	uint64_t data;
 
-	args.msr = msr;
+	pthread_mutex_lock(&devicelocks[0]);
+	bool valid = options.backend->read(options.fds[0], msr, &data);
+	pthread_mutex_unlock(&devicelocks[0]);
 
-	if (ioctl(options.fd, CPUCTL_RDMSR, &args) == -1)
+	if (!valid)
 	{
-		exit_error(1, "ERROR: ioctl CPUCTL_RDMSR failed: %i\n", errno);
+		exit_error(1, "ERROR: Couldn't read MSR 0x%x: %s\n", msr, strerror(errno));
 	}
 
-	return args.data;
+	return data;
 }
 
-// --------
 
+/*
+ * Reads several MSRs of the given package at once. This is
+ * cheaper than calling getmsr() for each of them, since the
+ * backend may submit all reads with just one syscall.
+ *
+ *  - package: Package to read from.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs data, same order as msrs.
+ *  - count: Number of MSRs.
+ */
+void getmsrs(uint32_t package, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+	int32_t fd = options.fds[package];
+	size_t n = 0;
+	bool batched = options.backend->readbatch != NULL;
+
+	pthread_mutex_lock(&devicelocks[package]);
+
+	if (batched) {
+		n = options.backend->readbatch(fd, msrs, data, count) ? count : 0;
+	} else {
+		while (n < count && options.backend->read(fd, msrs[n], &data[n])) {
+			n++;
+		}
+	}
+
+	pthread_mutex_unlock(&devicelocks[package]);
+
+	if (n < count) {
+		if (batched) {
+			exit_error(1, "ERROR: Couldn't read %zu MSRs: %s\n", count, strerror(errno));
+		}
+
+		exit_error(1, "ERROR: Couldn't read MSR 0x%x: %s\n", msrs[n], strerror(errno));
+	}
+}
+
+
+/*
+ * Writes the given MSR of the given package.
+ *
+ *  - package: Package to write to.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+bool setmsr(uint32_t package, int32_t msr, uint64_t data) {
+	if (!options.backend->write) {
+		errno = EROFS;
+		return false;
+	}
+
+	pthread_mutex_lock(&devicelocks[package]);
+	bool written = options.backend->write(options.fds[package], msr, data);
+	pthread_mutex_unlock(&devicelocks[package]);
+
+	return written;
+}
+
+
+/*
+ * Opens the devices of the CPUs of the given package.
+ *
+ *  - package: Package whose CPUs are opened.
+ *  - fds: Filled with a FD for each CPU.
+ *  - cpus: Filled with the number of each CPU.
+ *  - max: Maximum number of CPUs.
+ */
+uint32_t opencpus(uint32_t package, int32_t *fds, int32_t *cpus, uint32_t max) {
+	uint32_t n = 0;
+
+	if (!options.backend->opencpu) {
+		return 0;
+	}
+
+	while (n < max && (fds[n] = options.backend->opencpu(package, n, &cpus[n])) != -1) {
+		n++;
+	}
+
+	return n;
+}
+
+
+/*
+ * Reads MSRs of several CPUs.
+ *
+ *  - fds: FD of the CPU of each MSR, as returned by opencpus().
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs data, same order as msrs.
+ *  - count: Number of MSRs.
+ */
+bool getcpumsrs(const int32_t *fds, const int32_t *msrs, uint64_t *data,
+		size_t count) {
+	if (options.backend->readcpus) {
+		return options.backend->readcpus(fds, msrs, data, count);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (!options.backend->read(fds[i], msrs[i], &data[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * Closes the devices of the CPUs.
+ *
+ *  - fds: FDs of the CPUs.
+ *  - nfds: Number of CPUs.
+ */
+void closecpus(const int32_t *fds, size_t nfds) {
+	for (size_t c = 0; c < nfds; c++) {
+		options.backend->close(fds[c]);
+	}
+}
+
+// --------
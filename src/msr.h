@@ -68,6 +68,7 @@
 
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
@@ -147,6 +148,27 @@
 // --------
 
 
+// Power consumption of the whole platform (SoC and
+// chipset) since reboot or register wrap around.
+#define PLATFORM_STATUS 0x64d
+
+
+// --------
+
+
+// Time stamp counter, counts at a constant rate.
+#define TSC_COUNTER 0x10
+
+// Counts at the TSC rate while the CPU is in C0.
+#define MPERF_COUNTER 0xe7
+
+// Counts at the actual frequency while the CPU is in C0.
+#define APERF_COUNTER 0xe8
+
+
+// --------
+
+
 // *_LIMIT MSR structure (PP0, PP1 and DRAM).
 typedef struct limit_msr_t {
 	uint64_t power_limit         : 15;
@@ -222,23 +244,210 @@ typedef struct unit_msr_t {
 // --------
 
 
+// Backend used to access the MSRs and the CPUID. Each operating
+// system has it's own interface, additionally there's a file based
+// backend for running without root privileges or real hardware.
+typedef struct backend_t {
+	// Name of the backend, as given to -b.
+	const char *name;
+
+	// Default device, NULL if there's none.
+	const char *device;
+
+	// True if the *_STATUS MSRs are emulated from counters
+	// the kernel already scaled, so all domains share the
+	// emulated energy unit.
+	bool emulated;
+
+	// Returns true if the backend is usable on this system.
+	bool (*probe)(void);
+
+	// Opens the given device and returns a FD or -1.
+	int32_t (*open)(const char *device);
+
+	// Reads the given MSR into data. Returns false if the
+	// MSR doesn't exist or couldn't be read.
+	bool (*read)(int32_t fd, int32_t msr, uint64_t *data);
+
+	// Reads count MSRs given in msrs into data, using as few
+	// syscalls as possible. Returns false if any of the MSRs
+	// couldn't be read. If NULL, read() is called for each MSR.
+	bool (*readbatch)(int32_t fd, const int32_t *msrs, uint64_t *data,
+			size_t count);
+
+	// Writes data into the given MSR. The device must have been
+	// opened with options.writable set. Returns false if the MSR
+	// doesn't exist or couldn't be written. NULL if the backend
+	// is read only.
+	bool (*write)(int32_t fd, int32_t msr, uint64_t data);
+
+	// Queries the given CPUID leaf. EAX, EBX, ECX and EDX are
+	// written to data. Returns false on error.
+	bool (*cpuid)(int32_t fd, uint32_t level, uint32_t level_type,
+			uint32_t data[4]);
+
+	// Closes the given FD.
+	void (*close)(int32_t fd);
+
+	// Writes the device of the given package into device and
+	// the number of a CPU belonging to it into cpu. Returns false
+	// if there's no such package. If NULL, the backend doesn't
+	// know about packages and only the default device is used.
+	bool (*package)(uint32_t package, char *device, size_t len,
+			int32_t *cpu);
+
+	// Opens the device of the n-th CPU of the given package and
+	// writes the CPUs number into cpu. The FD is read and closed
+	// like a package device. Returns -1 if there's no such CPU.
+	// NULL if the backend can't access single CPUs.
+	int32_t (*opencpu)(uint32_t package, uint32_t n, int32_t *cpu);
+
+	// Reads count MSRs, each from it's own device. Used for
+	// the MSRs of single CPUs. All reads are submitted at once
+	// and may be executed in parallel. If NULL, read() is
+	// called for each MSR.
+	bool (*readcpus)(const int32_t *fds, const int32_t *msrs, uint64_t *data,
+			size_t count);
+
+	// Replaying backends only. Writes the energy unit in joule
+	// the given *_STATUS MSR was recorded in into unit, 0 if
+	// it's given by UNIT_MULTIPLIER. Returns false if the MSR
+	// wasn't recorded. NULL if the MSRs are read live.
+	bool (*unit)(int32_t fd, int32_t msr, double *unit);
+
+	// Replaying backends only. Advances to the next recorded
+	// sample and returns the CLOCK_REALTIME time it was taken
+	// at in nanoseconds, 0 at the end of the recording. NULL
+	// if the MSRs are read live.
+	uint64_t (*next)(int32_t fd);
+} backend_t;
+
+#ifdef __FreeBSD__
+// cpuctl(4), see backend/cpuctl.c.
+extern const backend_t backend_cpuctl;
+#endif
+
+#ifdef __linux__
+// Linux /dev/cpu/N/msr, see backend/linux.c.
+extern const backend_t backend_linux;
+
+// Linux perf_event power PMU, see backend/perf.c.
+extern const backend_t backend_perf;
+
+// Linux powercap sysfs, see backend/powercap.c.
+extern const backend_t backend_powercap;
+#endif
+
+// MSR dump in a file, see backend/file.c.
+extern const backend_t backend_file;
+
+// Replay of a recording, see backend/replay.c.
+extern const backend_t backend_replay;
+
+
+// --------
+
+
 // Replacement for pow() with a base of 2.
 #define B2POW(e) (((e) == 0) ? 1 : (2 << ((e) - 1)))
 
 /*
- * Checks if the given MSR exists.
+ * Returns the backend with the given name or
+ * NULL if there's no such backend.
+ *
+ *  - name: Name of the backend.
+ */
+const backend_t *getbackend(const char *name);
+
+/*
+ * Opens the devices of the backend given in options, one for
+ * each package. If no backend was given all backends usable
+ * on this system are tried in order, the first one that can
+ * be opened is used. Sets options.backend, options.packages,
+ * options.devices, options.fds and options.cpus.
+ */
+void openbackend(void);
+
+/*
+ * Closes all devices opened by openbackend().
+ */
+void closebackend(void);
+
+/*
+ * Checks if the given MSR exists. Only the
+ * first package is checked.
  *
  * - msr: MSR to be checked.
  */
 bool checkmsr(int32_t msr);
 
 /*
- * Reads the given MSR and returns it's data.
+ * Reads the given MSR of the first
+ * package and returns it's data.
  *
  *  - msr: MSR to read.
  */
 uint64_t getmsr(int32_t msr);
 
+/*
+ * Reads several MSRs of the given package at once. This is
+ * cheaper than calling getmsr() for each of them, since the
+ * backend may submit all reads with just one syscall. Like
+ * all functions accessing the devices of the packages it's
+ * thread safe, the access to each device is serialized.
+ *
+ *  - package: Package to read from.
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs data, same order as msrs.
+ *  - count: Number of MSRs.
+ */
+void getmsrs(uint32_t package, const int32_t *msrs, uint64_t *data,
+		size_t count);
+
+/*
+ * Writes the given MSR of the given package. Returns false
+ * and sets errno if the backend is read only or the write
+ * failed.
+ *
+ *  - package: Package to write to.
+ *  - msr: MSR to write.
+ *  - data: Data to write.
+ */
+bool setmsr(uint32_t package, int32_t msr, uint64_t data);
+
+/*
+ * Opens the devices of the CPUs of the given package. Returns
+ * the number of CPUs, 0 if the backend can't access single CPUs.
+ *
+ *  - package: Package whose CPUs are opened.
+ *  - fds: Filled with a FD for each CPU.
+ *  - cpus: Filled with the number of each CPU.
+ *  - max: Maximum number of CPUs.
+ */
+uint32_t opencpus(uint32_t package, int32_t *fds, int32_t *cpus, uint32_t max);
+
+/*
+ * Reads MSRs of several CPUs at once. All reads are submitted
+ * together, on 100+ CPUs this is much faster than reading one
+ * CPU after the other. Returns false if any of the MSRs couldn't
+ * be read.
+ *
+ *  - fds: FD of the CPU of each MSR, as returned by opencpus().
+ *  - msrs: MSRs to read.
+ *  - data: Filled with the MSRs data, same order as msrs.
+ *  - count: Number of MSRs.
+ */
+bool getcpumsrs(const int32_t *fds, const int32_t *msrs, uint64_t *data,
+		size_t count);
+
+/*
+ * Closes the devices opened by opencpus().
+ *
+ *  - fds: FDs of the CPUs.
+ *  - nfds: Number of CPUs.
+ */
+void closecpus(const int32_t *fds, size_t nfds);
+
 
 // --------
 
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "budget.h"
+#include "cap.h"
+#include "cgroups.h"
+#include "domain.h"
+#include "main.h"
+#include "metrics.h"
+#include "msr.h"
+#include "output.h"
+#include "pmshm.h"
+#include "rollup.h"
+#include "sampler.h"
+#include "shm.h"
+#include "store.h"
+
+
+// --------
+
+
+// Size of the output buffer.
+#define OUTPUT_BUFFER (64 * 1024)
+
+// Longest possible record.
+#define OUTPUT_RECORD 1024
+
+// Longest time records are kept in the buffer in nanoseconds.
+#define OUTPUT_FLUSH (1000 * 1000 * 1000)
+
+// Samples taken per record of a replay.
+#define OUTPUT_SAMPLES 4
+
+
+// --------
+
+
+// Records not yet written.
+static char buffer[OUTPUT_BUFFER];
+
+// Bytes used in buffer.
+static size_t used;
+
+
+// --------
+
+
+/*
+ * Writes the buffer to stdout. If stdout was closed, for
+ * example because the reading end of a pipe exited, the
+ * main loop is broken.
+ */
+static void flush(void) {
+	size_t written = 0;
+
+	while (written < used) {
+		ssize_t ret = write(STDOUT_FILENO, buffer + written, used - written);
+
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			options.stop = SIGPIPE;
+			break;
+		}
+
+		written += ret;
+	}
+
+	used = 0;
+}
+
+
+/*
+ * Appends a formatted string to the buffer. The caller
+ * makes sure that there's at least OUTPUT_RECORD bytes
+ * left.
+ *
+ *  - fmt: Format of the string.
+ *  - ...: Argument list.
+ */
+static void append(const char *fmt, ...) {
+	va_list vl;
+
+	va_start(vl, fmt);
+	int ret = vsnprintf(buffer + used, sizeof(buffer) - used, fmt, vl);
+	va_end(vl);
+
+	if (ret > 0) {
+		used += ((size_t)ret < sizeof(buffer) - used) ? (size_t)ret
+			: sizeof(buffer) - used - 1;
+	}
+}
+
+
+/*
+ * Sleeps until the given CLOCK_MONOTONIC time. Returns
+ * false if the sleep was interrupted by a signal that
+ * breaks the main loop.
+ *
+ *  - deadline: Time to wake up in nanoseconds.
+ */
+static bool waituntil(uint64_t deadline) {
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		if (options.stop) {
+			return false;
+		}
+	}
+
+	return !options.stop;
+}
+
+
+/*
+ * Appends the header line. Only CSV has one.
+ */
+static void header(void) {
+	if (options.output != OUTPUT_CSV) {
+		return;
+	}
+
+	append("%s", "time,missed");
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present) {
+			append(",%s_w,%s_j", domains[i].key, domains[i].key);
+		}
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			append(",%s_throttled_pct", throttles[i].key);
+		}
+	}
+
+	append("%s", "\n");
+}
+
+
+/*
+ * Appends one record.
+ *
+ *  - now: CLOCK_REALTIME time of the record.
+ *  - missed: Sampling deadlines missed since start.
+ *  - power: Power in watts.
+ *  - total: Energy since start in joule.
+ *  - throttled: Share of the interval throttled in percent.
+ */
+static void record(const struct timespec *now, uint64_t missed,
+		const energy_t *power, const energy_t *total, const throttled_t *throttled) {
+	if (options.output == OUTPUT_CSV) {
+		append("%lld.%03ld,%" PRIu64, (long long)now->tv_sec,
+				now->tv_nsec / 1000000, missed);
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			if (domains[i].present) {
+				append(",%.3f,%.3f", power->domain[i], total->domain[i]);
+			}
+		}
+
+		for (uint32_t i = 0; i < THROTTLES; i++) {
+			if (throttles[i].present) {
+				append(",%.3f", throttled->throttle[i]);
+			}
+		}
+	} else {
+		append("{\"time\":%lld.%03ld,\"missed\":%" PRIu64, (long long)now->tv_sec,
+				now->tv_nsec / 1000000, missed);
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			if (domains[i].present) {
+				append(",\"%s_w\":%.3f,\"%s_j\":%.3f", domains[i].key,
+						power->domain[i], domains[i].key, total->domain[i]);
+			}
+		}
+
+		for (uint32_t i = 0; i < THROTTLES; i++) {
+			if (throttles[i].present) {
+				append(",\"%s_throttled_pct\":%.3f", throttles[i].key, throttled->throttle[i]);
+			}
+		}
+
+		append("%s", "}");
+	}
+
+	append("%s", "\n");
+}
+
+
+/*
+ * Appends one record for each cgroup that used CPU time
+ * or was removed during the last interval. Flushes the
+ * buffer as necessary, there may be thousands.
+ *
+ *  - now: CLOCK_REALTIME time of the record.
+ */
+static void cgrouprecords(const struct timespec *now) {
+	const cgroup_t *cgroup;
+	uint32_t iter = 0;
+
+	while ((cgroup = nextcgroup(&iter))) {
+		if (sizeof(buffer) - used < OUTPUT_RECORD) {
+			flush();
+		}
+
+		append("{\"time\":%lld.%03ld,\"cgroup\":\"%s\",\"cpu_s\":%.3f,\"%s_j\":%.3f",
+				(long long)now->tv_sec, now->tv_nsec / 1000000, cgroup->path,
+				cgroup->cputime / 1000000000.0, domains[DOMAIN_PKG].key, cgroup->pkg_energy);
+
+		if (domains[DOMAIN_PP0].present) {
+			append(",\"%s_j\":%.3f", domains[DOMAIN_PP0].key, cgroup->pp0_energy);
+		}
+
+		append("%s", cgroup->removed ? ",\"removed\":true}\n" : "}\n");
+	}
+}
+
+
+// --------
+
+
+/*
+ * Writes records until the user interrupts us.
+ */
+void output(void) {
+	// A closed pipe is handled by flush().
+	signal(SIGPIPE, SIG_IGN);
+
+	if (options.shm) {
+		uint32_t present = 0;
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			present |= domains[i].present << i;
+		}
+
+		for (uint32_t i = 0; i < THROTTLES; i++) {
+			present |= throttles[i].present << (PMSHM_THROTTLED_SHIFT + i);
+		}
+
+		openshm(options.shm, present, options.interval);
+	}
+
+	if (options.listen) {
+		openmetrics(options.listen);
+	}
+
+	if (options.cgroup) {
+		opencgroups(options.cgroup);
+	}
+
+	// Replayed records are cut at the recorded time,
+	// not when the replay happens to get there.
+	bool replay = options.backend->next != NULL;
+
+	if (replay) {
+		pacesamplers();
+	}
+
+	// Start sampling. The live counters are read for each
+	// record, the samplers only catch the wraparounds. A
+	// replay takes a few samples per record, so each record
+	// sees at least one new sample.
+	startsamplers(replay ? options.interval / OUTPUT_SAMPLES : UINT64_MAX);
+
+	if (options.output) {
+		header();
+		flush();
+	}
+
+	// Baseline of the cgroups.
+	energy_t last;
+
+	memset(&last, 0, sizeof(last));
+
+	if (options.cgroup) {
+		scancgroups();
+	}
+
+	uint64_t deadline = gettime();
+	uint64_t lastflush = deadline;
+
+	for (uint64_t n = 0; !options.count || n < options.count; n++) {
+		struct timespec now;
+
+		if (replay) {
+			uint64_t recorded = advancesamplers(options.interval);
+
+			now.tv_sec = recorded / 1000000000;
+			now.tv_nsec = recorded % 1000000000;
+
+			// At the recorded pace scrapes are served
+			// while the samplers catch up.
+			if (options.listen && !options.fast) {
+				deadline += options.interval;
+
+				if (!servemetrics(deadline)) {
+					break;
+				}
+			}
+
+			waitsamplers();
+		} else {
+			deadline += options.interval;
+
+			// Scrapes are served while waiting.
+			if (!(options.listen ? servemetrics(deadline) : waituntil(deadline))) {
+				break;
+			}
+
+			clock_gettime(CLOCK_REALTIME, &now);
+		}
+
+		energy_t power;
+		energy_t total;
+		throttled_t throttled;
+		uint64_t missed = 0;
+		uint64_t timestamp = 0;
+
+		energy_t package_power[MAX_PACKAGES];
+		energy_t package_total[MAX_PACKAGES];
+		throttled_t package_throttled[MAX_PACKAGES];
+		throttled_t package_throttledtotal[MAX_PACKAGES];
+		uint64_t package_missed[MAX_PACKAGES];
+
+		memset(&power, 0, sizeof(power));
+		memset(&total, 0, sizeof(total));
+		memset(&throttled, 0, sizeof(throttled));
+		memset(package_power, 0, sizeof(package_power));
+
+		// Summed over all packages.
+		for (uint32_t p = 0; p < options.packages; p++) {
+			sample_t sample;
+			energy_t delta;
+
+			getsample(p, &sample);
+			getjoules(&sample, &sample.delta, &delta);
+			getjoules(&sample, &sample.total, &package_total[p]);
+
+			for (uint32_t i = 0; i < DOMAINS; i++) {
+				if (sample.time > 0) {
+					package_power[p].domain[i] = delta.domain[i] / sample.time;
+				}
+
+				power.domain[i] += package_power[p].domain[i];
+				total.domain[i] += package_total[p].domain[i];
+			}
+
+			updatecap(p, package_power[p].domain[DOMAIN_PKG], sample.time);
+			updatebudget(p, package_power[p].domain[DOMAIN_PKG], sample.time);
+
+			// The machine is throttled by the mean over all packages.
+			getthrottled(&sample, &package_throttled[p]);
+
+			for (uint32_t i = 0; i < THROTTLES; i++) {
+				package_throttledtotal[p].throttle[i] = sample.throttledtotal[i] * sample.timeunit;
+				throttled.throttle[i] += package_throttled[p].throttle[i] / options.packages;
+			}
+
+			package_missed[p] = sample.missed;
+			missed += sample.missed;
+
+			if (p == 0) {
+				timestamp = sample.timestamp;
+			}
+		}
+
+		addrollup(timestamp, &total);
+		storesample(timestamp, package_total);
+
+		if (options.listen) {
+			updatemetrics(package_power, package_total, package_throttled,
+					package_throttledtotal, package_missed);
+		}
+
+		if (options.shm) {
+			publishshm(gettime(), (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec,
+					missed, power.domain, total.domain, throttled.throttle);
+		}
+
+		if (options.output) {
+			record(&now, missed, &power, &total, &throttled);
+		}
+
+		if (options.cgroup) {
+			scancgroups();
+			attributecgroups(total.domain[DOMAIN_PKG] - last.domain[DOMAIN_PKG],
+					total.domain[DOMAIN_PP0] - last.domain[DOMAIN_PP0]);
+			cgrouprecords(&now);
+		}
+
+		last = total;
+
+		// Write if the records are getting old
+		// or the next one may not fit.
+		uint64_t cur = gettime();
+
+		if (cur - lastflush >= OUTPUT_FLUSH
+				|| sizeof(buffer) - used < OUTPUT_RECORD) {
+			flush();
+			lastflush = cur;
+		}
+
+		// Interrupted or the replay ended.
+		if (options.stop || samplersdone()) {
+			break;
+		}
+	}
+
+	flush();
+	stopsamplers();
+
+	closeshm();
+	closemetrics();
+	closecgroups();
+}
+
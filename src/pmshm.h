@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Reader side of the shared memory export. Powermon started
+ * with --shm publishes one record per interval into a ring in
+ * POSIX shared memory. Any number of readers can map it and
+ * read the latest or older records without syscalls or locks.
+ * This header is self contained and can be copied into other
+ * projects:
+ *
+ *   const pmshm_header_t *shm = pmshm_attach("/powermon");
+ *   pmshm_record_t record;
+ *
+ *   if (shm && pmshm_latest(shm, &record)) {
+ *       printf("%f W\n", record.power[PMSHM_PKG]);
+ *   }
+ *
+ * Each record is guarded by a sequence lock. While the record
+ * is written it's sequence number is odd, afterwards it's
+ * 2 * (n + 1) for the n-th record ever published. A reader
+ * copies the record and checks that the sequence number was
+ * the expected one before and after the copy.
+ */
+
+#ifndef PMSHM_H_
+#define PMSHM_H_
+
+
+// --------
+
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// --------
+
+
+// Identifies the segment, "PMON".
+#define PMSHM_MAGIC 0x4e4f4d50
+
+// Layout version, bumped on incompatible changes.
+#define PMSHM_VERSION 2
+
+// Number of domains in each record.
+#define PMSHM_DOMAINS 5
+
+// Domains, index into pmshm_record_t.power and .energy.
+#define PMSHM_PKG 0
+#define PMSHM_PP0 1
+#define PMSHM_PP1 2
+#define PMSHM_DRAM 3
+#define PMSHM_PLATFORM 4
+
+// Number of throttling counters in each record.
+#define PMSHM_THROTTLES 3
+
+// Throttling counters, index into pmshm_record_t.throttled.
+#define PMSHM_THROTTLE_PKG 0
+#define PMSHM_THROTTLE_PP0 1
+#define PMSHM_THROTTLE_DRAM 2
+
+// Bit of the first throttling counter in pmshm_header_t.present.
+#define PMSHM_THROTTLED_SHIFT 16
+
+
+// --------
+
+
+/*
+ * One record, as published per interval.
+ */
+typedef struct pmshm_record_t {
+	// Sequence lock, see above.
+	uint64_t seq;
+
+	// CLOCK_MONOTONIC time in nanoseconds.
+	uint64_t timestamp;
+
+	// CLOCK_REALTIME time in nanoseconds.
+	uint64_t realtime;
+
+	// Sampling deadlines missed since start.
+	uint64_t missed;
+
+	// Power in watts, summed over all packages.
+	double power[PMSHM_DOMAINS];
+
+	// Energy since start in joule.
+	double energy[PMSHM_DOMAINS];
+
+	// Share of the interval the domains were throttled
+	// to enforce their power limit in percent, mean over
+	// all packages.
+	double throttled[PMSHM_THROTTLES];
+} pmshm_record_t;
+
+
+/*
+ * Start of the segment, followed by the ring.
+ */
+typedef struct pmshm_header_t {
+	// PMSHM_MAGIC, written last when the
+	// segment is ready.
+	uint32_t magic;
+
+	// PMSHM_VERSION.
+	uint32_t version;
+
+	// Number of records in the ring, power of 2.
+	uint32_t records;
+
+	// Bitmask of present domains, bit n for domain n,
+	// and of present throttling counters, bit n +
+	// PMSHM_THROTTLED_SHIFT for counter n.
+	uint32_t present;
+
+	// Interval between two records in nanoseconds.
+	uint64_t interval;
+
+	// Number of records published.
+	uint64_t head;
+
+	// The ring, record n is at n % records.
+	pmshm_record_t ring[];
+} pmshm_header_t;
+
+
+// --------
+
+
+/*
+ * Returns the size of a segment with the given number of records.
+ *
+ *  - records: Number of records in the ring.
+ */
+static inline size_t pmshm_size(uint32_t records) {
+	return sizeof(pmshm_header_t) + records * sizeof(pmshm_record_t);
+}
+
+
+/*
+ * Maps the segment with the given name read only. Returns
+ * NULL if there's no such segment or it's incompatible.
+ *
+ *  - name: Name of the segment, as given to --shm.
+ */
+static inline const pmshm_header_t *pmshm_attach(const char *name) {
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd == -1) {
+		return NULL;
+	}
+
+	struct stat sb;
+
+	if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(pmshm_header_t)) {
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	const pmshm_header_t *shm = map;
+
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != PMSHM_MAGIC
+			|| shm->version != PMSHM_VERSION
+			|| (size_t)sb.st_size < pmshm_size(shm->records)) {
+		munmap(map, sb.st_size);
+		return NULL;
+	}
+
+	return shm;
+}
+
+
+/*
+ * Unmaps a segment mapped by pmshm_attach().
+ *
+ *  - shm: Segment to unmap.
+ */
+static inline void pmshm_detach(const pmshm_header_t *shm) {
+	munmap((void *)shm, pmshm_size(shm->records));
+}
+
+
+/*
+ * Returns the number of records published so far. The
+ * latest one is head - 1.
+ *
+ *  - shm: Segment to query.
+ */
+static inline uint64_t pmshm_head(const pmshm_header_t *shm) {
+	return __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+}
+
+
+/*
+ * Copies the n-th record ever published. Returns false if
+ * it's not published yet or was already overwritten.
+ *
+ *  - shm: Segment to read from.
+ *  - n: Number of the record.
+ *  - record: Filled with the record.
+ */
+static inline bool pmshm_read(const pmshm_header_t *shm, uint64_t n,
+		pmshm_record_t *record) {
+	const pmshm_record_t *slot = &shm->ring[n & (shm->records - 1)];
+	uint64_t expected = 2 * (n + 1);
+
+	for (;;) {
+		uint64_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+		// Being written right now, it's coming.
+		if (before == expected - 1) {
+			continue;
+		}
+
+		// Overwritten or not written yet.
+		if (before != expected) {
+			return false;
+		}
+
+		memcpy(record, slot, sizeof(*record));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == before) {
+			record->seq = before;
+			return true;
+		}
+	}
+}
+
+
+/*
+ * Copies the latest record. Returns false if there's none.
+ *
+ *  - shm: Segment to read from.
+ *  - record: Filled with the record.
+ */
+static inline bool pmshm_latest(const pmshm_header_t *shm,
+		pmshm_record_t *record) {
+	for (;;) {
+		uint64_t head = pmshm_head(shm);
+
+		if (!head) {
+			return false;
+		}
+
+		if (pmshm_read(shm, head - 1, record)) {
+			return true;
+		}
+	}
+}
+
+
+// --------
+
+#endif // PMSHM_H_
+
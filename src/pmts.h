@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Reader side of the time series store. Powermon started with
+ * --store appends the power of each package and domain into
+ * files in the given directory. This header is self contained
+ * and can be copied into other projects:
+ *
+ *   pmts_file_t file;
+ *   pmts_cursor_t cursor;
+ *   uint64_t time;
+ *   double values[PMTS_COLUMNS];
+ *
+ *   if (pmts_open("store/powermon-1760000000000.pmts", &file)) {
+ *       for (uint64_t n = pmts_seek(&file, from); n < file.blocks; n++) {
+ *           pmts_begin(&cursor, &file, n);
+ *
+ *           while (pmts_next(&cursor, &time, values)) {
+ *               ...
+ *           }
+ *       }
+ *
+ *       pmts_close(&file);
+ *   }
+ *
+ * A file starts with a header and continues with fixed size
+ * blocks, each one holding the records of a time range. Blocks
+ * are self contained, the first record is stored verbatim and
+ * the following ones are compressed against their predecessor:
+ * Timestamps as delta of delta, values as XOR with the previous
+ * value of the same column, see "Gorilla: A Fast, Scalable,
+ * In-Memory Time Series Database". Since the blocks are sorted
+ * by time a reader finds the start of a range by binary search
+ * without decoding anything before it.
+ *
+ * Blocks are written in one piece and carry a checksum. A block
+ * torn by a crash fails the check and is skipped by the reader,
+ * just like a hole left by a block that was never written. Only
+ * complete blocks are written to their final position, copies of
+ * the block being filled go alternately to one of two shadow
+ * slots behind the header. A crash tears at most one copy, the
+ * reader takes the newest intact one as the last block.
+ */
+
+#ifndef PMTS_H_
+#define PMTS_H_
+
+
+// --------
+
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// --------
+
+
+// Identifies a file, "PMTS".
+#define PMTS_MAGIC 0x53544d50
+
+// Identifies a block, "PMBK".
+#define PMTS_BLOCK_MAGIC 0x4b424d50
+
+// Layout version, bumped on incompatible changes.
+#define PMTS_VERSION 2
+
+// Size of the header and each block in bytes.
+#define PMTS_BLOCK 4096
+
+// Shadow slots for the block being filled.
+#define PMTS_SHADOWS 2
+
+// Maximum number of columns, 16 packages with 5 domains.
+#define PMTS_COLUMNS 80
+
+// Values are rounded to this fraction of a watt and
+// stored as integral doubles. Those have the low bits
+// of the mantissa cleared and compress much better.
+#define PMTS_RESOLUTION 1000.0
+
+// Domains, as given in pmts_header_t.domain.
+#define PMTS_PKG 0
+#define PMTS_PP0 1
+#define PMTS_PP1 2
+#define PMTS_DRAM 3
+#define PMTS_PLATFORM 4
+
+
+// --------
+
+
+/*
+ * Start of a file, padded to PMTS_BLOCK bytes.
+ */
+typedef struct pmts_header_t {
+	// PMTS_MAGIC.
+	uint32_t magic;
+
+	// PMTS_VERSION.
+	uint32_t version;
+
+	// PMTS_BLOCK.
+	uint32_t block;
+
+	// Number of values in each record.
+	uint32_t columns;
+
+	// CLOCK_REALTIME time the file was created in milliseconds.
+	uint64_t created;
+
+	// Package and domain of each column. The value
+	// is the power in watts, see PMTS_RESOLUTION.
+	uint8_t package[PMTS_COLUMNS];
+	uint8_t domain[PMTS_COLUMNS];
+} pmts_header_t;
+
+
+/*
+ * One block. Shadow slot s starts at (s + 1) * PMTS_BLOCK,
+ * block n at (n + 1 + PMTS_SHADOWS) * PMTS_BLOCK.
+ */
+typedef struct pmts_block_t {
+	// PMTS_BLOCK_MAGIC.
+	uint32_t magic;
+
+	// FNV-1a of everything after this field
+	// up to the last used byte of data.
+	uint32_t checksum;
+
+	// CLOCK_REALTIME time of the first and last
+	// record in milliseconds.
+	uint64_t first;
+	uint64_t last;
+
+	// Number of records.
+	uint32_t records;
+
+	// Number of bits used in data.
+	uint32_t bits;
+
+	// The records, a bitstream. Most significant bit first.
+	uint8_t data[PMTS_BLOCK - 32];
+} pmts_block_t;
+
+
+/*
+ * A mapped file.
+ */
+typedef struct pmts_file_t {
+	const pmts_header_t *header;
+	size_t size;
+
+	// Number of blocks, including torn ones. The
+	// last one is the block being filled.
+	uint64_t blocks;
+} pmts_file_t;
+
+
+/*
+ * Decoding state of one block.
+ */
+typedef struct pmts_cursor_t {
+	const pmts_block_t *block;
+	uint32_t columns;
+
+	// Next record and bit to decode.
+	uint32_t record;
+	uint32_t bit;
+
+	// Previous timestamp and delta.
+	uint64_t time;
+	int64_t delta;
+
+	// Previous value and it's meaningful bits of each column.
+	uint64_t value[PMTS_COLUMNS];
+	uint8_t leading[PMTS_COLUMNS];
+	uint8_t trailing[PMTS_COLUMNS];
+} pmts_cursor_t;
+
+
+// --------
+
+
+/*
+ * Returns the checksum of a block.
+ *
+ *  - block: Block to check.
+ */
+static inline uint32_t pmts_checksum(const pmts_block_t *block) {
+	const uint8_t *data = (const uint8_t *)&block->first;
+	size_t size = offsetof(pmts_block_t, data) - offsetof(pmts_block_t, first)
+		+ (block->bits + 7) / 8;
+	uint32_t hash = 2166136261u;
+
+	if (block->bits > sizeof(block->data) * 8) {
+		return ~block->checksum;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+
+/*
+ * Maps a file read only. Returns false if it can't
+ * be opened or is incompatible.
+ *
+ *  - path: File to map.
+ *  - file: Filled with the mapping.
+ */
+static inline bool pmts_open(const char *path, pmts_file_t *file) {
+	int fd = open(path, O_RDONLY);
+
+	if (fd == -1) {
+		return false;
+	}
+
+	struct stat sb;
+
+	if (fstat(fd, &sb) == -1 || sb.st_size < (1 + PMTS_SHADOWS) * PMTS_BLOCK) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return false;
+	}
+
+	const pmts_header_t *header = map;
+
+	if (header->magic != PMTS_MAGIC || header->version != PMTS_VERSION
+			|| header->block != PMTS_BLOCK || header->columns > PMTS_COLUMNS) {
+		munmap(map, sb.st_size);
+		return false;
+	}
+
+	file->header = header;
+	file->size = sb.st_size;
+	file->blocks = sb.st_size / PMTS_BLOCK - PMTS_SHADOWS;
+
+	return true;
+}
+
+
+/*
+ * Unmaps a file mapped by pmts_open().
+ *
+ *  - file: File to unmap.
+ */
+static inline void pmts_close(pmts_file_t *file) {
+	munmap((void *)file->header, file->size);
+}
+
+
+/*
+ * Returns the block in the given slot, or NULL if it's torn.
+ *
+ *  - file: File to read from.
+ *  - slot: Offset in the file in PMTS_BLOCK units.
+ */
+static inline const pmts_block_t *pmts_slot(const pmts_file_t *file, uint64_t slot) {
+	const pmts_block_t *block = (const pmts_block_t *)
+		((const uint8_t *)file->header + slot * PMTS_BLOCK);
+
+	if (block->magic != PMTS_BLOCK_MAGIC || !block->records
+			|| pmts_checksum(block) != block->checksum) {
+		return NULL;
+	}
+
+	return block;
+}
+
+
+/*
+ * Returns block n, or NULL if it's torn. The last block
+ * is the newest intact shadow copy, unless the block it
+ * belongs to has been written to it's final position.
+ *
+ *  - file: File to read from.
+ *  - n: Number of the block.
+ */
+static inline const pmts_block_t *pmts_block(const pmts_file_t *file, uint64_t n) {
+	if (n + 1 < file->blocks) {
+		return pmts_slot(file, n + 1 + PMTS_SHADOWS);
+	}
+
+	const pmts_block_t *shadow = NULL;
+
+	for (uint64_t s = 0; s < PMTS_SHADOWS; s++) {
+		const pmts_block_t *block = pmts_slot(file, s + 1);
+
+		if (block && (!shadow || block->last > shadow->last)) {
+			shadow = block;
+		}
+	}
+
+	for (uint64_t i = n; shadow && i-- > 0;) {
+		const pmts_block_t *block = pmts_slot(file, i + 1 + PMTS_SHADOWS);
+
+		if (block) {
+			if (block->first >= shadow->first) {
+				shadow = NULL;
+			}
+
+			break;
+		}
+	}
+
+	return shadow;
+}
+
+
+/*
+ * Returns the first block with records at or after the given
+ * time, or file->blocks if there's none. Torn blocks and holes
+ * don't take part in the search, they're skipped until the
+ * next intact block.
+ *
+ *  - file: File to search.
+ *  - from: CLOCK_REALTIME time in milliseconds.
+ */
+static inline uint64_t pmts_seek(const pmts_file_t *file, uint64_t from) {
+	uint64_t low = 0;
+	uint64_t high = file->blocks;
+
+	while (low < high) {
+		uint64_t mid = low + (high - low) / 2;
+		uint64_t probe = mid;
+		const pmts_block_t *block = NULL;
+
+		while (probe < high && !(block = pmts_block(file, probe))) {
+			probe++;
+		}
+
+		if (block && block->last < from) {
+			low = probe + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+
+/*
+ * Reads count bits from the block.
+ *
+ *  - cursor: Cursor to read from.
+ *  - count: Number of bits, at most 64.
+ */
+static inline uint64_t pmts_bits(pmts_cursor_t *cursor, uint32_t count) {
+	uint64_t value = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t bit = cursor->bit++;
+		value = (value << 1) | ((cursor->block->data[bit / 8] >> (7 - bit % 8)) & 1);
+	}
+
+	return value;
+}
+
+
+/*
+ * Starts decoding block n. A torn block decodes as empty.
+ *
+ *  - cursor: Cursor to initialize.
+ *  - file: File to read from.
+ *  - n: Number of the block.
+ */
+static inline void pmts_begin(pmts_cursor_t *cursor, const pmts_file_t *file,
+		uint64_t n) {
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->block = pmts_block(file, n);
+	cursor->columns = file->header->columns;
+}
+
+
+/*
+ * Decodes the next record. Returns false at the end of the block.
+ *
+ *  - cursor: Cursor to read from.
+ *  - time: CLOCK_REALTIME time of the record in milliseconds.
+ *  - values: Filled with the value of each column.
+ */
+static inline bool pmts_next(pmts_cursor_t *cursor, uint64_t *time,
+		double *values) {
+	if (!cursor->block || cursor->record == cursor->block->records) {
+		return false;
+	}
+
+	if (cursor->record == 0) {
+		cursor->time = pmts_bits(cursor, 64);
+	} else {
+		// Delta of delta, '0', '10', '110', '1110' or '1111'.
+		static const uint32_t widths[5] = { 0, 7, 9, 12, 64 };
+		uint32_t prefix = 0;
+
+		while (prefix < 4 && pmts_bits(cursor, 1)) {
+			prefix++;
+		}
+
+		int64_t dod = 0;
+
+		if (prefix) {
+			uint64_t raw = pmts_bits(cursor, widths[prefix]);
+
+			if (widths[prefix] < 64 && raw & (UINT64_C(1) << (widths[prefix] - 1))) {
+				raw |= ~UINT64_C(0) << widths[prefix];
+			}
+
+			dod = (int64_t)raw;
+		}
+
+		cursor->delta += dod;
+		cursor->time += cursor->delta;
+	}
+
+	for (uint32_t i = 0; i < cursor->columns; i++) {
+		if (cursor->record == 0) {
+			cursor->value[i] = pmts_bits(cursor, 64);
+		} else if (pmts_bits(cursor, 1)) {
+			// '10' reuses the previous window, '11' brings a new one.
+			if (pmts_bits(cursor, 1)) {
+				cursor->leading[i] = pmts_bits(cursor, 5);
+				uint32_t length = pmts_bits(cursor, 6) + 1;
+				cursor->trailing[i] = 64 - cursor->leading[i] - length;
+			}
+
+			uint32_t length = 64 - cursor->leading[i] - cursor->trailing[i];
+			cursor->value[i] ^= pmts_bits(cursor, length) << cursor->trailing[i];
+		}
+
+		memcpy(&values[i], &cursor->value[i], sizeof(double));
+		values[i] /= PMTS_RESOLUTION;
+	}
+
+	*time = cursor->time;
+	cursor->record++;
+
+	return true;
+}
+
+
+// --------
+
+#endif // PMTS_H_
+
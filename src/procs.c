@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#if defined(__FreeBSD__)
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#endif
+
+#include "main.h"
+#include "procs.h"
+
+
+// --------
+
+
+// Slots in the process table, a power of 2. At most
+// half of them are used to keep the probes short.
+#define PROCS_SLOTS 131072
+
+// Descriptors left for everything else.
+#define PROCS_RESERVE 64
+
+
+// --------
+
+
+// The process table, open addressing with linear probing.
+static proc_t *procs;
+
+// Number of used slots.
+static uint32_t used;
+
+// Number of the current scan.
+static uint32_t generation;
+
+#if defined(__FreeBSD__)
+// Buffer for the process list, grown when too small.
+static struct kinfo_proc *kinfo;
+static size_t kinfosize;
+#elif defined(__linux__)
+// /proc, rewound for each scan.
+static DIR *procdir;
+
+// Nanoseconds per clock tick.
+static uint64_t ticklength;
+
+// Descriptors kept open and the maximum.
+static uint64_t descriptors;
+static uint64_t maxdescriptors;
+#endif
+
+
+// --------
+
+
+/*
+ * Returns the home slot of a pid.
+ *
+ *  - pid: Process ID.
+ */
+static inline uint32_t hashpid(int32_t pid) {
+	return ((uint32_t)pid * 2654435761u) & (PROCS_SLOTS - 1);
+}
+
+
+/*
+ * Returns the slot of a process, adding it if it's not
+ * in the table. Returns NULL if the table is full.
+ *
+ *  - pid: Process ID.
+ *  - added: Set to 1 if the process was added.
+ */
+static proc_t *findproc(int32_t pid, uint32_t *added) {
+	uint32_t slot = hashpid(pid);
+
+	*added = 0;
+
+	while (procs[slot].pid) {
+		if (procs[slot].pid == pid) {
+			return &procs[slot];
+		}
+
+		slot = (slot + 1) & (PROCS_SLOTS - 1);
+	}
+
+	if (used >= PROCS_SLOTS / 2) {
+		return NULL;
+	}
+
+	memset(&procs[slot], 0, sizeof(proc_t));
+	procs[slot].pid = pid;
+	procs[slot].fd = -1;
+	used++;
+	*added = 1;
+
+	return &procs[slot];
+}
+
+
+/*
+ * Removes a process. The following entries of the probe
+ * sequence are shifted back, so no tombstones are needed.
+ *
+ *  - proc: Process to remove.
+ */
+static void removeproc(proc_t *proc) {
+	uint32_t hole = proc - procs;
+	uint32_t slot = hole;
+
+#if defined(__linux__)
+	if (proc->fd != -1) {
+		close(proc->fd);
+		descriptors--;
+	}
+#endif
+
+	for (;;) {
+		slot = (slot + 1) & (PROCS_SLOTS - 1);
+
+		if (!procs[slot].pid) {
+			break;
+		}
+
+		// Entries whose home is cyclically in (hole, slot]
+		// are reachable without the hole and stay.
+		uint32_t home = hashpid(procs[slot].pid);
+
+		if (((slot - home) & (PROCS_SLOTS - 1)) < ((slot - hole) & (PROCS_SLOTS - 1))) {
+			continue;
+		}
+
+		procs[hole] = procs[slot];
+		hole = slot;
+	}
+
+	procs[hole].pid = 0;
+	used--;
+}
+
+
+/*
+ * Updates the CPU time of a process. The first scan only
+ * takes the baseline, a process appearing later is assumed
+ * to have used it's CPU time since the last scan.
+ *
+ *  - proc: Process to update.
+ *  - cputime: CPU time since the process started in nanoseconds.
+ *  - added: Set if the process is new.
+ */
+static void updateproc(proc_t *proc, uint64_t cputime, uint32_t added) {
+	if (added) {
+		proc->delta = (generation > 1) ? cputime : 0;
+	} else {
+		proc->delta = (cputime > proc->cputime) ? cputime - proc->cputime : 0;
+	}
+
+	proc->cputime = cputime;
+	proc->generation = generation;
+}
+
+
+#if defined(__linux__)
+/*
+ * Reads and parses /proc/pid/stat. Returns false if the
+ * process is gone.
+ *
+ *  - proc: Process to read.
+ *  - cputime: Filled with utime plus stime in nanoseconds.
+ */
+static bool readstat(proc_t *proc, uint64_t *cputime) {
+	char buf[1024];
+	ssize_t len;
+
+	// Kept open, or reopened for every scan
+	// once we're running out of descriptors.
+	if (proc->fd == -1) {
+		char path[32];
+		int32_t fd;
+
+		snprintf(path, sizeof(path), "/proc/%d/stat", proc->pid);
+
+		if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+			return false;
+		}
+
+		len = pread(fd, buf, sizeof(buf) - 1, 0);
+
+		if (len > 0 && descriptors < maxdescriptors) {
+			proc->fd = fd;
+			descriptors++;
+		} else {
+			close(fd);
+		}
+	} else {
+		len = pread(proc->fd, buf, sizeof(buf) - 1, 0);
+	}
+
+	if (len <= 0) {
+		return false;
+	}
+
+	buf[len] = '\0';
+
+	// The name may contain spaces and parentheses,
+	// the fields start after the last ')'.
+	char *open = strchr(buf, '(');
+	char *close = strrchr(buf, ')');
+
+	if (!open || !close || close < open) {
+		return false;
+	}
+
+	size_t namelen = close - open - 1;
+
+	if (namelen >= PROC_COMM) {
+		namelen = PROC_COMM - 1;
+	}
+
+	memcpy(proc->comm, open + 1, namelen);
+	proc->comm[namelen] = '\0';
+
+	// utime and stime are the 14th and 15th field,
+	// the state after the name is the 3rd.
+	char *field = close + 2;
+
+	for (uint32_t i = 3; i < 14 && field; i++) {
+		field = strchr(field, ' ');
+
+		if (field) {
+			field++;
+		}
+	}
+
+	if (!field) {
+		return false;
+	}
+
+	char *end;
+	uint64_t utime = strtoull(field, &end, 10);
+	uint64_t stime = strtoull(end, NULL, 10);
+
+	*cputime = (utime + stime) * ticklength;
+
+	return true;
+}
+#endif
+
+
+// --------
+
+
+/*
+ * Allocates the process table.
+ */
+void openprocs(void) {
+	// calloc()ed memory is mapped lazily, only the
+	// slots ever used are backed by memory.
+	if (!(procs = calloc(PROCS_SLOTS, sizeof(proc_t)))) {
+		exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+	}
+
+#if defined(__linux__)
+	// One descriptor per process.
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		if (limit.rlim_cur < limit.rlim_max) {
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+
+		if (limit.rlim_cur > PROCS_RESERVE) {
+			maxdescriptors = limit.rlim_cur - PROCS_RESERVE;
+		}
+	}
+
+	if (!(procdir = opendir("/proc"))) {
+		exit_error(1, "ERROR: Couldn't open /proc: %s\n", strerror(errno));
+	}
+
+	ticklength = 1000000000 / sysconf(_SC_CLK_TCK);
+#endif
+}
+
+
+/*
+ * Updates all processes.
+ */
+uint32_t scanprocs(void) {
+	uint32_t added;
+
+	generation++;
+
+#if defined(__FreeBSD__)
+	int mib[3] = { CTL_KERN, KERN_PROC, KERN_PROC_PROC };
+	size_t len = kinfosize;
+
+	// Only grown when there are more processes than ever before.
+	while (sysctl(mib, 3, kinfo, &len, NULL, 0) == -1) {
+		if (errno != ENOMEM) {
+			exit_error(1, "ERROR: Couldn't get the process list: %s\n", strerror(errno));
+		}
+
+		sysctl(mib, 3, NULL, &len, NULL, 0);
+		len += len / 4;
+
+		if (!(kinfo = realloc(kinfo, len))) {
+			exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+		}
+
+		kinfosize = len;
+	}
+
+	for (size_t i = 0; i < len / sizeof(struct kinfo_proc); i++) {
+		proc_t *proc = findproc(kinfo[i].ki_pid, &added);
+
+		// The table is full, the processes in it are
+		// still updated and nothing is evicted.
+		if (!proc) {
+			continue;
+		}
+
+		snprintf(proc->comm, sizeof(proc->comm), "%s", kinfo[i].ki_comm);
+		updateproc(proc, (uint64_t)kinfo[i].ki_runtime * 1000, added);
+	}
+#elif defined(__linux__)
+	struct dirent *entry;
+
+	rewinddir(procdir);
+
+	while ((entry = readdir(procdir))) {
+		uint64_t cputime;
+
+		if (entry->d_name[0] < '1' || entry->d_name[0] > '9') {
+			continue;
+		}
+
+		proc_t *proc = findproc(atoi(entry->d_name), &added);
+
+		if (!proc) {
+			continue;
+		}
+
+		if (readstat(proc, &cputime)) {
+			updateproc(proc, cputime, added);
+			continue;
+		}
+
+		// The descriptor belongs to an exited process
+		// whose pid was reused. Try again with a new one.
+		if (!added && proc->fd != -1) {
+			close(proc->fd);
+			proc->fd = -1;
+			descriptors--;
+
+			if (readstat(proc, &cputime)) {
+				updateproc(proc, cputime, 1);
+				continue;
+			}
+		}
+
+		removeproc(proc);
+	}
+#endif
+
+	// Processes not seen in this scan exited. Removing
+	// shifts entries back, so a slot is checked again
+	// after something was moved into it.
+	for (uint32_t slot = 0; slot < PROCS_SLOTS; slot++) {
+		while (procs[slot].pid && procs[slot].generation != generation) {
+			removeproc(&procs[slot]);
+		}
+	}
+
+	return used;
+}
+
+
+/*
+ * Splits the energy between the processes.
+ */
+void attributeprocs(double pkg, double pp0, double seconds) {
+	uint64_t total = 0;
+
+	for (uint32_t slot = 0; slot < PROCS_SLOTS; slot++) {
+		if (procs[slot].pid) {
+			total += procs[slot].delta;
+		}
+	}
+
+	for (uint32_t slot = 0; slot < PROCS_SLOTS; slot++) {
+		proc_t *proc = &procs[slot];
+
+		if (!proc->pid) {
+			continue;
+		}
+
+		double share = total ? (double)proc->delta / total : 0;
+
+		proc->pkg_power = (seconds > 0) ? pkg * share / seconds : 0;
+		proc->pp0_power = (seconds > 0) ? pp0 * share / seconds : 0;
+		proc->pkg_energy += pkg * share;
+		proc->pp0_energy += pp0 * share;
+	}
+}
+
+
+/*
+ * Returns the processes using the most power.
+ */
+uint32_t gettopprocs(const proc_t **top, uint32_t count) {
+	uint32_t filled = 0;
+
+	// Insertion into the short list. Most processes are idle
+	// and rejected by the first comparison.
+	for (uint32_t slot = 0; slot < PROCS_SLOTS && count; slot++) {
+		const proc_t *proc = &procs[slot];
+
+		if (!proc->pid || !proc->delta) {
+			continue;
+		}
+
+		if (filled == count && proc->delta <= top[filled - 1]->delta) {
+			continue;
+		}
+
+		uint32_t i = (filled < count) ? filled++ : filled - 1;
+
+		while (i > 0 && top[i - 1]->delta < proc->delta) {
+			top[i] = top[i - 1];
+			i--;
+		}
+
+		top[i] = proc;
+	}
+
+	return filled;
+}
+
+
+/*
+ * Frees everything.
+ */
+void closeprocs(void) {
+	if (!procs) {
+		return;
+	}
+
+#if defined(__FreeBSD__)
+	free(kinfo);
+	kinfo = NULL;
+	kinfosize = 0;
+#elif defined(__linux__)
+	for (uint32_t slot = 0; slot < PROCS_SLOTS; slot++) {
+		if (procs[slot].pid && procs[slot].fd != -1) {
+			close(procs[slot].fd);
+		}
+	}
+
+	closedir(procdir);
+	procdir = NULL;
+	descriptors = 0;
+#endif
+
+	free(procs);
+	procs = NULL;
+}
+
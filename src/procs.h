@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef PROCS_H_
+#define PROCS_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+
+// --------
+
+
+// Length of a process name, including the terminating 0.
+#define PROC_COMM 20
+
+
+/*
+ * A process, as tracked by scanprocs().
+ */
+typedef struct proc_t {
+	// Process ID, 0 for a free slot.
+	int32_t pid;
+
+	// Descriptor of /proc/pid/stat on Linux, -1 if none.
+	int32_t fd;
+
+	// Number of the last scan the process was seen in.
+	uint32_t generation;
+
+	char comm[PROC_COMM];
+
+	// CPU time in nanoseconds, since the process
+	// started and during the last interval.
+	uint64_t cputime;
+	uint64_t delta;
+
+	// Share of the package and x86 cores power during
+	// the last interval and of the energy since the
+	// process was first seen.
+	double pkg_power;
+	double pp0_power;
+	double pkg_energy;
+	double pp0_energy;
+} proc_t;
+
+
+// --------
+
+
+/*
+ * Allocates the process table. Aborts the program on error.
+ */
+void openprocs(void);
+
+
+/*
+ * Updates the CPU time of all processes. Processes that
+ * exited are removed, new ones added. Nothing is allocated,
+ * on Linux the /proc/pid/stat files are kept open between
+ * scans. Returns the number of processes.
+ */
+uint32_t scanprocs(void);
+
+
+/*
+ * Splits the energy consumed during the last interval
+ * between the processes, in proportion to the CPU time
+ * they used.
+ *
+ *  - pkg: Package energy in joule.
+ *  - pp0: x86 cores energy in joule.
+ *  - seconds: Length of the interval.
+ */
+void attributeprocs(double pkg, double pp0, double seconds);
+
+
+/*
+ * Fills top with the processes using the most package
+ * power, highest first. Returns the number filled in.
+ *
+ *  - top: Filled with the processes.
+ *  - count: Maximum number of processes.
+ */
+uint32_t gettopprocs(const proc_t **top, uint32_t count);
+
+
+/*
+ * Closes all files and frees the process table.
+ */
+void closeprocs(void);
+
+
+// --------
+
+#endif // PROCS_H_
+
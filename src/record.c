@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "domain.h"
+#include "main.h"
+#include "msr.h"
+#include "record.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Size of the write buffer.
+#define RECORD_BUFFER (64 * 1024)
+
+
+// --------
+
+
+// MSRs read only once, written to the header if present.
+static const int32_t statics[] = {
+	UNIT_MULTIPLIER,
+	PKG_INFO,
+	PKG_LIMIT,
+	PP0_LIMIT,
+	PP1_LIMIT,
+	DRAM_LIMIT
+};
+
+// The recording, NULL if there's none.
+static FILE *record;
+
+// Serializes the sampler threads.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Write buffer.
+static char buffer[RECORD_BUFFER];
+
+
+// --------
+
+
+/*
+ * Writes the given data, aborts on error.
+ *
+ *  - data: Data to write.
+ *  - size: Size of data.
+ */
+static void writerecord(const void *data, size_t size) {
+	if (fwrite(data, size, 1, record) != 1) {
+		exit_error(1, "ERROR: Couldn't write recording: %s\n", strerror(errno));
+	}
+}
+
+
+// --------
+
+
+/*
+ * Creates the recording.
+ */
+void startrecord(const char *path) {
+	if (!(record = fopen(path, "wb"))) {
+		exit_error(1, "ERROR: Couldn't create %s: %s\n", path, strerror(errno));
+	}
+
+	setvbuf(record, buffer, _IOFBF, sizeof(buffer));
+
+	// Header.
+	recordheader_t header;
+	const uint32_t leafs[RECORD_LEAFS] = RECORD_LEAF_LIST;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = RECORD_MAGIC;
+	header.version = RECORD_VERSION;
+	header.packages = options.packages;
+
+	// A replay already gives wall clock time.
+	if (!options.backend->next) {
+		struct timespec now;
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		header.realtime = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec - gettime();
+	}
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present) {
+			header.domains++;
+		}
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			header.domains++;
+		}
+	}
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		for (size_t i = 0; i < sizeof(statics) / sizeof(statics[0]); i++) {
+			uint64_t value;
+
+			if (options.backend->read(options.fds[p], statics[i], &value)) {
+				header.statics++;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < RECORD_LEAFS; i++) {
+		options.backend->cpuid(options.fds[0], leafs[i], 0, header.cpuid[i]);
+	}
+
+	writerecord(&header, sizeof(header));
+
+	// *_STATUS and throttling MSRs.
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present) {
+			writerecord(&domains[i].msr, sizeof(domains[i].msr));
+		}
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			writerecord(&throttles[i].msr, sizeof(throttles[i].msr));
+		}
+	}
+
+	// Their units.
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present) {
+			writerecord(&domains[i].unit, sizeof(domains[i].unit));
+		}
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			double unit = 0;
+
+			writerecord(&unit, sizeof(unit));
+		}
+	}
+
+	// Static MSRs.
+	for (uint32_t p = 0; p < options.packages; p++) {
+		for (size_t i = 0; i < sizeof(statics) / sizeof(statics[0]); i++) {
+			recordstatic_t entry = { p, statics[i], 0 };
+
+			if (options.backend->read(options.fds[p], statics[i], &entry.value)) {
+				writerecord(&entry, sizeof(entry));
+			}
+		}
+	}
+}
+
+
+/*
+ * Appends a sample.
+ */
+void recordsample(uint32_t package, uint64_t timestamp, const uint32_t *raw,
+		const uint32_t *throttle) {
+	recordsample_t sample = { package, 0, timestamp };
+
+	pthread_mutex_lock(&lock);
+
+	writerecord(&sample, sizeof(sample));
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present) {
+			writerecord(&raw[i], sizeof(raw[i]));
+		}
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			writerecord(&throttle[i], sizeof(throttle[i]));
+		}
+	}
+
+	pthread_mutex_unlock(&lock);
+}
+
+
+/*
+ * Closes the recording.
+ */
+void stoprecord(void) {
+	if (!record) {
+		return;
+	}
+
+	fclose(record);
+	record = NULL;
+}
+
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+/*
+ * Recordings of raw samples, written with --record and read back
+ * by the replay backend. A recording is a header followed by the
+ * samples, appended as they're taken. All values are in host byte
+ * order:
+ *
+ *  - recordheader_t.
+ *  - The MSRs of each sample, as int32_t[domains]. First the
+ *    *_STATUS MSRs, then the throttling counters.
+ *  - The energy unit in joule each MSR was read in, as
+ *    double[domains]. 0 if it's given by UNIT_MULTIPLIER,
+ *    always 0 for the throttling counters. A replay uses
+ *    these instead of deriving the units again, they may
+ *    have come from the backend or the command line.
+ *  - The MSRs read only once, as recordstatic_t[statics].
+ *  - Any number of samples, each a recordsample_t followed by
+ *    the raw counters as uint32_t[domains]. Counters of domains
+ *    not sampled on the package are 0.
+ */
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+
+// --------
+
+
+// Identifies a recording, "PMRC".
+#define RECORD_MAGIC 0x43524d50
+
+// Format version, bumped on incompatible changes.
+#define RECORD_VERSION 3
+
+// Number of CPUID leafs in the header.
+#define RECORD_LEAFS 6
+
+// The CPUID leafs in the header.
+#define RECORD_LEAF_LIST { 0x0, 0x1, 0x80000000, 0x80000002, \
+	0x80000003, 0x80000004 }
+
+
+// --------
+
+
+/*
+ * Start of a recording.
+ */
+typedef struct recordheader_t {
+	// RECORD_MAGIC.
+	uint32_t magic;
+
+	// RECORD_VERSION.
+	uint32_t version;
+
+	// Number of packages.
+	uint32_t packages;
+
+	// Number of MSRs in each sample.
+	uint32_t domains;
+
+	// Number of MSRs read only once.
+	uint32_t statics;
+
+	// Padding, always 0.
+	uint32_t reserved;
+
+	// CLOCK_REALTIME minus CLOCK_MONOTONIC in nanoseconds
+	// when the recording was started. Turns the sample
+	// timestamps into wall clock time. 0 if they already
+	// are, e.g. in the recording of a replay.
+	uint64_t realtime;
+
+	// EAX, EBX, ECX and EDX of the leafs
+	// in RECORD_LEAF_LIST.
+	uint32_t cpuid[RECORD_LEAFS][4];
+} recordheader_t;
+
+
+/*
+ * A MSR read only once, e.g. UNIT_MULTIPLIER.
+ */
+typedef struct recordstatic_t {
+	// Package the MSR belongs to.
+	uint32_t package;
+
+	// The MSR.
+	int32_t msr;
+
+	// It's content.
+	uint64_t value;
+} recordstatic_t;
+
+
+/*
+ * Start of a sample.
+ */
+typedef struct recordsample_t {
+	// Package the sample belongs to.
+	uint32_t package;
+
+	// Padding, always 0.
+	uint32_t reserved;
+
+	// CLOCK_MONOTONIC time in nanoseconds.
+	uint64_t timestamp;
+} recordsample_t;
+
+
+// --------
+
+
+/*
+ * Creates the given recording and writes the header. Must
+ * be called after the domains were initialized. Aborts the
+ * program on error.
+ *
+ *  - path: File to write.
+ */
+void startrecord(const char *path);
+
+
+/*
+ * Appends a sample. May be called from several threads.
+ *
+ *  - package: Package the sample belongs to.
+ *  - timestamp: CLOCK_MONOTONIC time in nanoseconds.
+ *  - raw: Raw counters, indexed by domain_e.
+ *  - throttle: Raw throttling counters, indexed by throttle_e.
+ */
+void recordsample(uint32_t package, uint64_t timestamp, const uint32_t *raw,
+		const uint32_t *throttle);
+
+
+/*
+ * Writes outstanding samples and closes the recording.
+ */
+void stoprecord(void);
+
+
+// --------
+
+#endif // RECORD_H_
+
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "domain.h"
+#include "rollup.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Periods kept per resolution: 10 minutes of
+// seconds, a day of minutes and a month of hours.
+#define ROLLUP_SECONDS 600
+#define ROLLUP_MINUTES 1440
+#define ROLLUP_HOURS 720
+
+
+// --------
+
+
+/*
+ * One resolution.
+ */
+typedef struct level_t {
+	// Length of a period in nanoseconds.
+	uint64_t length;
+
+	// Complete periods, the oldest one is overwritten.
+	rollup_t *ring;
+	uint32_t size;
+
+	// Number of complete periods.
+	uint64_t head;
+
+	// Period being filled.
+	rollup_t current;
+	bool open;
+} level_t;
+
+
+// --------
+
+
+static rollup_t seconds[ROLLUP_SECONDS];
+static rollup_t minutes[ROLLUP_MINUTES];
+static rollup_t hours[ROLLUP_HOURS];
+
+static uint64_t lasttimestamp;
+static energy_t lasttotal;
+
+static level_t levels[RESOLUTIONS] = {
+	[RESOLUTION_SECOND] = { UINT64_C(1000000000), seconds, ROLLUP_SECONDS, 0, { 0 }, false },
+	[RESOLUTION_MINUTE] = { UINT64_C(60000000000), minutes, ROLLUP_MINUTES, 0, { 0 }, false },
+	[RESOLUTION_HOUR] = { UINT64_C(3600000000000), hours, ROLLUP_HOURS, 0, { 0 }, false }
+};
+
+
+// --------
+
+
+/*
+ * Merges a rollup into a longer one.
+ *
+ *  - into: Rollup to merge into.
+ *  - from: Rollup to merge.
+ */
+static void merge(rollup_t *into, const rollup_t *from) {
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (from->min[i] < into->min[i]) {
+			into->min[i] = from->min[i];
+		}
+
+		if (from->max[i] > into->max[i]) {
+			into->max[i] = from->max[i];
+		}
+
+		into->energy[i] += from->energy[i];
+	}
+
+	into->time += from->time;
+}
+
+
+/*
+ * Adds a rollup to the given resolution. If it belongs
+ * to the next period, the current one is complete and
+ * passed on to the next coarser resolution.
+ *
+ *  - resolution: Resolution to add to.
+ *  - rollup: Rollup to add.
+ */
+static void push(uint32_t resolution, const rollup_t *rollup) {
+	level_t *level = &levels[resolution];
+	uint64_t period = rollup->start / level->length;
+
+	if (level->open && period != level->current.start / level->length) {
+		level->ring[level->head % level->size] = level->current;
+		level->head++;
+
+		if (resolution + 1 < RESOLUTIONS) {
+			push(resolution + 1, &level->current);
+		}
+
+		level->open = false;
+	}
+
+	if (level->open) {
+		merge(&level->current, rollup);
+	} else {
+		level->current = *rollup;
+		level->current.start = period * level->length;
+		level->open = true;
+	}
+}
+
+
+// --------
+
+
+/*
+ * Adds a reading.
+ */
+void addrollup(uint64_t timestamp, const energy_t *total) {
+	rollup_t rollup;
+
+	// The first reading is just the baseline.
+	if (lasttimestamp && timestamp > lasttimestamp) {
+		rollup.start = timestamp;
+		rollup.time = (timestamp - lasttimestamp) / 1000000000.0;
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			rollup.energy[i] = total->domain[i] - lasttotal.domain[i];
+			rollup.min[i] = rollup.energy[i] / rollup.time;
+			rollup.max[i] = rollup.energy[i] / rollup.time;
+		}
+
+		push(RESOLUTION_SECOND, &rollup);
+	}
+
+	lasttimestamp = timestamp;
+	lasttotal = *total;
+}
+
+
+/*
+ * Copies the latest complete periods.
+ */
+uint32_t getrollups(resolution_e resolution, rollup_t *rollups, uint32_t count) {
+	level_t *level = &levels[resolution];
+	uint32_t copied = 0;
+
+	while (copied < count && copied < level->head && copied < level->size) {
+		rollups[copied] = level->ring[(level->head - 1 - copied) % level->size];
+		copied++;
+	}
+
+	return copied;
+}
+
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+#include "domain.h"
+#include "sampler.h"
+
+
+// --------
+
+
+/*
+ * Resolutions of the rollups.
+ */
+typedef enum resolution_e {
+	RESOLUTION_SECOND = 0,
+	RESOLUTION_MINUTE,
+	RESOLUTION_HOUR,
+	RESOLUTIONS
+} resolution_e;
+
+
+/*
+ * Power statistics of the whole machine over one period
+ * of a resolution, indexed by domain_e.
+ */
+typedef struct rollup_t {
+	// CLOCK_MONOTONIC start of the period in nanoseconds.
+	uint64_t start;
+
+	// Seconds covered by samples.
+	double time;
+
+	// Lowest and highest power seen in watts.
+	double min[DOMAINS];
+	double max[DOMAINS];
+
+	// Energy consumed in joule. The mean
+	// power is energy divided by time.
+	double energy[DOMAINS];
+} rollup_t;
+
+
+// --------
+
+
+/*
+ * Adds a reading to the rollups. The energy consumed since the
+ * last reading is accounted to the period the reading falls in.
+ * Once a period is complete it's stored in the ring of its
+ * resolution and merged into the next coarser resolution.
+ * Not thread safe, must be called from the main thread.
+ *
+ *  - timestamp: CLOCK_MONOTONIC time of the reading in nanoseconds.
+ *  - total: Energy consumed since startup in joule.
+ */
+void addrollup(uint64_t timestamp, const energy_t *total);
+
+
+/*
+ * Copies the latest complete periods of the given resolution,
+ * newest first. Returns the number of periods copied.
+ *
+ *  - resolution: Resolution to query.
+ *  - rollups: Filled with the periods.
+ *  - count: Maximum number of periods to copy.
+ */
+uint32_t getrollups(resolution_e resolution, rollup_t *rollups, uint32_t count);
+
+
+// --------
+
+#endif // ROLLUP_H_
+
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "domain.h"
+#include "main.h"
+#include "run.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Window the peak power is measured over in nanoseconds.
+#define RUN_WINDOW (50 * 1000 * 1000)
+
+// Two sided 95% quantiles of Students t-distribution for
+// 1 to 30 degrees of freedom. Above that it's close enough
+// to the normal distribution.
+static const double tquantiles[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+
+// --------
+
+
+/*
+ * Result of one run, summed over all packages.
+ */
+typedef struct result_t {
+	// Wall time in seconds.
+	double time;
+
+	// Energy in joule.
+	energy_t energy;
+
+	// Highest power over one window in watts.
+	energy_t peak;
+} result_t;
+
+
+// --------
+
+
+/*
+ * Runs the command once.
+ *
+ *  - result: Filled with the measurements.
+ *  - status: Filled with the commands wait status.
+ */
+static void runonce(result_t *result, int *status) {
+	counters_t start[MAX_PACKAGES];
+	counters_t end[MAX_PACKAGES];
+	sample_t samples[MAX_PACKAGES];
+	sigset_t chld;
+	sigset_t old;
+
+	memset(result, 0, sizeof(*result));
+
+	// Blocked before the samplers start, so they inherit
+	// it and the exit is reported to sigtimedwait() only.
+	sigemptyset(&chld);
+	sigaddset(&chld, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &chld, &old);
+
+	startsamplers(RUN_WINDOW);
+
+	uint64_t begin = getedge(start);
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		exit_error(1, "ERROR: Couldn't fork: %s\n", strerror(errno));
+	} else if (pid == 0) {
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		execvp(options.command[0], options.command);
+
+		fprintf(stderr, "ERROR: Couldn't execute %s: %s\n",
+				options.command[0], strerror(errno));
+		_exit(127);
+	}
+
+	// Throw away what was sampled before the start.
+	for (uint32_t p = 0; p < options.packages; p++) {
+		getsample(p, &samples[p]);
+	}
+
+	for (;;) {
+		struct timespec timeout = { 0, RUN_WINDOW };
+
+		if (waitpid(pid, status, WNOHANG) == pid) {
+			break;
+		}
+
+		// Woken up early by the exit.
+		sigtimedwait(&chld, NULL, &timeout);
+
+		energy_t power = { { 0 } };
+		bool fresh = false;
+
+		for (uint32_t p = 0; p < options.packages; p++) {
+			energy_t energy;
+
+			getsample(p, &samples[p]);
+
+			if (samples[p].time <= 0) {
+				continue;
+			}
+
+			getjoules(&samples[p], &samples[p].delta, &energy);
+
+			for (uint32_t i = 0; i < DOMAINS; i++) {
+				power.domain[i] += energy.domain[i] / samples[p].time;
+			}
+
+			fresh = true;
+		}
+
+		for (uint32_t i = 0; fresh && i < DOMAINS; i++) {
+			if (power.domain[i] > result->peak.domain[i]) {
+				result->peak.domain[i] = power.domain[i];
+			}
+		}
+	}
+
+	uint64_t finish = getedge(end);
+
+	stopsamplers();
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	result->time = (finish - begin) / 1000000000.0;
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		counters_t used;
+		energy_t energy;
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			used.domain[i] = end[p].domain[i] - start[p].domain[i];
+		}
+
+		getjoules(&samples[p], &used, &energy);
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			result->energy.domain[i] += energy.domain[i];
+		}
+	}
+
+	// Runs shorter than a window have no peak,
+	// and no window is below the average.
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		double average = result->time > 0 ? result->energy.domain[i] / result->time : 0;
+
+		if (result->peak.domain[i] < average) {
+			result->peak.domain[i] = average;
+		}
+	}
+}
+
+
+/*
+ * Prints one value, with it's spread over several runs.
+ *
+ *  - label: Printed in front of the value.
+ *  - values: Value of each run.
+ *  - count: Number of runs.
+ *  - unit: Unit of the value.
+ */
+static void printstat(const char *label, const double *values, uint32_t count,
+		const char *unit) {
+	double mean = 0;
+	double variance = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		mean += values[i];
+	}
+
+	mean /= count;
+
+	if (count == 1) {
+		fprintf(stderr, "  %-22s %14.3f %s\n", label, mean, unit);
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		variance += (values[i] - mean) * (values[i] - mean);
+	}
+
+	double stddev = sqrt(variance / (count - 1));
+	double t = (count - 1 <= 30) ? tquantiles[count - 2] : 1.960;
+	double ci = t * stddev / sqrt(count);
+
+	fprintf(stderr, "  %-22s %14.3f %-3s +- %.3f (95%% CI %.3f .. %.3f)\n",
+			label, mean, unit, stddev, mean - ci, mean + ci);
+}
+
+
+// --------
+
+
+/*
+ * Runs the command and prints the results.
+ */
+int32_t runcommand(void) {
+	uint32_t runs = 0;
+	int status = 0;
+
+	result_t *results = calloc(options.repeat, sizeof(result_t));
+	double *values = calloc(options.repeat, sizeof(double));
+
+	if (!results || !values) {
+		exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+	}
+
+	// A failing run stops the series, like an interrupt.
+	while (runs < options.repeat) {
+		runonce(&results[runs++], &status);
+
+		if (options.stop || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			break;
+		}
+	}
+
+	fprintf(stderr, "\nEnergy of '");
+
+	for (char **arg = options.command; *arg; arg++) {
+		fprintf(stderr, "%s%s", (arg == options.command) ? "" : " ", *arg);
+	}
+
+	fprintf(stderr, "' (%u run%s):\n\n", runs, (runs == 1) ? "" : "s");
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		char label[64];
+
+		if (!domains[i].present) {
+			continue;
+		}
+
+		for (uint32_t r = 0; r < runs; r++) {
+			values[r] = results[r].energy.domain[i];
+		}
+
+		printstat(domains[i].name, values, runs, "J");
+
+		for (uint32_t r = 0; r < runs; r++) {
+			values[r] = results[r].energy.domain[i] / results[r].time;
+		}
+
+		snprintf(label, sizeof(label), "%s average", domains[i].name);
+		printstat(label, values, runs, "W");
+
+		for (uint32_t r = 0; r < runs; r++) {
+			values[r] = results[r].peak.domain[i];
+		}
+
+		snprintf(label, sizeof(label), "%s peak", domains[i].name);
+		printstat(label, values, runs, "W");
+		fprintf(stderr, "\n");
+	}
+
+	for (uint32_t r = 0; r < runs; r++) {
+		values[r] = results[r].time;
+	}
+
+	printstat("Wall time", values, runs, "s");
+
+	// Package energy times wall time.
+	for (uint32_t r = 0; r < runs; r++) {
+		values[r] = results[r].energy.domain[DOMAIN_PKG] * results[r].time;
+	}
+
+	printstat("Energy-delay product", values, runs, "Js");
+	fprintf(stderr, "\n");
+
+	free(results);
+	free(values);
+
+	if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status);
+	}
+
+	return WEXITSTATUS(status);
+}
+
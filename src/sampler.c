@@ -0,0 +1,856 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__FreeBSD__)
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "domain.h"
+#include "main.h"
+#include "msr.h"
+#include "record.h"
+#include "sampler.h"
+
+
+// --------
+
+
+// Shortest interval between two samples in nanoseconds.
+#define SAMPLE_MIN_INTERVAL (50 * 1000 * 1000)
+
+// Package power assumed if PKG_INFO doesn't tell us.
+#define SAMPLE_MAX_POWER 1000.0
+
+// Fraction of the time until a wraparound we're sleeping.
+#define SAMPLE_WRAP_MARGIN 0.9
+
+// Longest wait for a counter update in nanoseconds. RAPL
+// updates about every millisecond, a counter that doesn't
+// move at all is given up on.
+#define SAMPLE_EDGE_TIMEOUT (5 * 1000 * 1000)
+
+
+// --------
+
+
+/*
+ * Multipliers used to calculate actual values from the raw data.
+ */
+typedef struct multipliers_t {
+	double energy;
+	double power;
+	double time;
+} multipliers_t;
+
+/*
+ * Maximum value of *_STATUS und *_THROTTLE MSR.
+ */
+typedef struct wraparound_t {
+	double status;
+	double throttle;
+} wraparound_t;
+
+/*
+ * Domains and throttling counters sampled on one package.
+ */
+typedef struct domainset_t {
+	// *_STATUS and throttling MSRs to read.
+	int32_t msrs[DOMAINS + THROTTLES];
+
+	// Domain of each MSR, DOMAINS + throttle_e
+	// for the throttling counters.
+	uint32_t index[DOMAINS + THROTTLES];
+
+	// Number of MSRs.
+	uint32_t count;
+} domainset_t;
+
+/*
+ * Raw state of the *_STATUS MSRs, indexed by domain_e,
+ * and of the throttling MSRs, indexed by throttle_e.
+ */
+typedef struct status_t {
+	uint32_t raw[DOMAINS];
+	uint32_t throttle[THROTTLES];
+} status_t;
+
+/*
+ * Energy consumed by one package. Allocated by the sampler
+ * thread after it was pinned, so it's local to the package.
+ */
+typedef struct sampler_t {
+	// Protects sample and status. Held while the
+	// counters are read, so samples are in order.
+	pthread_mutex_t lock;
+
+	// Accumulated since the last getsample().
+	sample_t sample;
+
+	// Raw counters at the latest sample.
+	status_t status;
+
+	// Domains sampled on the package.
+	domainset_t set;
+} sampler_t;
+
+
+// --------
+
+
+// Sampler threads, one per package.
+static pthread_t threads[MAX_PACKAGES];
+
+// State of each package.
+static sampler_t *samplers[MAX_PACKAGES];
+
+// Waited upon until all threads are initialized.
+static pthread_barrier_t ready;
+
+// If set the sampler threads exit.
+static uint32_t stop;
+
+// Signals stop to samplers sleeping until their deadline,
+// which may be minutes away.
+static pthread_mutex_t stoplock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stopcond;
+
+// Number of sampler threads that exited.
+static uint32_t finished;
+
+// Longest interval between two samples the caller accepts.
+static uint64_t interval;
+
+// Replay only. If set, samples are replayed up to the
+// horizon only, see pacesamplers().
+static bool paced;
+
+// Recorded time up to which samples are replayed.
+static uint64_t horizon;
+
+// How far the horizon is ahead of the record boundary.
+static uint64_t slack;
+
+// Bumped each time the horizon moves.
+static uint64_t generation;
+
+// Samplers waiting for the horizon in this generation.
+static uint32_t held;
+
+// Protects the above and signals their changes.
+static pthread_mutex_t pacelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pacecond = PTHREAD_COND_INITIALIZER;
+
+
+// --------
+
+
+/*
+ * Fills the given domainset_t struct with the domains
+ * and throttling counters sampled on the given package.
+ *
+ *  - package: Package to sample.
+ *  - *set: Struct to fill.
+ */
+static void getdomainset(uint32_t package, domainset_t *set) {
+	set->count = 0;
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (!domains[i].present) {
+			continue;
+		}
+
+		// Platform wide domains are sampled once.
+		if (domains[i].platform && package != 0) {
+			continue;
+		}
+
+		set->msrs[set->count] = domains[i].msr;
+		set->index[set->count] = i;
+		set->count++;
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		if (throttles[i].present) {
+			set->msrs[set->count] = throttles[i].msr;
+			set->index[set->count] = DOMAINS + i;
+			set->count++;
+		}
+	}
+}
+
+
+/*
+ * Fills the given status_t struct with the current state
+ * of the energy and throttling counters. The values are
+ * kept raw, they're converted when presented. Counters not
+ * in the set stay at 0.
+ *
+ *  - package: Package to read.
+ *  - *set: Domains to read.
+ *  - *status: Struct to fill.
+ */
+static void getstatus(uint32_t package, const domainset_t *set,
+		status_t *status) {
+	uint64_t data[DOMAINS + THROTTLES];
+
+	// All counters are read with one batch.
+	getmsrs(package, set->msrs, data, set->count);
+
+	// The upper 32 bits are reserved.
+	for (uint32_t i = 0; i < set->count; i++) {
+		if (set->index[i] < DOMAINS) {
+			status->raw[set->index[i]] = (uint32_t)data[i];
+		} else {
+			status->throttle[set->index[i] - DOMAINS] = (uint32_t)data[i];
+		}
+	}
+}
+
+
+/*
+ * Fills the given multipliers_t struct.
+ *
+ *  - package: Package to read.
+ *  - *multipliers: Struct to fill.
+ */
+static void getmultipliers(uint32_t package, multipliers_t *multipliers) {
+	int32_t msrs[1] = { UNIT_MULTIPLIER };
+	uint64_t msr;
+	unit_msr_t units;
+
+	getmsrs(package, msrs, &msr, 1);
+	memcpy(&units, &msr, sizeof(units));
+
+	multipliers->energy = 1.0 / (double)B2POW(units.energy);
+	multipliers->power = 1.0 / (double)B2POW(units.power);
+	multipliers->time = 1.0 / (double)B2POW(units.time);
+}
+
+
+/*
+ * Fills the given wraparound_t struct based upon the values
+ * in the given multipliers_t and the energy units. The
+ * domain with the smallest unit wraps first.
+ *
+ *  - *multi: multipliers_t struct to read values from.
+ *  - *units: Energy unit of each domain.
+ *  - *wrap: Struct to fill.
+ */
+static void getwraparounds(multipliers_t *multi, const double *units,
+		wraparound_t *wrap) {
+	double unit = multi->energy;
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		if (domains[i].present && units[i] < unit) {
+			unit = units[i];
+		}
+	}
+
+	wrap->status = (double)(unit * 4294967295); // 2^32-1
+	wrap->throttle = (double)(multi->time * 4294967295); // 2^32-1
+}
+
+
+/*
+ * Returns the longest interval between two samples in
+ * nanoseconds, that's safe for the given package. Even at
+ * maximum power the *_STATUS counters can't wrap more than
+ * once between two samples, so no wraparound is lost. The
+ * throttling counters advance at most at wall clock speed.
+ *
+ *  - package: Package to read.
+ *  - *multi: Struct to get correction multipliers from.
+ *  - *wrap: Struct to get the counters range from.
+ */
+static uint64_t getsafeinterval(uint32_t package, multipliers_t *multi,
+		wraparound_t *wrap) {
+	double maxpower = 0;
+
+	if (checkmsr(PKG_INFO)) {
+		int32_t msrs[1] = { PKG_INFO };
+		uint64_t msr;
+
+		info_msr_t info;
+
+		getmsrs(package, msrs, &msr, 1);
+		memcpy(&info, &msr, sizeof(info));
+
+		maxpower = info.maximum_power * multi->power;
+
+		// Some CPUs don't give a maximum.
+		if (info.thermal_spec_power * multi->power > maxpower) {
+			maxpower = info.thermal_spec_power * multi->power;
+		}
+	}
+
+	if (maxpower <= 0) {
+		maxpower = SAMPLE_MAX_POWER;
+	}
+
+	double seconds = wrap->status / maxpower * SAMPLE_WRAP_MARGIN;
+
+	if (wrap->throttle * SAMPLE_WRAP_MARGIN < seconds) {
+		seconds = wrap->throttle * SAMPLE_WRAP_MARGIN;
+	}
+
+	if (seconds * 1000000000.0 < SAMPLE_MIN_INTERVAL) {
+		return SAMPLE_MIN_INTERVAL;
+	}
+
+	return (uint64_t)(seconds * 1000000000.0);
+}
+
+
+/*
+ * Adds the energy consumed and the time throttled between
+ * last and cur to the sample. The counters are 32 bit wide,
+ * the modular subtraction takes care of a wraparound without
+ * a branch.
+ *
+ *  - cur: Current state of the counters.
+ *  - last: Last state of the counters.
+ *  - sample: Sample to add to.
+ */
+static inline void accumulate(const status_t *cur, const status_t *last,
+		sample_t *sample) {
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		uint32_t diff = cur->raw[i] - last->raw[i];
+
+		sample->delta.domain[i] += diff;
+		sample->total.domain[i] += diff;
+	}
+
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		uint32_t diff = cur->throttle[i] - last->throttle[i];
+
+		sample->throttled[i] += diff;
+		sample->throttledtotal[i] += diff;
+	}
+}
+
+
+/*
+ * Reads the counters of the given package and adds the
+ * energy consumed since the latest sample. The caller
+ * holds the samplers lock.
+ *
+ *  - package: Package to read.
+ *  - sampler: State of the package.
+ *  - timestamp: Recorded time of a replayed sample,
+ *               0 for the current time.
+ */
+static void readsample(uint32_t package, sampler_t *sampler, uint64_t timestamp) {
+	status_t status = { { 0 }, { 0 } };
+	sample_t *sample = &sampler->sample;
+
+	getstatus(package, &sampler->set, &status);
+
+	if (!timestamp) {
+		timestamp = gettime();
+	}
+
+	if (options.record) {
+		recordsample(package, timestamp, status.raw, status.throttle);
+	}
+
+	accumulate(&status, &sampler->status, sample);
+
+	sample->time += (timestamp - sample->timestamp) / 1000000000.0;
+	sample->timestamp = timestamp;
+	sampler->status = status;
+}
+
+
+/*
+ * Sleeps until the given CLOCK_MONOTONIC time
+ * or until stopsamplers() is called.
+ *
+ *  - deadline: Time to wake up in nanoseconds.
+ */
+static void sleepuntil(uint64_t deadline) {
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+
+	pthread_mutex_lock(&stoplock);
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)
+			&& pthread_cond_timedwait(&stopcond, &stoplock, &ts) != ETIMEDOUT);
+
+	pthread_mutex_unlock(&stoplock);
+}
+
+
+/*
+ * Pins the calling thread to the given CPU.
+ *
+ *  - cpu: CPU to pin to.
+ */
+static void pinthread(int32_t cpu) {
+#if defined(__FreeBSD__)
+	cpuset_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#elif defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)cpu;
+#endif
+}
+
+
+/*
+ * Waits until the horizon reaches the given recorded time.
+ * Returns false if the samplers were stopped meanwhile.
+ *
+ *  - timestamp: Recorded time of the next sample.
+ */
+static bool waithorizon(uint64_t timestamp) {
+	pthread_mutex_lock(&pacelock);
+
+	uint64_t seen = generation - 1;
+
+	while (timestamp > horizon && !__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		// Counted once per generation, so the consumer
+		// knows when all samplers are through.
+		if (seen != generation) {
+			seen = generation;
+			held++;
+			pthread_cond_broadcast(&pacecond);
+		}
+
+		pthread_cond_wait(&pacecond, &pacelock);
+	}
+
+	pthread_mutex_unlock(&pacelock);
+
+	return !__atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Sampler thread of one package. Samples the energy counters
+ * in the interval requested by the caller, but at least as
+ * often as necessary to never miss a counter wraparound. The
+ * deadlines are absolute, so the time spent sampling doesn't
+ * add up to a drift. Deadlines that have passed while we were
+ * late are counted and skipped.
+ *
+ *  - arg: Package number.
+ */
+static void *samplerthread(void *arg) {
+	uint32_t package = (uint32_t)(uintptr_t)arg;
+
+	// Reading the MSRs of a package from one of it's own
+	// CPUs saves the interprocessor interrupts.
+	if (options.cpus[package] != -1) {
+		pinthread(options.cpus[package]);
+	}
+
+	// Allocated after pinning, the first touch places
+	// the memory on the NUMA node of the package.
+	sampler_t *sampler = calloc(1, sizeof(sampler_t));
+
+	if (!sampler) {
+		exit_error(1, "%s\n", "ERROR: Couldn't allocate memory");
+	}
+
+	pthread_mutex_init(&sampler->lock, NULL);
+
+	multipliers_t multipliers;
+	getmultipliers(package, &multipliers);
+
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		sampler->sample.unit[i] = domains[i].unit ? domains[i].unit
+			: multipliers.energy;
+	}
+
+	sampler->sample.timeunit = multipliers.time;
+
+	wraparound_t wraparound;
+	getwraparounds(&multipliers, sampler->sample.unit, &wraparound);
+
+	getdomainset(package, &sampler->set);
+
+	// Wake up as seldom as possible.
+	uint64_t period = getsafeinterval(package, &multipliers, &wraparound);
+
+	if (interval < period) {
+		period = interval;
+	}
+
+	if (period < SAMPLE_MIN_INTERVAL) {
+		period = SAMPLE_MIN_INTERVAL;
+	}
+
+	// Replayed samples bring their own time.
+	uint64_t (*next)(int32_t fd) = options.backend->next;
+	int32_t fd = options.fds[package];
+	uint64_t first = next ? next(fd) : 0;
+
+	// Paced replays start at the first sample of package 0.
+	// Samples are taken a little after their deadlines, one
+	// up to half a period late still belongs to the record
+	// before.
+	if (next && paced && package == 0) {
+		pthread_mutex_lock(&pacelock);
+		horizon = first + period / 2;
+		slack = period / 2;
+		pthread_mutex_unlock(&pacelock);
+	}
+
+	getstatus(package, &sampler->set, &sampler->status);
+
+	uint64_t start = gettime();
+	uint64_t deadline = start;
+
+	sampler->sample.timestamp = next ? first : start;
+
+	if (options.record) {
+		recordsample(package, sampler->sample.timestamp, sampler->status.raw,
+				sampler->status.throttle);
+	}
+
+	samplers[package] = sampler;
+	pthread_barrier_wait(&ready);
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		if (next) {
+			uint64_t cur_time;
+
+			// At the recorded pace or as fast as possible.
+			if (!first || !(cur_time = next(fd))) {
+				break;
+			}
+
+			if (paced && !waithorizon(cur_time)) {
+				break;
+			}
+
+			if (!options.fast) {
+				sleepuntil(start + (cur_time - first));
+			}
+
+			pthread_mutex_lock(&sampler->lock);
+			readsample(package, sampler, cur_time);
+			pthread_mutex_unlock(&sampler->lock);
+		} else {
+			deadline += period;
+			sleepuntil(deadline);
+
+			pthread_mutex_lock(&sampler->lock);
+			readsample(package, sampler, 0);
+
+			// Skip the deadlines we've missed.
+			uint64_t missed = (sampler->sample.timestamp - deadline) / period;
+
+			sampler->sample.missed += missed;
+			pthread_mutex_unlock(&sampler->lock);
+
+			deadline += missed * period;
+		}
+	}
+
+	pthread_mutex_lock(&pacelock);
+	__atomic_add_fetch(&finished, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pacecond);
+	pthread_mutex_unlock(&pacelock);
+
+	return NULL;
+}
+
+
+// --------
+
+
+/*
+ * Starts one sampler thread for each package. The threads
+ * are pinned to a CPU of their package and sample it's energy
+ * counters until stopsamplers() is called. The samplers wake
+ * up at the given interval, or shorter if necessary to catch
+ * all counter wraparounds.
+ *
+ *  - period: Longest acceptable interval between two samples
+ *            in nanoseconds.
+ */
+void startsamplers(uint64_t period) {
+	sigset_t block;
+	sigset_t old;
+
+	interval = period;
+	horizon = 0;
+	slack = 0;
+	generation = 0;
+	held = 0;
+
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&stopcond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_barrier_init(&ready, NULL, options.packages + 1);
+	__atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&finished, 0, __ATOMIC_RELAXED);
+
+	// Signals are handled by the main thread.
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &block, &old);
+
+	for (uint32_t i = 0; i < options.packages; i++) {
+		if (pthread_create(&threads[i], NULL, samplerthread, (void *)(uintptr_t)i)) {
+			exit_error(1, "%s\n", "ERROR: Couldn't create sampler thread");
+		}
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	pthread_barrier_wait(&ready);
+	pthread_barrier_destroy(&ready);
+}
+
+
+/*
+ * Stops all sampler threads.
+ */
+void stopsamplers(void) {
+	pthread_mutex_lock(&stoplock);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	pthread_cond_broadcast(&stopcond);
+	pthread_mutex_unlock(&stoplock);
+
+	// Wakes up samplers waiting for the horizon.
+	pthread_mutex_lock(&pacelock);
+	pthread_cond_broadcast(&pacecond);
+	pthread_mutex_unlock(&pacelock);
+
+	for (uint32_t i = 0; i < options.packages; i++) {
+		pthread_join(threads[i], NULL);
+
+		pthread_mutex_destroy(&samplers[i]->lock);
+		free(samplers[i]);
+		samplers[i] = NULL;
+	}
+
+	pthread_cond_destroy(&stopcond);
+}
+
+
+/*
+ * Makes the next startsamplers() replay paced by
+ * advancesamplers() instead of on it's own.
+ */
+void pacesamplers(void) {
+	paced = true;
+}
+
+
+/*
+ * Lets the samplers replay the samples taken within the
+ * given interval after the last call, or after the first
+ * sample. Returns the recorded time they replay up to.
+ *
+ *  - period: Interval to replay in nanoseconds.
+ */
+uint64_t advancesamplers(uint64_t period) {
+	pthread_mutex_lock(&pacelock);
+
+	horizon += period;
+	generation++;
+	held = 0;
+	pthread_cond_broadcast(&pacecond);
+
+	uint64_t reached = horizon - slack;
+
+	pthread_mutex_unlock(&pacelock);
+
+	return reached;
+}
+
+
+/*
+ * Waits until the samplers replayed everything up to
+ * the horizon set by advancesamplers().
+ */
+void waitsamplers(void) {
+	pthread_mutex_lock(&pacelock);
+
+	while (held + __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < options.packages) {
+		pthread_cond_wait(&pacecond, &pacelock);
+	}
+
+	pthread_mutex_unlock(&pacelock);
+}
+
+
+/*
+ * Returns true if all sampler threads exited on their own,
+ * because the replayed recording ended.
+ */
+bool samplersdone(void) {
+	return __atomic_load_n(&finished, __ATOMIC_ACQUIRE) == options.packages;
+}
+
+
+/*
+ * Returns the energy consumed by the given package since the
+ * last call and since the samplers were started, together
+ * with the time covered by the samples.
+ *
+ *  - package: Package to query.
+ *  - sample: Struct to fill.
+ */
+void getsample(uint32_t package, sample_t *sample) {
+	sampler_t *sampler = samplers[package];
+
+	pthread_mutex_lock(&sampler->lock);
+
+	// Live counters are read right away, the samplers
+	// only need to wake up to catch the wraparounds.
+	if (!options.backend->next) {
+		readsample(package, sampler, 0);
+	}
+
+	*sample = sampler->sample;
+	memset(&sampler->sample.delta, 0, sizeof(sampler->sample.delta));
+	memset(sampler->sample.throttled, 0, sizeof(sampler->sample.throttled));
+	sampler->sample.time = 0;
+
+	pthread_mutex_unlock(&sampler->lock);
+}
+
+
+/*
+ * Waits for the next counter update and returns the
+ * energy consumed since start right after it.
+ */
+uint64_t getedge(counters_t *counters) {
+	int32_t msrs[1] = { domains[DOMAIN_PKG].msr };
+	uint64_t first;
+	uint64_t cur;
+	uint64_t now = gettime();
+	uint64_t timeout = now + SAMPLE_EDGE_TIMEOUT;
+
+	getmsrs(0, msrs, &first, 1);
+
+	do {
+		getmsrs(0, msrs, &cur, 1);
+		now = gettime();
+	} while ((uint32_t)cur == (uint32_t)first && now < timeout);
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		sampler_t *sampler = samplers[p];
+		status_t status = { { 0 }, { 0 } };
+
+		// Read under the lock, so the sampler can't
+		// store counters newer than ours meanwhile.
+		pthread_mutex_lock(&sampler->lock);
+
+		getstatus(p, &sampler->set, &status);
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			uint32_t diff = status.raw[i] - sampler->status.raw[i];
+			counters[p].domain[i] = sampler->sample.total.domain[i] + diff;
+		}
+
+		pthread_mutex_unlock(&sampler->lock);
+	}
+
+	return now;
+}
+
+
+/*
+ * Converts raw counters of the given sample to joule.
+ *
+ *  - sample: Sample the counters belong to.
+ *  - counters: Raw counters to convert.
+ *  - energy: Filled with the energy in joule.
+ */
+void getjoules(const sample_t *sample, const counters_t *counters,
+		energy_t *energy) {
+	for (uint32_t i = 0; i < DOMAINS; i++) {
+		energy->domain[i] = counters->domain[i] * sample->unit[i];
+	}
+}
+
+
+/*
+ * Converts the time throttled to a share of the sample.
+ *
+ *  - sample: Sample to convert.
+ *  - throttled: Filled with the share of each counter.
+ */
+void getthrottled(const sample_t *sample, throttled_t *throttled) {
+	for (uint32_t i = 0; i < THROTTLES; i++) {
+		double *percent = &throttled->throttle[i];
+
+		*percent = sample->time > 0
+			? 100.0 * sample->throttled[i] * sample->timeunit / sample->time : 0;
+
+		// The counters update at their own pace.
+		if (*percent > 100) {
+			*percent = 100;
+		}
+	}
+}
+
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t gettime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
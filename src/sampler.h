@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+
+// --------
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "domain.h"
+
+
+// --------
+
+
+/*
+ * Current state of energy counters (in joule),
+ * indexed by domain_e.
+ */
+typedef struct energy_t {
+	double domain[DOMAINS];
+} energy_t;
+
+
+/*
+ * Share of an interval the domains were throttled
+ * to enforce their power limit (in percent),
+ * indexed by throttle_e.
+ */
+typedef struct throttled_t {
+	double throttle[THROTTLES];
+} throttled_t;
+
+
+/*
+ * Energy counters in the raw unit of the package, as
+ * accumulated from the *_STATUS MSRs. Exact, they never
+ * drift. Indexed by domain_e, converted to joule
+ * with getjoules().
+ */
+typedef struct counters_t {
+	uint64_t domain[DOMAINS];
+} counters_t;
+
+
+/*
+ * Sample of one package, as returned by getsample().
+ */
+typedef struct sample_t {
+	// Energy since the last getsample().
+	counters_t delta;
+
+	// Energy since start.
+	counters_t total;
+
+	// Joule per raw counter unit.
+	double unit[DOMAINS];
+
+	// Time throttled since the last getsample() and since
+	// start in the raw time unit, indexed by throttle_e.
+	uint64_t throttled[THROTTLES];
+	uint64_t throttledtotal[THROTTLES];
+
+	// Seconds per raw time unit.
+	double timeunit;
+
+	// Seconds covered by delta, measured
+	// between the samples.
+	double time;
+
+	// CLOCK_MONOTONIC timestamp of the latest
+	// sample, in nanoseconds.
+	uint64_t timestamp;
+
+	// Sampling deadlines missed since start.
+	uint64_t missed;
+} sample_t;
+
+
+// --------
+
+
+/*
+ * Starts one sampler thread for each package. The threads
+ * are pinned to a CPU of their package and sample it's energy
+ * counters until stopsamplers() is called. The samplers wake
+ * up at the given interval, or shorter if necessary to catch
+ * all counter wraparounds. Since getsample() reads the live
+ * counters itself, UINT64_MAX lets them sleep as long as the
+ * wraparounds allow.
+ *
+ *  - period: Longest acceptable interval between two samples
+ *            in nanoseconds.
+ */
+void startsamplers(uint64_t period);
+
+
+/*
+ * Stops all sampler threads.
+ */
+void stopsamplers(void);
+
+
+/*
+ * Makes the next startsamplers() replay paced by
+ * advancesamplers() instead of on it's own.
+ */
+void pacesamplers(void);
+
+
+/*
+ * Lets the samplers replay the samples taken within the
+ * given interval after the last call, or after the first
+ * sample. Returns the recorded wall clock time they
+ * replay up to.
+ *
+ *  - period: Interval to replay in nanoseconds.
+ */
+uint64_t advancesamplers(uint64_t period);
+
+
+/*
+ * Waits until the samplers replayed everything up to
+ * the time returned by advancesamplers().
+ */
+void waitsamplers(void);
+
+
+/*
+ * Returns true if all sampler threads exited on their own,
+ * because the replayed recording ended.
+ */
+bool samplersdone(void);
+
+
+/*
+ * Returns the energy consumed by the given package since the
+ * last call and since the samplers were started, together
+ * with the time covered by the samples. Live counters are
+ * read right away, replayed ones as far as the replay got.
+ *
+ *  - package: Package to query.
+ *  - sample: Struct to fill.
+ */
+void getsample(uint32_t package, sample_t *sample);
+
+
+/*
+ * Waits for the next update of the package energy counter
+ * of package 0 and returns the energy consumed by each
+ * package since the samplers were started, read right
+ * after the update. RAPL updates it's counters about once
+ * a millisecond. Measuring from one update to another
+ * removes the quantization at both ends of short runs.
+ * Returns the CLOCK_MONOTONIC time of the update in
+ * nanoseconds.
+ *
+ *  - counters: Filled with the energy of each package.
+ */
+uint64_t getedge(counters_t *counters);
+
+
+/*
+ * Converts raw counters of the given sample to joule.
+ *
+ *  - sample: Sample the counters belong to.
+ *  - counters: Raw counters to convert.
+ *  - energy: Filled with the energy in joule.
+ */
+void getjoules(const sample_t *sample, const counters_t *counters,
+		energy_t *energy);
+
+
+/*
+ * Converts the time throttled since the last getsample() into
+ * the share of the time covered by the sample in percent.
+ *
+ *  - sample: Sample to convert.
+ *  - throttled: Filled with the share of each counter.
+ */
+void getthrottled(const sample_t *sample, throttled_t *throttled);
+
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t gettime(void);
+
+
+// --------
+
+#endif // SAMPLER_H_
+
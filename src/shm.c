@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "domain.h"
+#include "main.h"
+#include "pmshm.h"
+#include "shm.h"
+
+
+// --------
+
+
+// Number of records in the ring. Must be a power of 2.
+#define SHM_RECORDS 4096
+
+
+// --------
+
+
+// Records are indexed by domain_e and throttle_e.
+typedef char shm_domains_t[(PMSHM_DOMAINS == DOMAINS) ? 1 : -1];
+typedef char shm_throttles_t[(PMSHM_THROTTLES == THROTTLES) ? 1 : -1];
+
+// The segment, NULL if none is open.
+static pmshm_header_t *shm;
+
+// Name of the segment.
+static char shmname[256];
+
+
+// --------
+
+
+/*
+ * Creates the segment.
+ */
+void openshm(const char *name, uint32_t present, uint64_t interval) {
+	// Portable names start with a slash.
+	snprintf(shmname, sizeof(shmname), "%s%s", (name[0] == '/') ? "" : "/", name);
+
+	// A segment left by an earlier run may still be mapped by
+	// readers. Truncating it would SIGBUS them, so it's unlinked
+	// and they keep the old segment until they reopen.
+	shm_unlink(shmname);
+
+	int32_t fd = shm_open(shmname, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd == -1) {
+		exit_error(1, "ERROR: Couldn't create shared memory %s\n", shmname);
+	}
+
+	size_t size = pmshm_size(SHM_RECORDS);
+
+	if (ftruncate(fd, size) == -1) {
+		close(fd);
+		shm_unlink(shmname);
+		exit_error(1, "ERROR: Couldn't resize shared memory %s\n", shmname);
+	}
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		shm_unlink(shmname);
+		exit_error(1, "ERROR: Couldn't map shared memory %s\n", shmname);
+	}
+
+	// ftruncate() zeroed the ring, all
+	// records are 'not written yet'.
+	shm = map;
+	shm->version = PMSHM_VERSION;
+	shm->records = SHM_RECORDS;
+	shm->present = present;
+	shm->interval = interval;
+	shm->head = 0;
+
+	// Readers check the magic first.
+	__atomic_store_n(&shm->magic, PMSHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Publishes one record.
+ */
+void publishshm(uint64_t timestamp, uint64_t realtime, uint64_t missed,
+		const double *power, const double *energy, const double *throttled) {
+	uint64_t n = shm->head;
+	pmshm_record_t *slot = &shm->ring[n & (SHM_RECORDS - 1)];
+
+	// Odd while writing.
+	__atomic_store_n(&slot->seq, 2 * n + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->timestamp = timestamp;
+	slot->realtime = realtime;
+	slot->missed = missed;
+	memcpy(slot->power, power, sizeof(slot->power));
+	memcpy(slot->energy, energy, sizeof(slot->energy));
+	memcpy(slot->throttled, throttled, sizeof(slot->throttled));
+
+	__atomic_store_n(&slot->seq, 2 * (n + 1), __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->head, n + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Removes the segment.
+ */
+void closeshm(void) {
+	if (!shm) {
+		return;
+	}
+
+	munmap(shm, pmshm_size(SHM_RECORDS));
+	shm_unlink(shmname);
+	shm = NULL;
+}
+
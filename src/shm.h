@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef SHM_H_
+#define SHM_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+
+// --------
+
+
+/*
+ * Creates the shared memory segment with the given name
+ * and an empty ring. Aborts the program on error.
+ *
+ *  - name: Name of the segment.
+ *  - present: Bitmask of present domains and throttling counters.
+ *  - interval: Interval between two records in nanoseconds.
+ */
+void openshm(const char *name, uint32_t present, uint64_t interval);
+
+
+/*
+ * Publishes one record, overwriting the oldest one if
+ * the ring is full.
+ *
+ *  - timestamp: CLOCK_MONOTONIC time in nanoseconds.
+ *  - realtime: CLOCK_REALTIME time in nanoseconds.
+ *  - missed: Sampling deadlines missed since start.
+ *  - power: Power of each domain in watts.
+ *  - energy: Energy of each domain since start in joule.
+ *  - throttled: Share of the interval each throttling
+ *               counter was throttled in percent.
+ */
+void publishshm(uint64_t timestamp, uint64_t realtime, uint64_t missed,
+		const double *power, const double *energy, const double *throttled);
+
+
+/*
+ * Unmaps and removes the segment. Readers that
+ * have it still mapped can continue to read.
+ */
+void closeshm(void);
+
+
+// --------
+
+#endif // SHM_H_
+
@@ -0,0 +1,547 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "domain.h"
+#include "main.h"
+#include "pmts.h"
+#include "sampler.h"
+#include "store.h"
+
+
+// --------
+
+
+// Blocks per file, a new file is started
+// when it's full. 16MB per file.
+#define STORE_BLOCKS 4096
+
+// Blocks waiting for the writer.
+#define STORE_QUEUE 16
+
+// Interval the block being filled is copied to
+// a shadow slot in milliseconds. That's what's
+// lost at most when the machine crashes.
+#define STORE_SYNC 10000
+
+
+// --------
+
+
+// Domains in the file are indexed by domain_e.
+typedef char store_domains_t[(PMTS_PLATFORM == DOMAIN_PLATFORM) ? 1 : -1];
+
+
+/*
+ * Compression state of the block being filled,
+ * the counterpart of pmts_cursor_t.
+ */
+typedef struct encoder_t {
+	// Previous timestamp and delta.
+	uint64_t time;
+	int64_t delta;
+
+	// Previous value and it's meaningful bits of each column.
+	uint64_t value[PMTS_COLUMNS];
+	uint8_t leading[PMTS_COLUMNS];
+	uint8_t trailing[PMTS_COLUMNS];
+
+	// Set if the block is full.
+	bool overflow;
+} encoder_t;
+
+
+/*
+ * A block waiting to be written.
+ */
+typedef struct job_t {
+	// Creation time of the file, names it.
+	uint64_t created;
+
+	// Number of the block in the file.
+	uint32_t index;
+
+	// Set if the block is complete and goes to it's
+	// final position, otherwise it's a shadow copy.
+	bool sealed;
+
+	pmts_block_t block;
+} job_t;
+
+
+// --------
+
+
+// Directory the files are stored in.
+static char storedir[PATH_MAX];
+
+// Header of all files, columns is 0 if the store isn't open.
+static pmts_header_t header;
+
+// The block being filled.
+static pmts_block_t current;
+static encoder_t encoder;
+static uint64_t created;
+static uint32_t blockindex;
+static uint64_t synced;
+
+// Last reading, the records are the mean power between two.
+static uint64_t lasttimestamp;
+static energy_t lasttotal[MAX_PACKAGES];
+
+// CLOCK_REALTIME and CLOCK_MONOTONIC at the first reading. Records
+// are timestamped relative to it, so the deltas are free of clock
+// adjustments.
+static uint64_t firstrealtime;
+static uint64_t firsttimestamp;
+
+// Queue to the writer, guarded by lock.
+static job_t queue[STORE_QUEUE];
+static uint64_t queuehead;
+static uint64_t queuetail;
+static bool stopping;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+// Problems, reported at exit.
+static uint64_t dropped;
+static bool failed;
+
+
+// --------
+
+
+/*
+ * Appends bits to the block. Sets the overflow flag
+ * if they don't fit.
+ *
+ *  - value: Bits to append, right aligned.
+ *  - count: Number of bits, at most 64.
+ */
+static void putbits(uint64_t value, uint32_t count) {
+	if (current.bits + count > sizeof(current.data) * 8) {
+		encoder.overflow = true;
+		return;
+	}
+
+	for (uint32_t i = count; i > 0; i--) {
+		uint32_t bit = current.bits++;
+		uint8_t mask = 0x80 >> (bit % 8);
+
+		if ((value >> (i - 1)) & 1) {
+			current.data[bit / 8] |= mask;
+		} else {
+			current.data[bit / 8] &= ~mask;
+		}
+	}
+}
+
+
+/*
+ * Compresses one record into the block.
+ * Returns false if it doesn't fit.
+ *
+ *  - time: CLOCK_REALTIME time in milliseconds.
+ *  - values: Value of each column.
+ */
+static bool encode(uint64_t time, const double *values) {
+	if (current.records == 0) {
+		putbits(time, 64);
+	} else {
+		int64_t delta = time - encoder.time;
+		int64_t dod = delta - encoder.delta;
+
+		// Two's complement, the reader sign extends.
+		if (dod == 0) {
+			putbits(0, 1);
+		} else if (dod >= -64 && dod <= 63) {
+			putbits(0x2, 2);
+			putbits(dod & 0x7f, 7);
+		} else if (dod >= -256 && dod <= 255) {
+			putbits(0x6, 3);
+			putbits(dod & 0x1ff, 9);
+		} else if (dod >= -2048 && dod <= 2047) {
+			putbits(0xe, 4);
+			putbits(dod & 0xfff, 12);
+		} else {
+			putbits(0xf, 4);
+			putbits(dod, 64);
+		}
+
+		encoder.delta = delta;
+	}
+
+	encoder.time = time;
+
+	for (uint32_t i = 0; i < header.columns; i++) {
+		double quantized = round(values[i] * PMTS_RESOLUTION);
+		uint64_t value;
+
+		memcpy(&value, &quantized, sizeof(value));
+
+		// No window yet, the next XOR brings one.
+		if (current.records == 0) {
+			putbits(value, 64);
+			encoder.value[i] = value;
+			encoder.leading[i] = 64;
+			encoder.trailing[i] = 0;
+			continue;
+		}
+
+		uint64_t xor = value ^ encoder.value[i];
+		encoder.value[i] = value;
+
+		if (!xor) {
+			putbits(0, 1);
+			continue;
+		}
+
+		uint32_t leading = __builtin_clzll(xor);
+		uint32_t trailing = __builtin_ctzll(xor);
+
+		// Only 5 bits for the leading zeros.
+		if (leading > 31) {
+			leading = 31;
+		}
+
+		// The previous window is reused as long as it's not
+		// wasting more bits than a new one costs to describe.
+		uint32_t wasted = (leading - encoder.leading[i]) + (trailing - encoder.trailing[i]);
+
+		if (leading >= encoder.leading[i] && trailing >= encoder.trailing[i] && wasted <= 11) {
+			putbits(0x2, 2);
+			putbits(xor >> encoder.trailing[i], 64 - encoder.leading[i] - encoder.trailing[i]);
+		} else {
+			uint32_t length = 64 - leading - trailing;
+
+			putbits(0x3, 2);
+			putbits(leading, 5);
+			putbits(length - 1, 6);
+			putbits(xor >> trailing, length);
+
+			encoder.leading[i] = leading;
+			encoder.trailing[i] = trailing;
+		}
+	}
+
+	return !encoder.overflow;
+}
+
+
+/*
+ * Hands a copy of the block to the writer. Never
+ * waits, the copy is dropped if the queue is full.
+ *
+ *  - sealed: Set if the block is complete.
+ */
+static void submit(bool sealed) {
+	current.magic = PMTS_BLOCK_MAGIC;
+	current.checksum = pmts_checksum(&current);
+
+	pthread_mutex_lock(&lock);
+
+	// A newer copy of a block replaces the queued one,
+	// unless the writer is already working on it.
+	job_t *last = &queue[(queuehead - 1) % STORE_QUEUE];
+
+	if (queuehead - queuetail >= 2 && last->created == created && last->index == blockindex) {
+		memcpy(&last->block, &current, sizeof(current));
+		last->sealed = sealed;
+	} else if (queuehead - queuetail == STORE_QUEUE) {
+		dropped++;
+	} else {
+		job_t *job = &queue[queuehead % STORE_QUEUE];
+
+		job->created = created;
+		job->index = blockindex;
+		job->sealed = sealed;
+		memcpy(&job->block, &current, sizeof(current));
+
+		queuehead++;
+		pthread_cond_signal(&wakeup);
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	synced = current.last;
+}
+
+
+/*
+ * Appends one record, starting a new block or
+ * a new file if necessary.
+ *
+ *  - time: CLOCK_REALTIME time in milliseconds.
+ *  - values: Value of each column.
+ */
+static void append(uint64_t time, const double *values) {
+	if (!created) {
+		created = time;
+	}
+
+	uint32_t bits = current.bits;
+
+	if (!encode(time, values)) {
+		// The block is complete without this record.
+		current.bits = bits;
+		submit(true);
+
+		if (++blockindex == STORE_BLOCKS) {
+			created = time;
+			blockindex = 0;
+		}
+
+		memset(&current, 0, sizeof(current));
+		memset(&encoder, 0, sizeof(encoder));
+
+		encode(time, values);
+	}
+
+	if (current.records == 0) {
+		current.first = time;
+	}
+
+	current.last = time;
+	current.records++;
+
+	if (current.last - synced >= STORE_SYNC) {
+		submit(false);
+	}
+}
+
+
+/*
+ * Creates a file with it's header and empty shadow slots.
+ *
+ *  - time: Creation time of the file in milliseconds.
+ */
+static int32_t createfile(uint64_t time) {
+	char path[PATH_MAX];
+	uint8_t block[(1 + PMTS_SHADOWS) * PMTS_BLOCK] = { 0 };
+
+	if (snprintf(path, sizeof(path), "%s/powermon-%" PRIu64 ".pmts", storedir, time) >= (int32_t)sizeof(path)) {
+		return -1;
+	}
+
+	int32_t fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd == -1) {
+		return -1;
+	}
+
+	header.created = time;
+	memcpy(block, &header, sizeof(header));
+
+	if (pwrite(fd, block, sizeof(block), 0) != sizeof(block) || fsync(fd) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	// Make sure the file itself survives a crash.
+	int32_t dirfd = open(storedir, O_RDONLY);
+
+	if (dirfd != -1) {
+		fsync(dirfd);
+		close(dirfd);
+	}
+
+	return fd;
+}
+
+
+/*
+ * Writes the queued blocks to disk.
+ */
+static void *writeblocks(void *arg) {
+	(void)arg;
+
+	int32_t fd = -1;
+	uint64_t file = 0;
+	uint32_t shadow = 0;
+
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		while (queuehead == queuetail && !stopping) {
+			pthread_cond_wait(&wakeup, &lock);
+		}
+
+		if (queuehead == queuetail) {
+			break;
+		}
+
+		// The slot isn't reused before the tail moves on.
+		job_t *job = &queue[queuetail % STORE_QUEUE];
+		pthread_mutex_unlock(&lock);
+
+		if (fd == -1 || job->created != file) {
+			if (fd != -1) {
+				close(fd);
+			}
+
+			file = job->created;
+			fd = createfile(file);
+		}
+
+		// Shadow copies alternate, a torn one leaves the previous.
+		off_t offset = job->sealed
+			? (off_t)(job->index + 1 + PMTS_SHADOWS) * PMTS_BLOCK
+			: (off_t)(++shadow % PMTS_SHADOWS + 1) * PMTS_BLOCK;
+
+		if (fd == -1
+				|| pwrite(fd, &job->block, PMTS_BLOCK, offset) != PMTS_BLOCK
+				|| fdatasync(fd) == -1) {
+			failed = true;
+		}
+
+		pthread_mutex_lock(&lock);
+		queuetail++;
+	}
+
+	pthread_mutex_unlock(&lock);
+
+	if (fd != -1) {
+		close(fd);
+	}
+
+	return NULL;
+}
+
+
+// --------
+
+
+/*
+ * Starts the store.
+ */
+void openstore(const char *dir) {
+	snprintf(storedir, sizeof(storedir), "%s", dir);
+
+	if (mkdir(storedir, 0755) == -1 && errno != EEXIST) {
+		exit_error(1, "ERROR: Couldn't create %s: %s\n", storedir, strerror(errno));
+	}
+
+	header.magic = PMTS_MAGIC;
+	header.version = PMTS_VERSION;
+	header.block = PMTS_BLOCK;
+
+	// Platform wide domains are sampled once.
+	for (uint32_t p = 0; p < options.packages; p++) {
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			if (!domains[i].present || (domains[i].platform && p != 0)) {
+				continue;
+			}
+
+			header.package[header.columns] = p;
+			header.domain[header.columns] = i;
+			header.columns++;
+		}
+	}
+
+	if (pthread_create(&writer, NULL, writeblocks, NULL) != 0) {
+		header.columns = 0;
+		exit_error(1, "ERROR: Couldn't start the store writer\n");
+	}
+}
+
+
+/*
+ * Appends one record.
+ */
+void storesample(uint64_t timestamp, const energy_t *total) {
+	if (!header.columns) {
+		return;
+	}
+
+	if (!lasttimestamp) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		firstrealtime = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+		firsttimestamp = timestamp;
+	} else if (timestamp > lasttimestamp) {
+		double seconds = (timestamp - lasttimestamp) / 1000000000.0;
+		double values[PMTS_COLUMNS];
+
+		for (uint32_t i = 0; i < header.columns; i++) {
+			uint32_t p = header.package[i];
+			uint32_t d = header.domain[i];
+
+			values[i] = (total[p].domain[d] - lasttotal[p].domain[d]) / seconds;
+		}
+
+		append(firstrealtime + (timestamp - firsttimestamp) / 1000000, values);
+	}
+
+	memcpy(lasttotal, total, options.packages * sizeof(energy_t));
+	lasttimestamp = timestamp;
+}
+
+
+/*
+ * Stops the store.
+ */
+void closestore(void) {
+	if (!header.columns) {
+		return;
+	}
+
+	if (current.records) {
+		submit(false);
+	}
+
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&wakeup);
+	pthread_mutex_unlock(&lock);
+
+	pthread_join(writer, NULL);
+	header.columns = 0;
+
+	if (dropped) {
+		fprintf(stderr, "WARNING: %" PRIu64 " blocks weren't written to %s, the disk was too slow\n",
+				dropped, storedir);
+	}
+
+	if (failed) {
+		fprintf(stderr, "WARNING: Couldn't write to %s\n", storedir);
+	}
+}
+
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#ifndef STORE_H_
+#define STORE_H_
+
+
+// --------
+
+
+#include <stdint.h>
+
+#include "sampler.h"
+
+
+// --------
+
+
+/*
+ * Starts the time series store in the given directory,
+ * which is created if necessary. The layout of the files
+ * is described in pmts.h. Aborts the program on error.
+ *
+ *  - dir: Directory to store the files in.
+ */
+void openstore(const char *dir);
+
+
+/*
+ * Appends one record with the mean power of each package
+ * and domain since the last call. Never waits for the disk,
+ * the files are written by a thread of their own. Must be
+ * called from the main thread.
+ *
+ *  - timestamp: CLOCK_MONOTONIC time of the reading in nanoseconds.
+ *  - total: Energy consumed since startup by each package in joule.
+ */
+void storesample(uint64_t timestamp, const energy_t *total);
+
+
+/*
+ * Writes the pending records and stops the store.
+ */
+void closestore(void);
+
+
+// --------
+
+#endif // STORE_H_
+
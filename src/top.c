@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2017 Y. Burmeister
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */ 
+
+#include <ncurses.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "domain.h"
+#include "main.h"
+#include "procs.h"
+#include "sampler.h"
+#include "top.h"
+
+
+// --------
+
+
+// Interval between two updates in nanoseconds.
+#define TOP_INTERVAL (1000 * 1000 * 1000)
+
+// Most processes shown.
+#define TOP_ROWS 256
+
+// First row of the process list.
+#define TOP_FIRST 3
+
+
+// --------
+
+
+/*
+ * Returns the energy consumed since start, summed
+ * over all packages.
+ *
+ *  - total: Filled with the energy.
+ *  - timestamp: Filled with the time of the latest sample.
+ */
+static void gettotal(energy_t *total, uint64_t *timestamp) {
+	memset(total, 0, sizeof(*total));
+
+	for (uint32_t p = 0; p < options.packages; p++) {
+		sample_t sample;
+		energy_t energy;
+
+		getsample(p, &sample);
+		getjoules(&sample, &sample.total, &energy);
+
+		for (uint32_t i = 0; i < DOMAINS; i++) {
+			total->domain[i] += energy.domain[i];
+		}
+
+		if (p == 0) {
+			*timestamp = sample.timestamp;
+		}
+	}
+}
+
+
+// --------
+
+
+/*
+ * Prints the process list.
+ */
+void top(void) {
+	const proc_t *list[TOP_ROWS];
+	energy_t last;
+	energy_t total;
+	uint64_t lasttime = 0;
+	uint64_t now = 0;
+	uint64_t lastscan;
+
+
+	// Initialize curses.
+	initscr();
+	cbreak();
+	keypad(stdscr, TRUE);
+	noecho();
+	nodelay(stdscr, TRUE);
+	curs_set(0);
+
+
+	// Start sampling and take the baseline. The counters
+	// are read for each update, the samplers only catch
+	// the wraparounds.
+	openprocs();
+	startsamplers(UINT64_MAX);
+
+	gettotal(&last, &lasttime);
+	scanprocs();
+	lastscan = gettime();
+
+
+	// Print static fields once
+	attron(A_BOLD);
+	mvprintw(TOP_FIRST - 1, 0, "    PID  %-19s %6s %9s %10s %9s %10s",
+			"COMMAND", "CPU%", "PKG W", "CORES W", "PKG J", "CORES J");
+	attroff(A_BOLD);
+
+	while (1) {
+		// One update every second.
+		usleep(TOP_INTERVAL / 1000);
+
+		// Interrupted by a signal.
+		if (options.stop) {
+			break;
+		}
+
+		gettotal(&total, &now);
+
+		double seconds = (now - lasttime) / 1000000000.0;
+		double pkg = total.domain[DOMAIN_PKG] - last.domain[DOMAIN_PKG];
+		double pp0 = total.domain[DOMAIN_PP0] - last.domain[DOMAIN_PP0];
+
+		// The CPU times are taken by the scan, so are
+		// the process shares.
+		uint32_t count = scanprocs();
+		uint64_t scan = gettime();
+		double scanned = (scan - lastscan) / 1000000000.0;
+
+		attributeprocs(pkg, pp0, scanned);
+
+		last = total;
+		lasttime = now;
+		lastscan = scan;
+
+		// Whole machine.
+		move(0, 0);
+		clrtoeol();
+
+		if (seconds > 0) {
+			mvprintw(0, 1, "Package: %.2fW   x86 Cores: %.2fW   Processes: %u",
+					pkg / seconds, pp0 / seconds, count);
+		}
+
+		// As many processes as fit on the screen.
+		uint32_t rows = (LINES > TOP_FIRST) ? LINES - TOP_FIRST : 0;
+
+		if (rows > TOP_ROWS) {
+			rows = TOP_ROWS;
+		}
+
+		uint32_t shown = gettopprocs(list, rows);
+
+		for (uint32_t r = 0; r < rows; r++) {
+			move(TOP_FIRST + r, 0);
+			clrtoeol();
+
+			if (r < shown) {
+				const proc_t *proc = list[r];
+
+				mvprintw(TOP_FIRST + r, 0, "%7d  %-19s %6.1f %9.2f %10.2f %9.1f %10.1f",
+						proc->pid, proc->comm, (scanned > 0) ? proc->delta / (scanned * 10000000.0) : 0,
+						proc->pkg_power, proc->pp0_power, proc->pkg_energy, proc->pp0_energy);
+			}
+		}
+
+		// Print the new data
+		refresh();
+
+		// Quit?
+		int32_t ch;
+
+		while ((ch = getch()) != ERR) {
+			switch (ch) {
+				case 'q':
+				case 'Q':
+				case 27:
+					options.stop = 1;
+			}
+		}
+
+		if (options.stop) {
+			break;
+		}
+	}
+
+	// Stop sampling.
+	stopsamplers();
+	closeprocs();
+
+	// Quit curses.
+	endwin();
+}
+